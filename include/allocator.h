@@ -0,0 +1,294 @@
+#ifndef _ALLOCATOR_H_
+#define _ALLOCATOR_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "./utils.h"
+#include "types.h"
+
+#define ALLOCATOR_ALIGNMENT 64
+#define ALLOCATOR_ALIGNED_SIZE(size) (((size) + ALLOCATOR_ALIGNMENT - 1) / ALLOCATOR_ALIGNMENT * ALLOCATOR_ALIGNMENT)
+#define POOL_MIN_CLASS_SHIFT 6
+#define POOL_CLASSES_COUNT 20
+#define ARENA_DEFAULT_BLOCK_SIZE (4 * 1024 * 1024)
+#define DEALLOCATE_MEMORY(...) deallocate_memory(sizeof((void*[]){__VA_ARGS__}) / sizeof(void*), __VA_ARGS__)
+
+// Backend of the allocation functions: alloc returns a block of at least size bytes aligned to ALLOCATOR_ALIGNMENT
+// and reports its real capacity, free gets the block back together with that capacity
+typedef struct Allocator {
+    void* (*alloc)(void* state, size_t size, size_t* capacity);
+    void (*free)(void* state, void* block, size_t capacity);
+    void* state;
+} Allocator;
+
+// Stored right before every block handed out, so that memory always returns to the allocator it came from,
+// once the last of the references taken through retain_memory has been released
+typedef struct AllocationHeader {
+    Allocator* allocator;
+    size_t size;
+    size_t capacity;
+    atomic_uint references;
+} AllocationHeader;
+
+typedef struct PoolAllocator {
+    pthread_mutex_t lock;
+    void* free_lists[POOL_CLASSES_COUNT];
+} PoolAllocator;
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+} ArenaBlock;
+
+typedef struct ArenaAllocator {
+    pthread_mutex_t lock;
+    ArenaBlock* blocks;
+    ArenaBlock* current;
+    size_t block_size;
+} ArenaAllocator;
+
+void deallocate_memory(int len, ...);
+void* alloc_memory_from(Allocator* allocator, size_t count, size_t size);
+Allocator* create_arena_allocator(size_t block_size);
+void destroy_arena_allocator(Allocator* allocator);
+void reset_arena_allocator(Allocator* allocator);
+void* realloc_memory(void* ptr, size_t size);
+void* alloc_memory(size_t count, size_t size);
+void* alloc_memory_uninit(size_t count, size_t size);
+void set_allocator(Allocator* allocator);
+Allocator* get_heap_allocator(void);
+Allocator* get_pool_allocator(void);
+bool is_memory_shared(void* ptr);
+void release_pool_allocator(void);
+void* retain_memory(void* ptr);
+Allocator* get_allocator(void);
+void free_memory(void* ptr);
+
+/* ------------------------------------------------------------------------------------------------ */
+
+static void* heap_alloc(void* state, size_t size, size_t* capacity) {
+    NOT_USED(state);
+    *capacity = ALLOCATOR_ALIGNED_SIZE(size);
+    return aligned_alloc(ALLOCATOR_ALIGNMENT, *capacity);
+}
+
+static void heap_free(void* state, void* block, size_t capacity) {
+    NOT_USED(state);
+    NOT_USED(capacity);
+    free(block);
+    return;
+}
+
+Allocator* get_heap_allocator(void) {
+    static Allocator heap_allocator = { .alloc = heap_alloc, .free = heap_free, .state = NULL };
+    return &heap_allocator;
+}
+
+static void* pool_alloc(void* state, size_t size, size_t* capacity) {
+    PoolAllocator* pool = (PoolAllocator*) state;
+    unsigned int size_class = 0;
+    while ((size_class < POOL_CLASSES_COUNT) && (((size_t) 1 << (size_class + POOL_MIN_CLASS_SHIFT)) < size)) size_class++;
+    if (size_class == POOL_CLASSES_COUNT) return heap_alloc(NULL, size, capacity);
+
+    *capacity = (size_t) 1 << (size_class + POOL_MIN_CLASS_SHIFT);
+    pthread_mutex_lock(&(pool -> lock));
+    void* block = pool -> free_lists[size_class];
+    if (block != NULL) pool -> free_lists[size_class] = *CAST_PTR(block, void*);
+    pthread_mutex_unlock(&(pool -> lock));
+
+    return block != NULL ? block : aligned_alloc(ALLOCATOR_ALIGNMENT, *capacity);
+}
+
+static void pool_free(void* state, void* block, size_t capacity) {
+    PoolAllocator* pool = (PoolAllocator*) state;
+    unsigned int size_class = 0;
+    while ((size_class < POOL_CLASSES_COUNT) && (((size_t) 1 << (size_class + POOL_MIN_CLASS_SHIFT)) != capacity)) size_class++;
+    if (size_class == POOL_CLASSES_COUNT) {
+        free(block);
+        return;
+    }
+
+    pthread_mutex_lock(&(pool -> lock));
+    *CAST_PTR(block, void*) = pool -> free_lists[size_class];
+    pool -> free_lists[size_class] = block;
+    pthread_mutex_unlock(&(pool -> lock));
+
+    return;
+}
+
+static PoolAllocator pool_state = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+Allocator* get_pool_allocator(void) {
+    static Allocator pool_allocator = { .alloc = pool_alloc, .free = pool_free, .state = &pool_state };
+    return &pool_allocator;
+}
+
+void release_pool_allocator(void) {
+    pthread_mutex_lock(&(pool_state.lock));
+    for (unsigned int i = 0; i < POOL_CLASSES_COUNT; ++i) {
+        while (pool_state.free_lists[i] != NULL) {
+            void* block = pool_state.free_lists[i];
+            pool_state.free_lists[i] = *CAST_PTR(block, void*);
+            free(block);
+        }
+    }
+    pthread_mutex_unlock(&(pool_state.lock));
+    return;
+}
+
+static void* arena_alloc(void* state, size_t size, size_t* capacity) {
+    ArenaAllocator* arena = (ArenaAllocator*) state;
+    const size_t block_header_size = ALLOCATOR_ALIGNED_SIZE(sizeof(ArenaBlock));
+    *capacity = ALLOCATOR_ALIGNED_SIZE(size);
+
+    pthread_mutex_lock(&(arena -> lock));
+    // Blocks kept by a reset are reused in order, a new one is chained only when none of them has room left
+    while ((arena -> current != NULL) && (arena -> current -> used + *capacity > arena -> current -> size)) arena -> current = arena -> current -> next;
+    if (arena -> current == NULL) {
+        size_t block_size = MAX(arena -> block_size, *capacity);
+        ArenaBlock* block = (ArenaBlock*) aligned_alloc(ALLOCATOR_ALIGNMENT, block_header_size + block_size);
+        ASSERT(block == NULL, "BAD_MEMORY");
+        block -> next = arena -> blocks;
+        block -> size = block_size;
+        block -> used = 0;
+        arena -> blocks = block;
+        arena -> current = block;
+    }
+    void* ptr = CAST_PTR(arena -> current, unsigned char) + block_header_size + arena -> current -> used;
+    arena -> current -> used += *capacity;
+    pthread_mutex_unlock(&(arena -> lock));
+
+    return ptr;
+}
+
+static void arena_free(void* state, void* block, size_t capacity) {
+    NOT_USED(state);
+    NOT_USED(block);
+    NOT_USED(capacity);
+    return;
+}
+
+Allocator* create_arena_allocator(size_t block_size) {
+    Allocator* allocator = (Allocator*) calloc(1, sizeof(Allocator));
+    ArenaAllocator* arena = (ArenaAllocator*) calloc(1, sizeof(ArenaAllocator));
+    ASSERT(allocator == NULL || arena == NULL, "BAD_MEMORY");
+    pthread_mutex_init(&(arena -> lock), NULL);
+    arena -> block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK_SIZE;
+    allocator -> alloc = arena_alloc;
+    allocator -> free = arena_free;
+    allocator -> state = arena;
+    return allocator;
+}
+
+void reset_arena_allocator(Allocator* allocator) {
+    ArenaAllocator* arena = (ArenaAllocator*) allocator -> state;
+    pthread_mutex_lock(&(arena -> lock));
+    for (ArenaBlock* block = arena -> blocks; block != NULL; block = block -> next) block -> used = 0;
+    arena -> current = arena -> blocks;
+    pthread_mutex_unlock(&(arena -> lock));
+    return;
+}
+
+void destroy_arena_allocator(Allocator* allocator) {
+    ArenaAllocator* arena = (ArenaAllocator*) allocator -> state;
+    if (get_allocator() == allocator) set_allocator(NULL);
+    while (arena -> blocks != NULL) {
+        ArenaBlock* block = arena -> blocks;
+        arena -> blocks = block -> next;
+        free(block);
+    }
+    pthread_mutex_destroy(&(arena -> lock));
+    DEALLOCATE_PTRS(arena, allocator);
+    return;
+}
+
+static Allocator* current_allocator = NULL;
+
+Allocator* get_allocator(void) {
+    return current_allocator != NULL ? current_allocator : get_pool_allocator();
+}
+
+// NULL restores the default pool allocator
+void set_allocator(Allocator* allocator) {
+    current_allocator = allocator;
+    return;
+}
+
+static void* alloc_block(Allocator* allocator, size_t count, size_t size, bool clean_flag) {
+    size_t capacity = 0;
+    size_t bytes = checked_mul(count, size);
+    ASSERT(bytes > SIZE_MAX - 2 * ALLOCATOR_ALIGNMENT, "SIZE_OVERFLOW");
+    unsigned char* block = (unsigned char*) allocator -> alloc(allocator -> state, ALLOCATOR_ALIGNMENT + bytes, &capacity);
+    ASSERT(block == NULL, "BAD_MEMORY");
+    AllocationHeader* header = (AllocationHeader*) block;
+    header -> allocator = allocator;
+    header -> size = bytes;
+    header -> capacity = capacity;
+    atomic_init(&(header -> references), 1);
+    if (clean_flag) memset(block + ALLOCATOR_ALIGNMENT, 0, bytes);
+    return block + ALLOCATOR_ALIGNMENT;
+}
+
+void* alloc_memory_from(Allocator* allocator, size_t count, size_t size) {
+    return alloc_block(allocator, count, size, TRUE);
+}
+
+void* alloc_memory(size_t count, size_t size) {
+    return alloc_block(get_allocator(), count, size, TRUE);
+}
+
+// Skips the zeroing, for buffers the caller overwrites entirely before reading them
+void* alloc_memory_uninit(size_t count, size_t size) {
+    return alloc_block(get_allocator(), count, size, FALSE);
+}
+
+void* realloc_memory(void* ptr, size_t size) {
+    if (ptr == NULL) return alloc_memory(1, size);
+    ASSERT(size > SIZE_MAX - 2 * ALLOCATOR_ALIGNMENT, "SIZE_OVERFLOW");
+    AllocationHeader* header = (AllocationHeader*) (CAST_PTR(ptr, unsigned char) - ALLOCATOR_ALIGNMENT);
+    if (ALLOCATOR_ALIGNMENT + size <= header -> capacity) {
+        if (size > header -> size) memset(CAST_PTR(ptr, unsigned char) + header -> size, 0, size - header -> size);
+        header -> size = size;
+        return ptr;
+    }
+    void* new_ptr = alloc_memory_uninit(1, size);
+    memcpy(new_ptr, ptr, header -> size);
+    memset(CAST_PTR(new_ptr, unsigned char) + header -> size, 0, size - header -> size);
+    free_memory(ptr);
+    return new_ptr;
+}
+
+void* retain_memory(void* ptr) {
+    if (ptr == NULL) return NULL;
+    AllocationHeader* header = (AllocationHeader*) (CAST_PTR(ptr, unsigned char) - ALLOCATOR_ALIGNMENT);
+    atomic_fetch_add_explicit(&(header -> references), 1, memory_order_relaxed);
+    return ptr;
+}
+
+bool is_memory_shared(void* ptr) {
+    if (ptr == NULL) return FALSE;
+    AllocationHeader* header = (AllocationHeader*) (CAST_PTR(ptr, unsigned char) - ALLOCATOR_ALIGNMENT);
+    return atomic_load_explicit(&(header -> references), memory_order_acquire) > 1;
+}
+
+// Drops one reference to the block, which goes back to its allocator with the last one
+void free_memory(void* ptr) {
+    if (ptr == NULL) return;
+    AllocationHeader* header = (AllocationHeader*) (CAST_PTR(ptr, unsigned char) - ALLOCATOR_ALIGNMENT);
+    if (atomic_fetch_sub_explicit(&(header -> references), 1, memory_order_acq_rel) != 1) return;
+    header -> allocator -> free(header -> allocator -> state, header, header -> capacity);
+    return;
+}
+
+void deallocate_memory(int len, ...) {
+    va_list args;
+    va_start(args, len);
+    for (int i = 0; i < len; ++i) free_memory(va_arg(args, void*));
+    va_end(args);
+    return;
+}
+
+#endif //_ALLOCATOR_H_
@@ -3,6 +3,7 @@
 
 #include "./tensor.h"
 #include "types.h"
+#include <stdatomic.h>
 #include <time.h>
 
 #define ALLOC_TENSOR_GRAD_GRAPH_FILLED(tensor, shape, rank, data_type, val) alloc_grad_graph_node(data_type, (tensor = alloc_tensor(shape, rank, data_type), fill_tensor(val, tensor), &tensor))
@@ -12,19 +13,34 @@
 #define FORWARD_PASS(node) forward_pass((set_update_flag(FALSE, (node)), ((GradNode*)(node)) -> is_value_updated = TRUE, (node)))
 #define OTHER_PARENT(node, parent) ((node) -> parents[0] == (parent) ? (node) -> parents[1] : (node) -> parents[0])
 #define NODE_DERIVED_TENSOR(node) CAST_PTR(node, GradNode) -> derived_value
-#define IS_DENOMINATOR(parent, child) parent == child -> parents[1]
 #define NODE_TENSOR(node) CAST_PTR(node, GradNode) -> value
+// Elements of a fused group computed before moving to the next tile, small enough for the group to stay in L1
+#define FUSED_TILE 1024
 #define DERIVE_NODE_REVERSE(node) derive_r_node(node, TRUE)
+#define PUSH_NO_GRAD() push_no_grad()
+#define POP_NO_GRAD() pop_no_grad()
 
 // TENSOR FUNCTIONS OPERATIONS
-#define TENSOR_GRAPH_NORM(c, a, val) graph_op(c, a, (Tensor) {.data = val, .data_type = (a).data_type}, NORM)
-#define TENSOR_GRAPH_POW(c, a, val) graph_op(c, a, (Tensor) {.data = val, .data_type = (a).data_type}, POW)
-#define TENSOR_GRAPH_SOFTMAX(c, a) graph_op(c, a, (Tensor) {.data_type = (a).data_type}, SOFTMAX)
-#define TENSOR_GRAPH_TANH(c, a) graph_op(c, a, (Tensor) {.data_type = (a).data_type}, TANH)
-#define TENSOR_GRAPH_SQRT(c, a) graph_op(c, a, (Tensor) {.data_type = (a).data_type}, SQRT)
-#define TENSOR_GRAPH_EXP(c, a) graph_op(c, a, (Tensor) {.data_type = (a).data_type}, EXP)
-#define TENSOR_GRAPH_LOG(c, a) graph_op(c, a, (Tensor) {.data_type = (a).data_type}, LOG)
-#define TENSOR_GRAPH_ABS(c, a) graph_op(c, a, (Tensor) {.data_type = (a).data_type}, ABS)
+#define TENSOR_GRAPH_NORM(c, a, val) graph_scalar_op(c, a, val, NORM)
+#define TENSOR_GRAPH_POW(c, a, val) graph_scalar_op(c, a, val, POW)
+#define TENSOR_GRAPH_SOFTMAX(c, a) graph_scalar_op(c, a, NULL, SOFTMAX)
+#define TENSOR_GRAPH_SOFTMAX_AXIS(c, a, axis) graph_scalar_op(c, a, &(unsigned int) {axis}, SOFTMAX)
+#define TENSOR_GRAPH_LOG_SOFTMAX(c, a) graph_scalar_op(c, a, NULL, LOG_SOFTMAX)
+#define TENSOR_GRAPH_LOG_SOFTMAX_AXIS(c, a, axis) graph_scalar_op(c, a, &(unsigned int) {axis}, LOG_SOFTMAX)
+#define TENSOR_GRAPH_TANH(c, a) graph_scalar_op(c, a, NULL, TANH)
+#define TENSOR_GRAPH_SIGMOID(c, a) graph_scalar_op(c, a, NULL, SIGMOID)
+#define TENSOR_GRAPH_GELU(c, a) graph_scalar_op(c, a, NULL, GELU)
+#define TENSOR_GRAPH_SQRT(c, a) graph_scalar_op(c, a, NULL, SQRT)
+#define TENSOR_GRAPH_EXP(c, a) graph_scalar_op(c, a, NULL, EXP)
+#define TENSOR_GRAPH_LOG(c, a) graph_scalar_op(c, a, NULL, LOG)
+#define TENSOR_GRAPH_ABS(c, a) graph_scalar_op(c, a, NULL, ABS)
+#define TENSOR_GRAPH_REDUCE(c, a, flag, axes, keepdims, p) graph_scalar_op(c, a, &(Reduction) {flag, axes, keepdims, p}, REDUCE)
+#define TENSOR_GRAPH_REDUCE_SUM(c, a, axes, keepdims) TENSOR_GRAPH_REDUCE(c, a, REDUCE_SUM, axes, keepdims, 0.0L)
+#define TENSOR_GRAPH_REDUCE_MEAN(c, a, axes, keepdims) TENSOR_GRAPH_REDUCE(c, a, REDUCE_MEAN, axes, keepdims, 0.0L)
+#define TENSOR_GRAPH_REDUCE_MAX(c, a, axes, keepdims) TENSOR_GRAPH_REDUCE(c, a, REDUCE_MAX, axes, keepdims, 0.0L)
+#define TENSOR_GRAPH_REDUCE_MIN(c, a, axes, keepdims) TENSOR_GRAPH_REDUCE(c, a, REDUCE_MIN, axes, keepdims, 0.0L)
+#define TENSOR_GRAPH_REDUCE_NORM(c, a, axes, keepdims, p) TENSOR_GRAPH_REDUCE(c, a, REDUCE_NORM, axes, keepdims, p)
+#define TENSOR_GRAPH_LOGSUMEXP(c, a, axes, keepdims) TENSOR_GRAPH_REDUCE(c, a, REDUCE_LOGSUMEXP, axes, keepdims, 0.0L)
 
 // TENSORS OPERATIONS
 #define TENSOR_GRAPH_MUL(c, a, b) graph_op(c, a, b, MULTIPLICATION)
@@ -35,14 +51,77 @@
 #define TENSOR_GRAPH_MAX(c, a, b) graph_op(c, a, b, MAX)
 #define TENSOR_GRAPH_MIN(c, a, b) graph_op(c, a, b, MIN)
 
+// A node on the stack of the topological sort, together with the next of its parents to visit
+typedef struct GradFrame {
+    GradNode* node;
+    unsigned int next_parent;
+} GradFrame;
+
+// One instruction of a compiled graph: element-wise steps are bound to their kernel, the others go through op_tensor
+typedef struct GradStep {
+    GradNode* node;
+    TensorKernel kernel;
+    Tensor* a;
+    Tensor* b;
+    size_t size;
+    unsigned int fused_count;
+} GradStep;
+
+typedef struct GradPlan {
+    GradStep* steps;
+    unsigned int steps_count;
+} GradPlan;
+
+// Runs a group of element-wise steps tile by tile, every step consuming the tile the previous ones left in cache
+typedef struct FusedTask {
+    GradStep* steps;
+    unsigned int steps_count;
+} FusedTask;
+
+// Maps a node back to its step while the memory of a plan is laid out
+typedef struct GradStepIndex {
+    GradNode* node;
+    unsigned int step;
+} GradStepIndex;
+
+// A block shared by the values whose lifetimes do not overlap, free once the step last_use has run
+typedef struct GradBuffer {
+    void* data;
+    size_t size;
+    unsigned int last_use;
+} GradBuffer;
+
+// Shared by every thread that sorts, restores or tears down a graph, so that each walk gets an epoch of its own
+static atomic_uint grad_epoch = 0;
+
+// Depth of the no-grad scopes open on the calling thread: inside any of them the graph operations build no node
+static _Thread_local unsigned int no_grad_depth = 0;
+
+void push_no_grad(void) {
+    no_grad_depth++;
+    return;
+}
+
+void pop_no_grad(void) {
+    ASSERT(!no_grad_depth, "NO_NO_GRAD_SCOPE");
+    no_grad_depth--;
+    return;
+}
+
+bool is_grad_enabled(void) {
+    return !no_grad_depth;
+}
+
 void alloc_grad_graph_node(DataType data_type, Tensor* value) {
-    GradNode* node = (GradNode*) calloc(1, sizeof(GradNode));
+    GradNode* node = (GradNode*) alloc_memory(1, sizeof(GradNode));
     node -> is_value_updated = FALSE;
+    node -> is_checkpoint = FALSE;
+    node -> is_value_shared = FALSE;
     node -> operation = NO_OP;
-    node -> children = NULL;
-    node -> parents = NULL;
+    node -> children = node -> inline_children;
+    node -> children_capacity = GRAD_NODE_INLINE_CHILDREN;
     node -> parents_count = 0;
-    node -> value = (Tensor*) calloc(1, sizeof(Tensor));
+    node -> value = (Tensor*) alloc_memory(1, sizeof(Tensor));
     copy_tensor(node -> value, *value);
     node -> exp = NULL;
     node -> children_count = 0;
@@ -52,236 +131,357 @@ void alloc_grad_graph_node(DataType data_type, Tensor* value) {
     return;
 }
 
-void* deallocate_grad_graph(bool single_removal_flag, GradNode* node, void*** deallocated_ptrs, unsigned int* deallocated_ptrs_count) {
-    for (unsigned int i = 0; i < *deallocated_ptrs_count; ++i) {
-        if ((*deallocated_ptrs)[i] == node) return NULL;
-    }
-    for (unsigned int i = 0; (i < node -> children_count) && !single_removal_flag; ++i) {
-        if (node -> children[i] != NULL) node -> children[i] = deallocate_grad_graph(single_removal_flag, node -> children[i], deallocated_ptrs, deallocated_ptrs_count);
-    }
+static void release_grad_node(GradNode* node) {
     DEALLOCATE_TENSORS(node -> derived_value, *(node -> value));
-    free(node -> value);
-    free(node -> children);
-    node -> children = NULL;
-    free(node -> parents);
-    node -> parents = NULL;
-    if (node -> exp != NULL) free(node -> exp);
-    node -> exp = NULL;
-    *deallocated_ptrs = (void**) realloc(*deallocated_ptrs, sizeof(void*) * ((*deallocated_ptrs_count) + 1));
-    (*deallocated_ptrs)[(*deallocated_ptrs_count)++] = node;
-    free(node);
-    node = NULL;
-    return node;
+    if (node -> children != node -> inline_children) free_memory(node -> children);
+    DEALLOCATE_MEMORY(node -> value, node -> exp, node);
+    return;
 }
 
+// Releases the listed nodes, together with every node depending on them unless single_removal_flag is set. Each node
+// is marked with the epoch of the call as it is listed, so that the nodes shared by the graphs, or reached through
+// several paths, are released exactly once.
 void deallocate_grad_graphs(int len, ...) {
     va_list args;
     va_start(args, len);
     bool single_removal_flag = va_arg(args, int);
-    void** deallocated_ptrs = (void**) calloc(1, sizeof(void*));
-    unsigned int deallocated_ptrs_count = 0;
+    const unsigned int epoch = atomic_fetch_add_explicit(&grad_epoch, 1, memory_order_relaxed) + 1;
+    unsigned int nodes_count = 0, nodes_capacity = 16;
+    GradNode** nodes = (GradNode**) calloc(nodes_capacity, sizeof(GradNode*));
+    ASSERT(nodes == NULL, "BAD_MEMORY");
+
     for (int i = 0; i < len; ++i) {
         GradNode* node = va_arg(args, GradNode*);
-        deallocate_grad_graph(single_removal_flag, node, &deallocated_ptrs, &deallocated_ptrs_count);
+        if ((node == NULL) || (node -> epoch == epoch)) continue;
+        node -> epoch = epoch;
+        if (nodes_count == nodes_capacity) {
+            nodes = (GradNode**) realloc(nodes, sizeof(GradNode*) * (nodes_capacity *= 2));
+            ASSERT(nodes == NULL, "BAD_MEMORY");
+        }
+        nodes[nodes_count++] = node;
+    }
+
+    // The list doubles as the queue of the walk over the children
+    for (unsigned int i = 0; (i < nodes_count) && !single_removal_flag; ++i) {
+        for (unsigned int j = 0; j < nodes[i] -> children_count; ++j) {
+            GradNode* child = nodes[i] -> children[j];
+            if (child -> epoch == epoch) continue;
+            child -> epoch = epoch;
+            if (nodes_count == nodes_capacity) {
+                nodes = (GradNode**) realloc(nodes, sizeof(GradNode*) * (nodes_capacity *= 2));
+                ASSERT(nodes == NULL, "BAD_MEMORY");
+            }
+            nodes[nodes_count++] = child;
+        }
     }
-    free(deallocated_ptrs);
     va_end(args);
+
+    // The parents left alive drop their released children, each one compacted once
+    const unsigned int parents_epoch = atomic_fetch_add_explicit(&grad_epoch, 1, memory_order_relaxed) + 1;
+    for (unsigned int i = 0; i < nodes_count; ++i) {
+        for (unsigned int j = 0; j < nodes[i] -> parents_count; ++j) {
+            GradNode* parent = nodes[i] -> parents[j];
+            if ((parent -> epoch == epoch) || (parent -> epoch == parents_epoch)) continue;
+            parent -> epoch = parents_epoch;
+            unsigned int children_count = 0;
+            for (unsigned int k = 0; k < parent -> children_count; ++k) {
+                if (parent -> children[k] -> epoch != epoch) parent -> children[children_count++] = parent -> children[k];
+            }
+            parent -> children_count = children_count;
+        }
+    }
+
+    for (unsigned int i = 0; i < nodes_count; ++i) release_grad_node(nodes[i]);
+    free(nodes);
+
     return;
 }
 
-void add_child(GradNode* child, GradNode* parent) {
-    parent -> children = (GradNode**) realloc(parent -> children, sizeof(GradNode*) * (parent -> children_count + 1));
+static void append_child(GradNode* parent, GradNode* child) {
+    if (parent -> children_count == parent -> children_capacity) {
+        GradNode** children = (GradNode**) alloc_memory(parent -> children_capacity * 2, sizeof(GradNode*));
+        memcpy(children, parent -> children, sizeof(GradNode*) * parent -> children_count);
+        if (parent -> children != parent -> inline_children) free_memory(parent -> children);
+        parent -> children = children;
+        parent -> children_capacity *= 2;
+    }
     parent -> children[(parent -> children_count)++] = child;
-    child -> parents = (GradNode**) realloc(child -> parents, sizeof(GradNode*) * (child -> parents_count + 1));
+    return;
+}
+
+void add_child(GradNode* child, GradNode* parent) {
+    ASSERT(child -> parents_count == GRAD_NODE_MAX_PARENTS, "TOO_MANY_PARENTS");
+    append_child(parent, child);
     child -> parents[(child -> parents_count)++] = parent;
     return;
 }
 
+// Under a no-grad scope only the result is computed: c is left out of every graph, with no copy of its value and no
+// gradient buffer, so it can not be derived nor used as the operand of a graph operation once the scope is closed
 Tensor* graph_op(Tensor* c, Tensor a, Tensor b, OperatorFlag operation) {
     op_tensor(c, a, b, operation);
+    if (no_grad_depth) {
+        c -> grad_node = NULL;
+        return c;
+    }
+    ASSERT(a.grad_node == NULL, "MISSING_GRAD_NODE");
     alloc_grad_graph_node(a.data_type, c);
     CAST_PTR(c -> grad_node, GradNode) -> operation = operation;
     add_child(c -> grad_node, a.grad_node);
-    if (operation == EXP || operation == TANH || operation == LOG || operation == ABS || operation == SOFTMAX) return c;
+    if (operation == EXP || operation == TANH || operation == LOG || operation == ABS || operation == SIGMOID || operation == GELU) return c;
+    else if (operation == SOFTMAX || operation == LOG_SOFTMAX) {
+        // The axis is kept resolved, so that every replay of the node runs along the same one
+        CAST_PTR(c -> grad_node, GradNode) -> exp = alloc_memory(1, sizeof(unsigned int));
+        *CAST_PTR(CAST_PTR(c -> grad_node, GradNode) -> exp, unsigned int) = (b.data != NULL) ? *CAST_PTR(b.data, unsigned int) : a.rank - 1;
+        return c;
+    }
+    else if (operation == REDUCE) {
+        CAST_PTR(c -> grad_node, GradNode) -> exp = alloc_memory(1, sizeof(Reduction));
+        *CAST_PTR(CAST_PTR(c -> grad_node, GradNode) -> exp, Reduction) = *CAST_PTR(b.data, Reduction);
+        return c;
+    }
     else if (operation == POW || operation == NORM) {
-        CAST_PTR(c -> grad_node, GradNode) -> exp = (void*) calloc(1, a.data_type);
-        mem_copy(CAST_PTR(c -> grad_node, GradNode) -> exp, b.data, b.data_type, 1);
+        CAST_PTR(c -> grad_node, GradNode) -> exp = alloc_memory(1, DATA_TYPE_SIZE(a.data_type));
+        mem_copy(CAST_PTR(c -> grad_node, GradNode) -> exp, b.data, DATA_TYPE_SIZE(b.data_type), 1);
         return c;
     } else if (operation == SQRT) {
-        CAST_PTR(c -> grad_node, GradNode) -> exp = calloc(1, a.data_type);
-        void* val = (void*) calloc(1, a.data_type);
-        ASSIGN(val, 0.5L, a.data_type);
-        mem_copy(CAST_PTR(c -> grad_node, GradNode) -> exp, val, a.data_type, 1);
-        free(val);
+        CAST_PTR(c -> grad_node, GradNode) -> exp = alloc_memory(1, DATA_TYPE_SIZE(a.data_type));
+        ASSIGN(CAST_PTR(c -> grad_node, GradNode) -> exp, 0.5L, a.data_type);
         return c;
     }
+    ASSERT(b.grad_node == NULL, "MISSING_GRAD_NODE");
     add_child(c -> grad_node, b.grad_node);
     return c;
 }
 
-void derive_op(GradNode* node, GradNode* child) {
+// Operators reading at most a scalar besides a, which is evaluated only once even when it is itself a graph operation
+Tensor* graph_scalar_op(Tensor* c, Tensor a, void* val, OperatorFlag operation) {
+    return graph_op(c, a, (Tensor) {.data = val, .data_type = a.data_type}, operation);
+}
+
+// Contribution of child to the gradient of node, written into res, for the rules without a fused accumulate kernel:
+// the element-wise operators reading an operand of another shape, MAX, MIN and NORM. node is the operand-th parent of
+// child, which tells the operands apart when node is both of them.
+static void derive_contribution(Tensor* res, GradNode* node, GradNode* child, unsigned int operand) {
     switch (child -> operation) {
         case SUM: {
-            copy_tensor(&(node -> derived_value), child -> derived_value);
+            copy_tensor(res, child -> derived_value);
             break;
         }
 
         case SUBTRACTION: {
-            if (node == child -> parents[0]) copy_tensor(&(node -> derived_value), child -> derived_value);
-            else CONJUGATE_TENSOR(&(node -> derived_value), child -> derived_value);
+            if (operand == 0) copy_tensor(res, child -> derived_value);
+            else CONJUGATE_TENSOR(res, child -> derived_value);
             break;
         }
 
         case MULTIPLICATION: {
-            Tensor* other_parent = (node == child -> parents[0]) ? child -> parents[1] -> value : child -> parents[0] -> value;
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, *other_parent);
+            Tensor* other_parent = child -> parents[1 - operand] -> value;
+            MULTIPLY_TENSOR(res, child -> derived_value, *other_parent);
             break;
         }
 
         case DIVISION: {
-            Tensor* other_parent = (node == child -> parents[0]) ? child -> parents[1] -> value : child -> parents[0] -> value;
-            if (IS_DENOMINATOR(node, child)) {
-                void* val = (void*) calloc(1, node -> derived_value.data_type);
-                ASSIGN(val, 2.0L, node -> derived_value.data_type);
-                MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, *DIVIDE_TENSOR(&(node -> derived_value), *other_parent, *POW_TENSOR(&(node -> derived_value), *(node -> value), val)));
-                CONJUGATE_TENSOR(&(node -> derived_value), node -> derived_value);
-                free(val);
+            Tensor* other_parent = child -> parents[1 - operand] -> value;
+            if (operand) {
+                void* val = ASSIGN(&(long double) {0}, 2.0L, res -> data_type);
+                MULTIPLY_TENSOR(res, child -> derived_value, *DIVIDE_TENSOR(res, *other_parent, *POW_TENSOR(res, *(node -> value), val)));
+                CONJUGATE_TENSOR(res, *res);
             } else {
-                DIVIDE_TENSOR(&(node -> derived_value), child -> derived_value, *other_parent);
+                DIVIDE_TENSOR(res, child -> derived_value, *other_parent);
             }
             break;
         }
 
-        case SQRT:
-        case POW: {
-            void* temp = calloc(1, node -> derived_value.data_type);
-            void* tmp = calloc(1, node -> derived_value.data_type);
-            copy_tensor(&(node -> derived_value), *(node -> value));
-            POW_TENSOR(&(node -> derived_value), node -> derived_value, SCALAR_SUB(temp, child -> exp, ASSIGN(tmp, 1.0L, node -> derived_value.data_type), node -> derived_value.data_type));
-            SCALAR_MUL_TENSOR(&(node -> derived_value), child -> exp);
-            free(tmp);
-            free(temp);
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, node -> derived_value);
+        case MAX:
+        case MIN: {
+            // The mask spans the result, as the value of node may have been broadcast into it
+            Tensor mask = alloc_tensor(child -> value -> shape, child -> value -> rank, child -> value -> data_type);
+            Tensor value = broadcast_operand(*(node -> value), child -> value -> shape, child -> value -> rank);
+            size_t size = TENSOR_SIZE(mask);
+            for (size_t i = 0; i < size; ++i) {
+                if (!IS_EQUAL(CAST_PTR_AT_INDEX(child -> value -> data, i, mask.data_type), CAST_PTR_AT_INDEX(value.data, strided_offset(value, i), value.data_type), mask.data_type)) continue;
+                ASSIGN(CAST_PTR_AT_INDEX(mask.data, i, mask.data_type), 1.0L, mask.data_type);
+            }
+            MULTIPLY_TENSOR(res, child -> derived_value, mask);
+            free_memory(value.strides);
+            DEALLOCATE_TENSORS(mask);
             break;
         }
 
-        case EXP: {
-            copy_tensor(&(node -> derived_value), *(child -> value));
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, node -> derived_value);
+        case CONJUGATE: {
+            ASSERT(TRUE, "Impossible to differentiate the CONJUGATE operation!");
             break;
         }
 
-        case TANH: {
-            void* val = calloc(1, node -> derived_value.data_type);
-            TANH_TENSOR(&(node -> derived_value), *(node -> value));
-            POW_TENSOR(&(node -> derived_value), node -> derived_value, ASSIGN(val, 2.0L, node -> derived_value.data_type));
-            SCALAR_SUM_TENSOR(CONJUGATE_TENSOR(&(node -> derived_value), node -> derived_value), ASSIGN(val, 1.0L, node -> derived_value.data_type));
-            free(val);
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, node -> derived_value);
+        case NORM: {
+            void* temp = &(long double) {0};
+            SCALAR_SUB(temp, child -> exp, ASSIGN(temp, 1.0L, res -> data_type), res -> data_type);
+            void* zero = &(long double) {0};
+            size_t size = TENSOR_SIZE(*res);
+            for (size_t i = 0; i < size; ++i) {
+                if (IS_EQUAL(CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), zero, node -> value -> data_type)) continue;
+                if (IS_EQUAL(temp, zero, res -> data_type)) ASSIGN(CAST_PTR_AT_INDEX(res -> data, i, res -> data_type), 1.0L, res -> data_type);
+                else {
+                    SCALAR_MUL(CAST_PTR_AT_INDEX(res -> data, i, res -> data_type), SCALAR_POW(CAST_PTR_AT_INDEX(res -> data, i, res -> data_type), CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), temp, res -> data_type), temp, res -> data_type);
+                    CAST_AND_OP_INDEX(res -> data, child -> value -> data, res -> data, i, res -> data_type, DIVISION);
+                }
+                if (IS_NEGATIVE(CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), node -> value -> data_type) && !IS_NEGATIVE(CAST_PTR_AT_INDEX(res -> data, i, res -> data_type), res -> data_type)) CAST_AND_SINGLE_OP_INDEX(res -> data, res -> data, i, res -> data_type, CONJUGATE);
+            }
+            MULTIPLY_TENSOR(res, child -> derived_value, *res);
             break;
         }
 
-        case DOT: {
-            if (node == child -> parents[0]) {
-                Tensor b_t = empty_tensor(node -> derived_value.data_type);
-                transpose_tensor(copy_tensor(&b_t, *(child -> parents[1] -> value)));
-                DOT_TENSOR(&(node -> derived_value), child -> derived_value, b_t);
-                DEALLOCATE_TENSORS(b_t);
-            } else {
-                Tensor a_t = empty_tensor(node -> derived_value.data_type);
-                transpose_tensor(copy_tensor(&a_t, *(child -> parents[0] -> value)));
-                DOT_TENSOR(&(node -> derived_value), a_t, child -> derived_value);
-                DEALLOCATE_TENSORS(a_t);
-            }
+        default: {
             break;
         }
+    }
+
+    return;
+}
 
-        case LOG: {
-            Tensor temp = alloc_tensor(node -> value -> shape, node -> value -> rank, node -> value -> data_type);
-            void* val = (void*) calloc(1, node -> derived_value.data_type);
-            fill_tensor(ASSIGN(val, 1.0L, node -> derived_value.data_type), temp);
-            free(val);
-            DIVIDE_TENSOR(&(node -> derived_value), temp, *(node -> value));
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, node -> derived_value);
+// Runs the fused backward rule of child, adding the contribution of node, its operand-th parent, straight into its
+// gradient. The rules reading an operand of another shape than the gradient are left to derive_contribution.
+static bool accumulate_grad(GradNode* node, GradNode* child, unsigned int operand) {
+    Tensor grad = node -> derived_value;
+    if (!has_accumulate_kernel(child -> operation, operand, grad.data_type)) return FALSE;
+
+    Tensor* x = node -> value;
+    Tensor* y = NULL;
+    void* exp = NULL;
+    switch (child -> operation) {
+        case SUM:
+        case SUBTRACTION: {
+            x = &(child -> derived_value);
+            break;
+        }
+
+        case MULTIPLICATION: {
+            x = child -> parents[1 - operand] -> value;
+            break;
+        }
+
+        case DIVISION: {
+            x = child -> parents[1] -> value;
+            if (operand) y = child -> parents[0] -> value;
             break;
         }
 
         case MAX:
         case MIN: {
-            void* val = (void*) calloc(1, node -> derived_value.data_type);
-            fill_tensor(val, node -> derived_value);
-            ASSIGN(val, 1.0L, node -> derived_value.data_type);
-            unsigned int size = TENSOR_SIZE(node -> derived_value);
-            for (unsigned int i = 0; i < size; ++i) {
-                if (!IS_EQUAL(CAST_PTR_AT_INDEX(child -> value -> data, i, node -> derived_value.data_type), CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), node -> derived_value.data_type)) continue;
-                ASSIGN(CAST_PTR_AT_INDEX(node -> derived_value.data, i, node -> derived_value.data_type), 1.0L, node -> derived_value.data_type);
-            }
-            free(val);
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, node -> derived_value);
+            y = child -> value;
             break;
         }
 
-        case ABS: {
-            unsigned int size = TENSOR_SIZE(node -> derived_value);
-            for (unsigned int i = 0; i < size; ++i) {
-                if (IS_NEGATIVE(CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), node -> value -> data_type)) ASSIGN(CAST_PTR_AT_INDEX(node -> derived_value.data, i, node -> derived_value.data_type), -1.0L, node -> derived_value.data_type);
-                else if (IS_POSITIVE(CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), node -> value -> data_type)) ASSIGN(CAST_PTR_AT_INDEX(node -> derived_value.data, i, node -> derived_value.data_type), 1.0L, node -> derived_value.data_type);
-            }
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, node -> derived_value);
+        case EXP:
+        case TANH:
+        case SIGMOID: {
+            x = child -> value;
             break;
         }
 
-        case CONJUGATE: {
-            ASSERT(TRUE, "Impossible to differentiate the CONJUGATE operation!");
+        case POW:
+        case SQRT: {
+            exp = child -> exp;
             break;
         }
 
-        case NORM: {
-            void* temp = (void*) calloc(1, node -> derived_value.data_type);
-            SCALAR_SUB(temp, child -> exp, ASSIGN(temp, 1.0L, node -> derived_value.data_type), node -> derived_value.data_type);
-            void* zero = (void*) calloc(1, node -> derived_value.data_type);
-            unsigned int size = TENSOR_SIZE(node -> derived_value);
-            for (unsigned int i = 0; i < size; ++i) {
-                if (IS_EQUAL(CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), zero, node -> value -> data_type)) continue;
-                if (IS_EQUAL(temp, zero, node -> derived_value.data_type)) ASSIGN(CAST_PTR_AT_INDEX(node -> derived_value.data, i, node -> derived_value.data_type), 1.0L, node -> derived_value.data_type);
-                else {
-                    SCALAR_MUL(CAST_PTR_AT_INDEX(node -> derived_value.data, i, node -> derived_value.data_type), SCALAR_POW(CAST_PTR_AT_INDEX(node -> derived_value.data, i, node -> derived_value.data_type), CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), temp, node -> derived_value.data_type), temp, node -> derived_value.data_type);
-                    CAST_AND_OP_INDEX(node -> derived_value.data, child -> value -> data, node -> derived_value.data, i, node -> derived_value.data_type, DIVISION);
-                }
-                if (IS_NEGATIVE(CAST_PTR_AT_INDEX(node -> value -> data, i, node -> value -> data_type), node -> value -> data_type) && !IS_NEGATIVE(CAST_PTR_AT_INDEX(node -> derived_value.data, i, node -> derived_value.data_type), node -> derived_value.data_type)) CAST_AND_SINGLE_OP_INDEX(node -> derived_value.data, node -> derived_value.data, i, node -> derived_value.data_type, CONJUGATE);
-            }
-            DEALLOCATE_PTRS(temp, zero);
-            MULTIPLY_TENSOR(&(node -> derived_value), child -> derived_value, node -> derived_value);
+        default: {
             break;
         }
+    }
 
-        case SOFTMAX: {
-            unsigned int size = TENSOR_SIZE(node -> derived_value);
-            unsigned int shape[] = {size, size};
-            Tensor temp_tensor = alloc_tensor(shape, ARR_SIZE(shape), node -> derived_value.data_type);
-            void* temp = (void*) calloc(1, node -> derived_value.data_type);
-            void* one = (void*) calloc(1, node -> derived_value.data_type);
-            ASSIGN(one, 1.0L, node -> derived_value.data_type);
+    if (!has_shape(child -> derived_value, grad.shape, grad.rank, grad.data_type) || !has_shape(*x, grad.shape, grad.rank, grad.data_type) || ((y != NULL) && !has_shape(*y, grad.shape, grad.rank, grad.data_type))) return FALSE;
 
-            for (unsigned int i = 0; i < size; ++i) {
-                for (unsigned int j = 0; j < size; ++j) {
-                    if (i == j) SCALAR_MUL(CAST_PTR_AT_INDEX(temp_tensor.data, i * size + j, temp_tensor.data_type), CAST_PTR_AT_INDEX(child -> value -> data, i, child -> value -> data_type), SCALAR_SUB(temp, one, CAST_PTR_AT_INDEX(child -> value -> data, i, child -> value -> data_type), child -> value -> data_type), temp_tensor.data_type);
-                    else SCALAR_CONJUGATE(CAST_PTR_AT_INDEX(temp_tensor.data, i * size + j, temp_tensor.data_type), SCALAR_MUL(CAST_PTR_AT_INDEX(temp_tensor.data, i * size + j, temp_tensor.data_type), CAST_PTR_AT_INDEX(child -> value -> data, j, child -> value -> data_type), CAST_PTR_AT_INDEX(child -> value -> data, i, child -> value -> data_type), temp_tensor.data_type), temp_tensor.data_type);
-                }
-            }
-
-            DOT_TENSOR(&(node -> derived_value), temp_tensor, *(child -> value));
+    // The kernels walk every operand linearly, the strided ones are gathered first
+    Tensor x_copy = empty_tensor(grad.data_type);
+    Tensor y_copy = empty_tensor(grad.data_type);
+    if (!is_contiguous(*x)) x = copy_tensor(&x_copy, *x);
+    if ((y != NULL) && !is_contiguous(*y)) y = copy_tensor(&y_copy, *y);
+    run_accumulate_kernel(child -> operation, operand, grad.data_type, grad.data, x -> data, (y != NULL) ? y -> data : exp, child -> derived_value.data, TENSOR_SIZE(grad));
+    DEALLOCATE_TENSORS(x_copy, y_copy);
 
-            DEALLOCATE_TENSORS(temp_tensor);
-            DEALLOCATE_PTRS(temp, one);
+    return TRUE;
+}
 
-            break;
+// Each element of the input of a reduction reads the gradient and the value of the output it was reduced into: with
+// the reduced axes kept, the output is laid out along the strides of the input zeroed across them
+static void derive_reduction(GradNode* node, GradNode* child) {
+    Reduction reduction = *CAST_PTR(child -> exp, Reduction);
+    ASSERT(reduction.flag == REDUCE_ARGMAX, "Impossible to differentiate the ARGMAX reduction!");
+    Tensor* x = node -> value;
+    const unsigned int axes = reduction.axes ? reduction.axes : ((x -> rank == REDUCE_MAX_RANK) ? ~0u : AXIS(x -> rank) - 1);
+    size_t out_strides[REDUCE_MAX_RANK] = {0};
+    size_t stride = 1;
+    size_t count = 1;
+    for (unsigned int d = x -> rank; d-- > 0;) {
+        if (axes & AXIS(d)) {
+            count *= x -> shape[d];
+            continue;
         }
+        out_strides[d] = stride;
+        stride *= x -> shape[d];
+    }
 
-        case NO_OP: {
-            break;
+    Tensor x_copy = empty_tensor(x -> data_type);
+    Tensor y_copy = empty_tensor(x -> data_type);
+    Tensor* y = child -> value;
+    if (!is_contiguous(*x)) x = copy_tensor(&x_copy, *x);
+    if (!is_contiguous(*y)) y = copy_tensor(&y_copy, *y);
+    const long double p = (reduction.flag == REDUCE_MEAN) ? 1.0L / count : reduction.p;
+    run_reduce_grad_kernel(x -> data_type, reduction.flag, p, node -> derived_value.data, x -> data, y -> data, child -> derived_value.data, x -> shape, out_strides, x -> rank);
+    DEALLOCATE_TENSORS(x_copy, y_copy);
+
+    return;
+}
+
+// Adds the contribution of child to the gradient of node, which is the operand-th parent of child
+void derive_op(GradNode* node, GradNode* child, unsigned int operand) {
+    if (child -> operation == NO_OP) return;
+
+    // The transposed operands are views, gemm walks them through their strides and accumulates into the gradient
+    if (child -> operation == DOT) {
+        if (operand == 0) {
+            Tensor b_t = empty_tensor(node -> derived_value.data_type);
+            transpose_tensor(view_tensor(&b_t, *(child -> parents[1] -> value), child -> parents[1] -> value -> shape, child -> parents[1] -> value -> rank));
+            accumulate_dot_tensor(&(node -> derived_value), child -> derived_value, b_t);
+            DEALLOCATE_TENSORS(b_t);
+        } else {
+            Tensor a_t = empty_tensor(node -> derived_value.data_type);
+            transpose_tensor(view_tensor(&a_t, *(child -> parents[0] -> value), child -> parents[0] -> value -> shape, child -> parents[0] -> value -> rank));
+            accumulate_dot_tensor(&(node -> derived_value), a_t, child -> derived_value);
+            DEALLOCATE_TENSORS(a_t);
         }
+        return;
+    }
+
+    // The vector-Jacobian product of the softmax runs row by row from its output, in place of the n x n Jacobian
+    if ((child -> operation == SOFTMAX) || (child -> operation == LOG_SOFTMAX)) {
+        const unsigned int axis = *CAST_PTR(child -> exp, unsigned int);
+        Tensor* value = child -> value;
+        Tensor value_copy = empty_tensor(value -> data_type);
+        if (!is_contiguous(*value)) value = copy_tensor(&value_copy, *value);
+        run_softmax_grad_kernel(value -> data_type, child -> operation == LOG_SOFTMAX, node -> derived_value.data, value -> data, child -> derived_value.data, tensor_size(value -> shape, axis), value -> shape[axis], tensor_size(value -> shape + axis + 1, value -> rank - axis - 1));
+        DEALLOCATE_TENSORS(value_copy);
+        return;
+    }
+
+    if (child -> operation == REDUCE) {
+        derive_reduction(node, child);
+        return;
+    }
+
+    if (accumulate_grad(node, child, operand)) return;
+
+    // The gradient of a broadcast operand is summed back over the dimensions it was repeated along
+    Tensor contribution = alloc_tensor(node -> derived_value.shape, node -> derived_value.rank, node -> derived_value.data_type);
+    derive_contribution(&contribution, node, child, operand);
+    if (!has_shape(contribution, node -> derived_value.shape, node -> derived_value.rank, contribution.data_type)) {
+        sum_to_shape(&contribution, contribution, node -> derived_value.shape, node -> derived_value.rank);
     }
+    SUM_TENSOR(&(node -> derived_value), contribution, node -> derived_value);
+    DEALLOCATE_TENSORS(contribution);
+
     return;
 }
 
@@ -290,44 +490,189 @@ void derive_node(GradNode* node) {
     // Seed the sink with 1.0
     if (node -> children_count == 0) {
         copy_tensor(&(node -> derived_value), *(node -> value));
-        void* value = calloc(1, node -> derived_value.data_type);
-        fill_tensor(ASSIGN(value, 1.0L, node -> derived_value.data_type), node -> derived_value);
-        free(value);
+        fill_tensor(ASSIGN(&(long double) {0}, 1.0L, node -> derived_value.data_type), node -> derived_value);
         return;
     }
 
-    Tensor diff = alloc_tensor(node -> value -> shape, node -> value -> rank, node -> value -> data_type);
+    // A child reading node twice is listed twice, its n-th listing stands for the n-th parent slot holding node
+    fill_tensor(ASSIGN(&(long double) {0}, 0.0L, node -> derived_value.data_type), node -> derived_value);
     for (unsigned int i = 0; i < node -> children_count; ++i) {
-        derive_node(node -> children[i]);
-        derive_op(node, node -> children[i]);
-        SUM_TENSOR(&diff, diff, node -> derived_value);
+        GradNode* child = node -> children[i];
+        unsigned int occurrence = 0;
+        for (unsigned int j = 0; j < i; ++j) occurrence += (node -> children[j] == child);
+        unsigned int operand = 0;
+        while ((child -> parents[operand] != node) || occurrence) {
+            if (child -> parents[operand] == node) occurrence--;
+            operand++;
+        }
+        derive_node(child);
+        derive_op(node, child, operand);
     }
 
-    copy_tensor(&(node -> derived_value), diff);
-    DEALLOCATE_TENSORS(diff);
+    return;
+}
 
+// Lists every node node depends on exactly once, each after all of its parents: the graph is walked iteratively,
+// marking the visited nodes with a new epoch, so that deep graphs can not overflow the stack
+static GradNode** sort_grad_graph(GradNode* node, unsigned int* count) {
+    const unsigned int epoch = atomic_fetch_add_explicit(&grad_epoch, 1, memory_order_relaxed) + 1;
+    unsigned int order_capacity = 16, stack_capacity = 16, stack_count = 0;
+    GradNode** order = (GradNode**) calloc(order_capacity, sizeof(GradNode*));
+    GradFrame* stack = (GradFrame*) calloc(stack_capacity, sizeof(GradFrame));
+    ASSERT(order == NULL || stack == NULL, "BAD_MEMORY");
+
+    *count = 0;
+    node -> epoch = epoch;
+    stack[stack_count++] = (GradFrame) { .node = node, .next_parent = 0 };
+    while (stack_count) {
+        GradFrame* frame = stack + stack_count - 1;
+        if (frame -> next_parent < frame -> node -> parents_count) {
+            GradNode* parent = frame -> node -> parents[(frame -> next_parent)++];
+            if (parent -> epoch == epoch) continue;
+            parent -> epoch = epoch;
+            if (stack_count == stack_capacity) {
+                stack = (GradFrame*) realloc(stack, sizeof(GradFrame) * (stack_capacity *= 2));
+                ASSERT(stack == NULL, "BAD_MEMORY");
+            }
+            stack[stack_count++] = (GradFrame) { .node = parent, .next_parent = 0 };
+            continue;
+        }
+
+        if (*count == order_capacity) {
+            order = (GradNode**) realloc(order, sizeof(GradNode*) * (order_capacity *= 2));
+            ASSERT(order == NULL, "BAD_MEMORY");
+        }
+        order[(*count)++] = frame -> node;
+        stack_count--;
+    }
+
+    free(stack);
+
+    return order;
+}
+
+// Computes the value of node from the current values of its parents
+static void evaluate_grad_node(GradNode* node) {
+    if (node -> operation == NO_OP) return;
+    Tensor b = (node -> parents_count > 1) ? *(node -> parents[1] -> value) : (Tensor) {.data = node -> exp, .data_type = node -> value -> data_type};
+    op_tensor(node -> value, *(node -> parents[0] -> value), b, node -> operation);
     return;
 }
 
-// Derive using reverse-mode
+// The shape stays, so that the value can be recomputed and the gradients keep being shaped after it
+static void release_grad_value(GradNode* node) {
+    DEALLOCATE_MEMORY(TENSOR_STORAGE(*(node -> value)), node -> value -> strides);
+    node -> value -> data = NULL;
+    node -> value -> storage = NULL;
+    node -> value -> strides = NULL;
+    node -> is_value_updated = FALSE;
+    return;
+}
+
+// Recomputes the released values among node and its parents, walking up to the nearest values still held
+static void restore_grad_values(GradNode* node) {
+    const unsigned int epoch = atomic_fetch_add_explicit(&grad_epoch, 1, memory_order_relaxed) + 1;
+    unsigned int stack_capacity = 16, stack_count = 0;
+    GradFrame* stack = (GradFrame*) calloc(stack_capacity, sizeof(GradFrame));
+    ASSERT(stack == NULL, "BAD_MEMORY");
+
+    node -> epoch = epoch;
+    stack[stack_count++] = (GradFrame) { .node = node, .next_parent = 0 };
+    while (stack_count) {
+        GradFrame* frame = stack + stack_count - 1;
+        if (frame -> next_parent < frame -> node -> parents_count) {
+            GradNode* parent = frame -> node -> parents[(frame -> next_parent)++];
+            if ((parent -> epoch == epoch) || (parent -> value -> data != NULL)) continue;
+            parent -> epoch = epoch;
+            if (stack_count == stack_capacity) {
+                stack = (GradFrame*) realloc(stack, sizeof(GradFrame) * (stack_capacity *= 2));
+                ASSERT(stack == NULL, "BAD_MEMORY");
+            }
+            stack[stack_count++] = (GradFrame) { .node = parent, .next_parent = 0 };
+            continue;
+        }
+        if (frame -> node -> value -> data == NULL) {
+            evaluate_grad_node(frame -> node);
+            frame -> node -> is_value_updated = TRUE;
+        }
+        stack_count--;
+    }
+
+    free(stack);
+
+    return;
+}
+
+// Whether deriving the graph reads the value of node, rather than only its shape
+static bool is_value_derived(GradNode* node) {
+    const OperatorFlag operation = node -> operation;
+    if ((operation == EXP) || (operation == TANH) || (operation == SIGMOID) || (operation == MAX) || (operation == MIN) || (operation == NORM) || (operation == SOFTMAX) || (operation == LOG_SOFTMAX) || (operation == REDUCE)) return TRUE;
+    for (unsigned int i = 0; i < node -> children_count; ++i) {
+        if ((node -> children[i] -> operation != SUM) && (node -> children[i] -> operation != SUBTRACTION)) return TRUE;
+    }
+    return FALSE;
+}
+
+// Whether evaluating node outside of its plan would read or overwrite a value held by the shared buffers of the plan
+static bool is_shared_operand(GradNode* node) {
+    if (node -> is_value_shared) return TRUE;
+    for (unsigned int i = 0; i < node -> parents_count; ++i) {
+        if (node -> parents[i] -> is_value_shared) return TRUE;
+    }
+    return FALSE;
+}
+
+// Marks node as a checkpoint, whose forward value is kept through the reverse sweep under any checkpoint policy
+void set_checkpoint_flag(bool checkpoint_flag, GradNode* node) {
+    node -> is_checkpoint = checkpoint_flag;
+    return;
+}
+
+// Derive using reverse-mode: a single sweep, from node back to the leaves, accumulates every gradient exactly once.
+// The gradient of node is seeded with 1.0 when is_sink is set, otherwise its current derived value is propagated.
 void derive_r_node(GradNode* node, bool is_sink) {
     if (node -> parents_count == 0) return;
-    else if (is_sink) {
-        void* val = calloc(1, node -> derived_value.data_type);
-        ASSIGN(val, 1.0L, node -> derived_value.data_type);
-        fill_tensor(val, node -> derived_value);
-        free(val);
+
+    unsigned int count = 0;
+    GradNode** order = sort_grad_graph(node, &count);
+    void* val = &(long double) {0};
+    const TensorContext* context = get_tensor_context();
+
+    // The values moved to the shared buffers of a plan are overwritten as it runs: none of them may be read by a
+    // backward rule, nor recomputed from under a checkpoint policy
+    for (unsigned int i = 0; i < count; ++i) {
+        ASSERT(order[i] -> is_value_shared && ((context -> checkpoint_policy != CHECKPOINT_NONE) || is_value_derived(order[i])), "SHARED_GRAD_VALUE");
     }
 
-    for (unsigned int i = 0; i < node -> parents_count; ++i) {
-        Tensor temp = empty_tensor(node -> derived_value.data_type);
-        copy_tensor(&temp, node -> parents[i] -> derived_value);
-        derive_op(node -> parents[i], node);
-        SUM_TENSOR(&(node -> parents[i] -> derived_value), node -> parents[i] -> derived_value, temp);
-        DEALLOCATE_TENSORS(temp);
-        derive_r_node(node -> parents[i], FALSE);
+    // Under a checkpoint policy only the leaves, the checkpoints and node keep their values: the others are released
+    // here, then recomputed segment by segment as the sweep reaches them and released again once derived
+    bool* is_kept = NULL;
+    if (context -> checkpoint_policy != CHECKPOINT_NONE) {
+        unsigned int segment = 0;
+        if (context -> checkpoint_policy == CHECKPOINT_EVERY) segment = MAX(context -> checkpoint_segment, 1);
+        else if (context -> checkpoint_policy == CHECKPOINT_SQRT) segment = (unsigned int) ceil(sqrt((double) count));
+        is_kept = (bool*) calloc(count, sizeof(bool));
+        ASSERT(is_kept == NULL, "BAD_MEMORY");
+        for (unsigned int i = 0; i < count; ++i) {
+            is_kept[i] = (order[i] -> operation == NO_OP) || (i == count - 1) || order[i] -> is_checkpoint || (segment && !(i % segment));
+            if (!is_kept[i]) release_grad_value(order[i]);
+        }
+    }
+
+    for (unsigned int i = 0; i < count - 1; ++i) fill_tensor(ASSIGN(val, 0.0L, order[i] -> derived_value.data_type), order[i] -> derived_value);
+    if (is_sink) fill_tensor(ASSIGN(val, 1.0L, node -> derived_value.data_type), node -> derived_value);
+
+    // Each backward rule accumulates its contribution straight into the gradient of the parent
+    for (unsigned int i = count; i-- > 0;) {
+        GradNode* child = order[i];
+        if (is_kept != NULL) restore_grad_values(child);
+        for (unsigned int j = 0; j < child -> parents_count; ++j) derive_op(child -> parents[j], child, j);
+        if ((is_kept != NULL) && !is_kept[i]) release_grad_value(child);
     }
 
+    free(is_kept);
+    free(order);
+
     return;
 }
 
@@ -341,9 +686,9 @@ void forward_pass(GradNode* node) {
         GradNode* child = node -> children[i];
 
         if (!(child -> is_value_updated)) {
+            ASSERT(is_shared_operand(child), "SHARED_GRAD_VALUE");
             OperatorFlag op_flag = child -> operation;
-            if (op_flag == TANH || op_flag == EXP || op_flag == LOG) op_tensor(child -> value, *(node -> value), (Tensor) {.data_type = node -> derived_value.data_type}, op_flag);
-            else if (op_flag == POW || op_flag == SQRT) op_tensor(child -> value, *(node -> value), (Tensor) {.data = child -> exp, .data_type = node -> derived_value.data_type}, op_flag);
+            if (child -> parents_count == 1) op_tensor(child -> value, *(node -> value), (Tensor) {.data = child -> exp, .data_type = node -> derived_value.data_type}, op_flag);
             else {
                 GradNode* other_parent = OTHER_PARENT(child, node);
                 if (!(other_parent -> is_value_updated)) forward_pass(other_parent);
@@ -361,11 +706,10 @@ void forward_pass(GradNode* node) {
 
 void backward_pass(GradNode* node) {
     OperatorFlag op_flag = node -> operation;
+    ASSERT((op_flag != NO_OP) && is_shared_operand(node), "SHARED_GRAD_VALUE");
 
-    if (op_flag == TANH || op_flag == EXP || op_flag == LOG) {
-        if (!(node -> parents[0] -> is_value_updated)) backward_pass(node -> parents[0]);
-        op_tensor(node -> value, *(node -> parents[0] -> value), (Tensor) {.data_type = node -> derived_value.data_type}, op_flag);
-    } else if (op_flag == POW || op_flag == SQRT) {
+    // The unary operators read their scalar, or the softmax axis, from exp
+    if ((op_flag != NO_OP) && (node -> parents_count == 1)) {
         if (!(node -> parents[0] -> is_value_updated)) backward_pass(node -> parents[0]);
         op_tensor(node -> value, *(node -> parents[0] -> value), (Tensor) {.data = node -> exp, .data_type = node -> derived_value.data_type}, op_flag);
     } else if (op_flag != NO_OP) {
@@ -379,6 +723,298 @@ void backward_pass(GradNode* node) {
     return;
 }
 
+// The constant is rounded to the data type first, the value must then match it exactly
+static bool is_constant_value(void* data, DataType data_type, long double value) {
+    return IS_EQUAL(data, ASSIGN(&(long double) {0}, value, data_type), data_type);
+}
+
+static bool is_constant_node(GradNode* node, long double value) {
+    if ((node -> operation != NO_OP) || node -> parents_count || (TENSOR_SIZE(*(node -> value)) != 1)) return FALSE;
+    return is_constant_value(node -> value -> data, node -> value -> data_type, value);
+}
+
+// An intermediate node of a pattern must feed nothing but the next node of the chain, as it is dropped once fused
+static bool is_chain_node(GradNode* node, OperatorFlag operation) {
+    return (node != NULL) && (node -> operation == operation) && (node -> children_count == 1);
+}
+
+static bool is_pow_node(GradNode* node, long double exp) {
+    return (node -> operation == POW) && (node -> exp != NULL) && is_constant_value(node -> exp, node -> value -> data_type, exp);
+}
+
+// Returns the operand of node other than the constant value, NULL when node does not compute operation against it
+static GradNode* constant_operand(GradNode* node, OperatorFlag operation, long double value) {
+    if ((node == NULL) || (node -> operation != operation) || (node -> parents_count != 2)) return NULL;
+    if (is_constant_node(node -> parents[0], value)) return node -> parents[1];
+    if (is_constant_node(node -> parents[1], value)) return node -> parents[0];
+    return NULL;
+}
+
+// Math: \frac{1}{1 + e^{-x}}, matched as POW(SUM(1, POW(EXP(x), -1)), -1)
+static GradNode* match_sigmoid(GradNode* node, GradNode** fused) {
+    if (!is_pow_node(node, -1.0L)) return NULL;
+    GradNode* c = node -> parents[0];
+    if (!is_chain_node(c, SUM)) return NULL;
+    GradNode* b = constant_operand(c, SUM, 1.0L);
+    if (!is_chain_node(b, POW) || !is_pow_node(b, -1.0L)) return NULL;
+    GradNode* a = b -> parents[0];
+    if (!is_chain_node(a, EXP)) return NULL;
+    fused[0] = a;
+    fused[1] = b;
+    fused[2] = c;
+    return a -> parents[0];
+}
+
+// Math: 0.5x(1 + {\tanh}[{\sqrt{2/\pi}}({x} + 0.044715{x}^{3})]), matched as
+// MUL(MUL(x, 0.5), SUM(1, TANH(MUL(GELU_SCALE, SUM(x, MUL(GELU_COEFFICIENT, POW(x, 3)))))))
+static GradNode* match_gelu(GradNode* node, GradNode** fused) {
+    if ((node -> operation != MULTIPLICATION) || (node -> parents_count != 2)) return NULL;
+    for (unsigned int i = 0; i < 2; ++i) {
+        GradNode* g = node -> parents[i];
+        GradNode* f = node -> parents[1 - i];
+        if (!is_chain_node(g, MULTIPLICATION) || !is_chain_node(f, SUM)) continue;
+        GradNode* x = constant_operand(g, MULTIPLICATION, 0.5L);
+        GradNode* e = constant_operand(f, SUM, 1.0L);
+        if ((x == NULL) || !is_chain_node(e, TANH)) continue;
+        GradNode* d = e -> parents[0];
+        if (!is_chain_node(d, MULTIPLICATION)) continue;
+        GradNode* c = constant_operand(d, MULTIPLICATION, GELU_SCALE);
+        if (!is_chain_node(c, SUM) || (c -> parents_count != 2) || ((c -> parents[0] != x) && (c -> parents[1] != x))) continue;
+        GradNode* b = OTHER_PARENT(c, x);
+        if (!is_chain_node(b, MULTIPLICATION)) continue;
+        GradNode* a = constant_operand(b, MULTIPLICATION, GELU_COEFFICIENT);
+        if (!is_chain_node(a, POW) || !is_pow_node(a, 3.0L) || (a -> parents[0] != x)) continue;
+        fused[0] = a;
+        fused[1] = b;
+        fused[2] = c;
+        fused[3] = d;
+        fused[4] = e;
+        fused[5] = f;
+        fused[6] = g;
+        return x;
+    }
+    return NULL;
+}
+
+static void remove_child(GradNode* parent, GradNode* child) {
+    for (unsigned int i = 0; i < parent -> children_count; ++i) {
+        if (parent -> children[i] != child) continue;
+        parent -> children[i] = parent -> children[--(parent -> children_count)];
+        break;
+    }
+    return;
+}
+
+// Detaches node and every fused one from their operands, then turns node into operation applied on input. The fused
+// nodes are left as single nodes out of the graph, still owned by the tensors they were created through.
+static void fuse_nodes(GradNode* node, GradNode* input, OperatorFlag operation, GradNode** fused, unsigned int fused_count) {
+    for (unsigned int i = 0; i <= fused_count; ++i) {
+        GradNode* current = (i == fused_count) ? node : fused[i];
+        for (unsigned int j = 0; j < current -> parents_count; ++j) remove_child(current -> parents[j], current);
+    }
+    for (unsigned int i = 0; i < fused_count; ++i) fused[i] -> parents_count = 0;
+
+    free_memory(node -> exp);
+    node -> exp = NULL;
+    node -> operation = operation;
+    node -> parents[0] = input;
+    node -> parents_count = 1;
+    append_child(input, node);
+
+    return;
+}
+
+// Rewrites the chains of element-wise nodes computing the sigmoid and the GELU activations into single SIGMOID and
+// GELU nodes. Only constants held by single element leaves, equal to the ones of the activations once rounded to their
+// data type, are matched, so that trainable scalars must not be fused. Nothing is released: the fused nodes, and the
+// constants no other node reads anymore, are unlinked from the graph, so that the tensors they were created through
+// must not be used as graph operands anymore, and must release them with DEALLOCATE_GRAD_SINGLE_GRAPHS.
+// Returns the number of chains fused.
+unsigned int fuse_grad_graph(GradNode* sink) {
+    unsigned int count = 0, fused_count = 0;
+    GradNode* fused[7] = {0};
+    GradNode** order = sort_grad_graph(sink, &count);
+
+    // Parents come first, so that a match only drops nodes already visited
+    for (unsigned int i = 0; i < count; ++i) {
+        GradNode* input = NULL;
+        if ((input = match_sigmoid(order[i], fused)) != NULL) {
+            fuse_nodes(order[i], input, SIGMOID, fused, 3);
+            fused_count++;
+        } else if ((input = match_gelu(order[i], fused)) != NULL) {
+            fuse_nodes(order[i], input, GELU, fused, 7);
+            fused_count++;
+        }
+    }
+
+    free(order);
+
+    return fused_count;
+}
+
+// Flattens the graph computing sink into its topologically ordered steps, so that it can be evaluated again on new
+// inputs without walking it. Kernels are bound once here: compile again after changing the fast-math mode, or the shape
+// of any value in the graph, the buffers themselves are looked up at every run. Consecutive element-wise steps of the
+// same size are grouped, each group running in a single pass over memory.
+GradPlan compile_graph(GradNode* sink) {
+    GradPlan plan = { .steps = NULL, .steps_count = 0 };
+    GradNode** order = sort_grad_graph(sink, &(plan.steps_count));
+    plan.steps = (GradStep*) calloc(plan.steps_count, sizeof(GradStep));
+    ASSERT(plan.steps == NULL, "BAD_MEMORY");
+
+    for (unsigned int i = 0; i < plan.steps_count; ++i) {
+        GradNode* node = order[i];
+        GradStep* step = plan.steps + i;
+        step -> node = node;
+        step -> size = TENSOR_SIZE(*(node -> value));
+        if (node -> operation == NO_OP) continue;
+
+        step -> a = node -> parents[0] -> value;
+        step -> b = (node -> parents_count > 1) ? node -> parents[1] -> value : NULL;
+        DataType data_type = node -> value -> data_type;
+        bool is_bindable = has_kernel(node -> operation, data_type) && is_contiguous(*(step -> a)) && has_shape(*(step -> a), node -> value -> shape, node -> value -> rank, data_type);
+        if (step -> b != NULL) is_bindable = is_bindable && is_contiguous(*(step -> b)) && has_shape(*(step -> b), node -> value -> shape, node -> value -> rank, data_type);
+        if (is_bindable) step -> kernel = get_kernel(node -> operation, data_type);
+    }
+
+    // Leaves compute nothing, they never break a group
+    for (unsigned int i = 0; i < plan.steps_count;) {
+        unsigned int j = i + 1;
+        while ((plan.steps[i].kernel != NULL) && (j < plan.steps_count) && ((plan.steps[j].node -> operation == NO_OP) || ((plan.steps[j].kernel != NULL) && (plan.steps[j].size == plan.steps[i].size)))) j++;
+        plan.steps[i].fused_count = j - i;
+        i = j;
+    }
+
+    free(order);
+
+    return plan;
+}
+
+static void fused_task(void* args, size_t start, size_t end) {
+    FusedTask* task = (FusedTask*) args;
+    for (size_t tile = start; tile < end; tile += FUSED_TILE) {
+        const size_t tile_size = MIN(end - tile, FUSED_TILE);
+        for (unsigned int i = 0; i < task -> steps_count; ++i) {
+            GradStep* step = task -> steps + i;
+            if (step -> kernel == NULL) continue;
+            const size_t offset = tile * DATA_TYPE_SIZE(step -> node -> value -> data_type);
+            void* b = (step -> b != NULL) ? (void*) (CAST_PTR(step -> b -> data, unsigned char) + offset) : step -> node -> exp;
+            step -> kernel(CAST_PTR(step -> node -> value -> data, unsigned char) + offset, CAST_PTR(step -> a -> data, unsigned char) + offset, b, tile_size);
+        }
+    }
+    return;
+}
+
+void run_compiled_graph(GradPlan plan) {
+    // Resolve the SIMD level before the workers read it
+    NOT_USED(get_simd_level());
+    for (unsigned int i = 0; i < plan.steps_count; i += plan.steps[i].fused_count) {
+        GradStep* step = plan.steps + i;
+        GradNode* node = step -> node;
+        if (step -> kernel != NULL) {
+            // Values released by a checkpointed sweep get their memory back before the kernels write them
+            for (unsigned int j = 0; j < step -> fused_count; ++j) {
+                if ((step[j].kernel != NULL) && (step[j].node -> value -> data == NULL)) reshape_tensor_uninit(step[j].node -> value, step[j].node -> value -> shape, step[j].node -> value -> rank, step[j].node -> value -> data_type);
+            }
+            FusedTask task = { .steps = step, .steps_count = step -> fused_count };
+            parallel_for(step -> size, KERNEL_GRAIN, fused_task, &task);
+        } else if (node -> operation != NO_OP) {
+            Tensor b = (step -> b != NULL) ? *(step -> b) : (Tensor) {.data = node -> exp, .data_type = node -> value -> data_type};
+            op_tensor(node -> value, *(step -> a), b, node -> operation);
+        }
+        for (unsigned int j = 0; j < step -> fused_count; ++j) step[j].node -> is_value_updated = TRUE;
+    }
+    return;
+}
+
+static int compare_step_index(const void* a, const void* b) {
+    const uintptr_t node_a = (uintptr_t) CAST_PTR(a, GradStepIndex) -> node;
+    const uintptr_t node_b = (uintptr_t) CAST_PTR(b, GradStepIndex) -> node;
+    return (node_a > node_b) - (node_a < node_b);
+}
+
+static int find_step(GradStepIndex* index, unsigned int count, GradNode* node) {
+    GradStepIndex key = { .node = node, .step = 0 };
+    GradStepIndex* entry = (GradStepIndex*) bsearch(&key, index, count, sizeof(GradStepIndex), compare_step_index);
+    return (entry == NULL) ? -1 : (int) entry -> step;
+}
+
+// Lays the intermediate values of the plan out over a few shared buffers: a value only lives from the step computing
+// it to the last step reading it, after which its buffer is handed to the next value that fits. Leaves, the sink, and
+// the values read by nodes outside the plan keep their own memory, as do the values the backward rules read when
+// keep_backward_values is set. The others are only meaningful while the plan runs: their nodes are marked as shared,
+// and deriving or re-evaluating the graph through any of them asserts. Returns the bytes held by the shared buffers.
+size_t plan_graph_memory(GradPlan* plan, bool keep_backward_values) {
+    const unsigned int count = plan -> steps_count;
+    GradStepIndex* index = (GradStepIndex*) calloc(count, sizeof(GradStepIndex));
+    unsigned int* last_use = (unsigned int*) calloc(count, sizeof(unsigned int));
+    bool* is_pinned = (bool*) calloc(count, sizeof(bool));
+    ASSERT(index == NULL || last_use == NULL || is_pinned == NULL, "BAD_MEMORY");
+
+    for (unsigned int i = 0; i < count; ++i) {
+        index[i] = (GradStepIndex) { .node = plan -> steps[i].node, .step = i };
+        last_use[i] = i;
+    }
+    qsort(index, count, sizeof(GradStepIndex), compare_step_index);
+
+    for (unsigned int i = 0; i < count; ++i) {
+        GradNode* node = plan -> steps[i].node;
+        for (unsigned int j = 0; j < node -> parents_count; ++j) {
+            const int parent_step = find_step(index, count, node -> parents[j]);
+            last_use[parent_step] = MAX(last_use[parent_step], i);
+        }
+        is_pinned[i] = (node -> operation == NO_OP) || (i == count - 1) || (keep_backward_values && is_value_derived(node));
+        for (unsigned int j = 0; (j < node -> children_count) && !is_pinned[i]; ++j) is_pinned[i] = (find_step(index, count, node -> children[j]) < 0);
+    }
+
+    GradBuffer* buffers = NULL;
+    unsigned int buffers_count = 0;
+    size_t planned_size = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        if (is_pinned[i]) continue;
+        Tensor* value = plan -> steps[i].node -> value;
+        const size_t size = checked_mul(TENSOR_SIZE(*value), DATA_TYPE_SIZE(value -> data_type));
+
+        // Best fit among the buffers whose last reader already ran, a new one when none is large enough
+        GradBuffer* buffer = NULL;
+        for (unsigned int j = 0; j < buffers_count; ++j) {
+            if ((buffers[j].last_use >= i) || (buffers[j].size < size)) continue;
+            if ((buffer == NULL) || (buffers[j].size < buffer -> size)) buffer = buffers + j;
+        }
+        if (buffer == NULL) {
+            buffers = (GradBuffer*) realloc(buffers, sizeof(GradBuffer) * (buffers_count + 1));
+            ASSERT(buffers == NULL, "BAD_MEMORY");
+            buffer = buffers + buffers_count++;
+            buffer -> data = alloc_memory_uninit(size, 1);
+            buffer -> size = size;
+            planned_size += size;
+        }
+        buffer -> last_use = last_use[i];
+
+        DEALLOCATE_MEMORY(TENSOR_STORAGE(*value), value -> strides);
+        value -> strides = NULL;
+        value -> storage = NULL;
+        value -> data = retain_memory(buffer -> data);
+        plan -> steps[i].node -> is_value_shared = TRUE;
+    }
+
+    // The values keep the buffers alive
+    for (unsigned int i = 0; i < buffers_count; ++i) free_memory(buffers[i].data);
+    free(buffers);
+    free(index);
+    free(last_use);
+    free(is_pinned);
+
+    return planned_size;
+}
+
+void deallocate_compiled_graph(GradPlan* plan) {
+    free(plan -> steps);
+    plan -> steps = NULL;
+    plan -> steps_count = 0;
+    return;
+}
+
 void set_update_flag(bool update_flag, GradNode* node) {
     node -> is_value_updated = update_flag;
     for (unsigned int i = 0; i < node -> children_count; ++i) set_update_flag(update_flag, node -> children[i]);
@@ -0,0 +1,267 @@
+#ifndef _FAST_MATH_H_
+#define _FAST_MATH_H_
+
+#include <stdint.h>
+#include <math.h>
+#include "types.h"
+
+// Branch-free approximations of the transcendental functions used by the element-wise kernels:
+// every function is built only from arithmetic, comparisons and bit manipulation, so loops calling
+// them get auto-vectorized. Maximum errors measured against the long double libm on dense sweeps:
+//   fast_expf  < 1.5 ULP    fast_exp  < 1.5 ULP      (full range, subnormal results included)
+//   fast_logf  < 2 ULP      fast_log  < 2 ULP        (positive normals and subnormals)
+//   fast_tanhf < 1.5 ULP    fast_tanh < 1.5 ULP
+// The activations of the kernels built on them stay within 3 ULP for sigmoid and 2.5 ULP for gelu,
+// which is measured against x / 2 for x < 0, where 1 + tanh cancels.
+// Special values follow libm: NaN propagates, exp overflows to inf and underflows to 0,
+// log(0) = -inf, log(x < 0) = NaN, tanh saturates to +-1.
+// fast_pow_* picks a strategy from the exponent, which is shared by the whole tensor:
+//   integer |p| <= FAST_POW_MAX_INT   binary powering, within |p| - 1 ULP, plus 1 ULP for p < 0
+//   half-integer p                    the integer part below p times the correctly rounded sqrt, plus 2 ULP
+//   any other p                       fast_exp(p * fast_log(x)), about (2 + |p * log(x)|) ULP
+
+#define FAST_POW_MAX_INT 64
+#define FAST_MATH_BLOCK 256
+
+typedef union FloatBits { float f; int32_t i; } FloatBits;
+typedef union DoubleBits { double f; int64_t i; } DoubleBits;
+
+static inline float fast_selectf(bool condition, float a, float b);
+static inline double fast_select(bool condition, double a, double b);
+static inline bool fast_isnanf(float x);
+static inline bool fast_isnan(double x);
+static inline float fast_expf(float x);
+static inline double fast_exp(double x);
+static inline float fast_logf(float x);
+static inline double fast_log(double x);
+static inline float fast_tanhf(float x);
+static inline double fast_tanh(double x);
+
+/* ------------------------------------------------------------------------------------------------ */
+
+// Bitwise selects and NaN tests: GCC sinks the arithmetic of a floating ?: into branches
+// (and refuses to if-convert x != x), which would keep the calling loops scalar
+static inline float fast_selectf(bool condition, float a, float b) {
+    FloatBits x = { .f = a }, y = { .f = b };
+    const int32_t mask = -(int32_t) condition;
+    FloatBits res = { .i = (x.i & mask) | (y.i & ~mask) };
+    return res.f;
+}
+
+static inline double fast_select(bool condition, double a, double b) {
+    DoubleBits x = { .f = a }, y = { .f = b };
+    const int64_t mask = -(int64_t) condition;
+    DoubleBits res = { .i = (x.i & mask) | (y.i & ~mask) };
+    return res.f;
+}
+
+static inline bool fast_isnanf(float x) {
+    FloatBits bits = { .f = x };
+    return (bits.i & 0x7FFFFFFF) > 0x7F800000;
+}
+
+static inline bool fast_isnan(double x) {
+    DoubleBits bits = { .f = x };
+    return (bits.i & 0x7FFFFFFFFFFFFFFFLL) > 0x7FF0000000000000LL;
+}
+
+static inline float fast_expf(float x) {
+    const float hi = 88.7228394f, lo = -103.972084f;
+    const float magic = 12582912.0f;
+    float t = fast_selectf(x > hi, hi, fast_selectf(x < lo, lo, x));
+
+    // Math: e^x = 2^n e^r, with n = round(x \log_2 e) and |r| <= \ln(2) / 2
+    FloatBits n_bits = { .f = t * 1.44269504088896341f + magic };
+    float n = n_bits.f - magic;
+    int32_t n_int = n_bits.i - 0x4B400000;
+    float r = (t - n * 0.693359375f) - n * -2.12194440e-4f;
+
+    float p = 1.98412698e-4f;
+    p = p * r + 1.38888889e-3f;
+    p = p * r + 8.33333333e-3f;
+    p = p * r + 4.16666667e-2f;
+    p = p * r + 1.66666667e-1f;
+    p = p * r + 0.5f;
+    p = p * r + 1.0f;
+    p = p * r + 1.0f;
+
+    // Scaling in two halves keeps both factors normal down to the subnormal range
+    int32_t n_half = n_int >> 1;
+    FloatBits scale_a = { .i = (n_half + 127) << 23 };
+    FloatBits scale_b = { .i = (n_int - n_half + 127) << 23 };
+    float res = p * scale_a.f * scale_b.f;
+
+    res = fast_selectf(x > hi, (float) INFINITY, res);
+    res = fast_selectf(x < lo, 0.0f, res);
+    return fast_selectf(fast_isnanf(x), x, res);
+}
+
+static inline double fast_exp(double x) {
+    const double hi = 709.782712893383973, lo = -745.133219101941108;
+    const double magic = 6755399441055744.0;
+    double t = fast_select(x > hi, hi, fast_select(x < lo, lo, x));
+
+    DoubleBits n_bits = { .f = t * 1.44269504088896340736 + magic };
+    double n = n_bits.f - magic;
+    int64_t n_int = n_bits.i - 0x4338000000000000LL;
+    double r = (t - n * 6.93145751953125e-1) - n * 1.42860682030941723212e-6;
+
+    double p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    int64_t n_half = n_int >> 1;
+    DoubleBits scale_a = { .i = (n_half + 1023) << 52 };
+    DoubleBits scale_b = { .i = (n_int - n_half + 1023) << 52 };
+    double res = p * scale_a.f * scale_b.f;
+
+    res = fast_select(x > hi, (double) INFINITY, res);
+    res = fast_select(x < lo, 0.0, res);
+    return fast_select(fast_isnan(x), x, res);
+}
+
+static inline float fast_logf(float x) {
+    // Subnormals are brought into the normal range before splitting exponent and mantissa
+    const bool is_subnormal = x < 1.17549435e-38f;
+    FloatBits bits = { .f = fast_selectf(is_subnormal, x * 8388608.0f, x) };
+    int32_t exponent = ((bits.i >> 23) & 0xFF) - (is_subnormal ? 150 : 127);
+    FloatBits mantissa = { .i = (bits.i & 0x007FFFFF) | 0x3F800000 };
+
+    // Math: \ln(m) = 2 atanh(s), with s = \frac{m - 1}{m + 1} and m in [\sqrt{2}/2, \sqrt{2}]
+    const bool is_large = mantissa.f > 1.41421356f;
+    float m = fast_selectf(is_large, mantissa.f * 0.5f, mantissa.f);
+    float e = (float) (exponent + (is_large ? 1 : 0));
+    float s = (m - 1.0f) / (m + 1.0f);
+    float s2 = s * s;
+
+    float p = 1.0f / 9.0f;
+    p = p * s2 + 1.0f / 7.0f;
+    p = p * s2 + 1.0f / 5.0f;
+    p = p * s2 + 1.0f / 3.0f;
+    float res = (2.0f * s + 2.0f * s * s2 * p + e * -2.12194440e-4f) + e * 0.693359375f;
+
+    res = fast_selectf(x == 0.0f, -(float) INFINITY, res);
+    res = fast_selectf(x < 0.0f, (float) NAN, res);
+    res = fast_selectf(x == (float) INFINITY, x, res);
+    return fast_selectf(fast_isnanf(x), x, res);
+}
+
+static inline double fast_log(double x) {
+    const bool is_subnormal = x < 2.2250738585072014e-308;
+    DoubleBits bits = { .f = fast_select(is_subnormal, x * 4503599627370496.0, x) };
+    int32_t exponent = (int32_t) ((bits.i >> 52) & 0x7FF) - (is_subnormal ? 1075 : 1023);
+    DoubleBits mantissa = { .i = (bits.i & 0x000FFFFFFFFFFFFFLL) | 0x3FF0000000000000LL };
+
+    const bool is_large = mantissa.f > 1.41421356237309505;
+    double m = fast_select(is_large, mantissa.f * 0.5, mantissa.f);
+    double e = (double) (exponent + (is_large ? 1 : 0));
+    double s = (m - 1.0) / (m + 1.0);
+    double s2 = s * s;
+
+    double p = 1.0 / 23.0;
+    p = p * s2 + 1.0 / 21.0;
+    p = p * s2 + 1.0 / 19.0;
+    p = p * s2 + 1.0 / 17.0;
+    p = p * s2 + 1.0 / 15.0;
+    p = p * s2 + 1.0 / 13.0;
+    p = p * s2 + 1.0 / 11.0;
+    p = p * s2 + 1.0 / 9.0;
+    p = p * s2 + 1.0 / 7.0;
+    p = p * s2 + 1.0 / 5.0;
+    p = p * s2 + 1.0 / 3.0;
+    double res = (2.0 * s + 2.0 * s * s2 * p + e * 1.42860682030941723212e-6) + e * 6.93145751953125e-1;
+
+    res = fast_select(x == 0.0, -(double) INFINITY, res);
+    res = fast_select(x < 0.0, (double) NAN, res);
+    res = fast_select(x == (double) INFINITY, x, res);
+    return fast_select(fast_isnan(x), x, res);
+}
+
+static inline float fast_tanhf(float x) {
+    float a = fast_selectf(x < 0.0f, -x, x);
+
+    // Math: \tanh(a) = \frac{a}{1 + \frac{a^2}{3 + \frac{a^2}{5 + \dots}}} near zero, folded into the rational a + a^3 R(a^2) / Q(a^2)
+    float a2 = a * a;
+    float num = -0.0001998001998001998f;
+    num = num * a2 + -0.020512820512820513f;
+    num = num * a2 + -0.33333333333333331f;
+    float den = 0.00020720020720020721f;
+    den = den * a2 + 0.023310023310023312f;
+    den = den * a2 + 0.46153846153846156f;
+    den = den * a2 + 1.0f;
+    float small = a + a * a2 * num / den;
+
+    // Math: \tanh(a) = 1 - \frac{2}{e^{2a} + 1} away from zero
+    float large = 1.0f - 2.0f / (fast_expf(2.0f * fast_selectf(a > 9.5f, 9.5f, a)) + 1.0f);
+
+    float res = fast_selectf(a < 0.625f, small, large);
+    res = fast_selectf(x < 0.0f, -res, res);
+    return fast_selectf(fast_isnanf(x), x, res);
+}
+
+static inline double fast_tanh(double x) {
+    double a = fast_select(x < 0.0, -x, x);
+
+    double a2 = a * a;
+    double num = -3.1622138893727926e-12;
+    num = num * a2 + -9.249475626415419e-09;
+    num = num * a2 + -4.0358545316592611e-06;
+    num = num * a2 + -0.00055210489993098692;
+    num = num * a2 + -0.026086956521739129;
+    num = num * a2 + -0.33333333333333331;
+    double den = 3.1622138893727926e-12;
+    den = den * a2 + 9.4961283097864969e-09;
+    den = den * a2 + 4.2732577394039233e-06;
+    den = den * a2 + 0.00061022120518688027;
+    den = den * a2 + 0.031055900621118012;
+    den = den * a2 + 0.47826086956521741;
+    den = den * a2 + 1.0;
+    double small = a + a * a2 * num / den;
+
+    double large = 1.0 - 2.0 / (fast_exp(2.0 * fast_select(a > 19.5, 19.5, a)) + 1.0);
+
+    double res = fast_select(a < 0.625, small, large);
+    res = fast_select(x < 0.0, -res, res);
+    return fast_select(fast_isnan(x), x, res);
+}
+
+// The exponent is shared by all elements, so the powering steps are decided once and applied to L1-sized blocks.
+// Stamped by kernels.h once per target, as the f64 bit manipulation only vectorizes from AVX2 on
+#define FAST_POW(name, target, type, exp_fn, log_fn, sqrt_fn) \
+    target static void name(type* res, const type* x, type p, size_t size) { \
+        const type twice = 2 * p; \
+        if (!((p >= -FAST_POW_MAX_INT) && (p <= FAST_POW_MAX_INT) && (twice == (type) (long long) twice))) { \
+            for (size_t i = 0; i < size; ++i) res[i] = exp_fn(p * log_fn(x[i])); \
+            return; \
+        } \
+        const long long twice_int = (long long) twice; \
+        const bool is_half = (twice_int % 2) != 0; \
+        const long long n = is_half ? (twice_int - 1) / 2 : twice_int / 2; \
+        const unsigned long long bits = (unsigned long long) (n < 0 ? -n : n); \
+        type acc[FAST_MATH_BLOCK], base[FAST_MATH_BLOCK]; \
+        for (size_t start = 0; start < size; start += FAST_MATH_BLOCK) { \
+            const unsigned int len = (size - start) < FAST_MATH_BLOCK ? (unsigned int) (size - start) : FAST_MATH_BLOCK; \
+            for (unsigned int i = 0; i < len; ++i) acc[i] = 1, base[i] = x[start + i]; \
+            for (unsigned long long b = bits; b; b >>= 1) { \
+                if (b & 1) for (unsigned int i = 0; i < len; ++i) acc[i] *= base[i]; \
+                if (b > 1) for (unsigned int i = 0; i < len; ++i) base[i] *= base[i]; \
+            } \
+            if (n < 0) for (unsigned int i = 0; i < len; ++i) acc[i] = 1 / acc[i]; \
+            if (is_half) for (unsigned int i = 0; i < len; ++i) acc[i] *= sqrt_fn(x[start + i]); \
+            for (unsigned int i = 0; i < len; ++i) res[start + i] = acc[i]; \
+        } \
+        return; \
+    }
+
+#endif //_FAST_MATH_H_
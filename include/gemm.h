@@ -0,0 +1,165 @@
+#ifndef _GEMM_H_
+#define _GEMM_H_
+
+#include "./thread_pool.h"
+#include "./allocator.h"
+#include "./utils.h"
+#include "types.h"
+
+// Below this amount of multiply-adds packing costs more than it saves
+#define GEMM_SMALL_THRESHOLD (32 * 32 * 32)
+#define GEMM_ALIGNMENT 64
+#define GEMM_ALIGNED_SIZE(size) (((size) + GEMM_ALIGNMENT - 1) / GEMM_ALIGNMENT * GEMM_ALIGNMENT)
+// Elements of a packed block of rows x depth, rounded up so that consecutive blocks stay aligned
+#define GEMM_PACKED_SIZE(type, rows, depth) (GEMM_ALIGNED_SIZE(sizeof(type) * (rows) * (depth)) / sizeof(type))
+#define GEMM_PACK_GRAIN 8
+
+// Operands of one (jc, pc) iteration: the shared packed B panel, the blocks of A packed by each participant, and the
+// slices of A, B and C it touches
+typedef struct GemmTask {
+    const void* a;
+    const void* b;
+    void* packed_a;
+    void* packed_b;
+    void* c;
+    size_t m;
+    size_t nc;
+    size_t kc;
+    size_t mc_step;
+    size_t rs_a;
+    size_t cs_a;
+    size_t rs_b;
+    size_t cs_b;
+    size_t ldc;
+    bool accumulate;
+} GemmTask;
+
+// Computes C (m x n, row stride ldc) = A (m x k) * B (k x n), adding to C when accumulate is set.
+// A and B are addressed through (row, column) strides so transposed operands need no copy. INT_8 operands accumulate
+// into an INT_32 C.
+void gemm(DataType data_type, size_t m, size_t n, size_t k, void* a, size_t rs_a, size_t cs_a, void* b, size_t rs_b, size_t cs_b, void* c, size_t ldc, bool accumulate);
+
+/* ------------------------------------------------------------------------------------------------ */
+
+// Blocking parameters: the products of type accumulate in acc_type, MR x NR is the register tile, KC x NR panels of B stay in L1, MC x KC blocks of A stay in L2.
+// Threads pack the shared B panel together, then each one packs and multiplies its own blocks of A (shrunk below MC
+// when there would be fewer blocks than threads) into the buffer of its participant, allocated once per call
+#define GEMM_FAMILY(suffix, type, acc_type, MR, NR, MC, KC, NC) \
+    static void gemm_small_##suffix(size_t m, size_t n, size_t k, const type* a, size_t rs_a, size_t cs_a, const type* b, size_t rs_b, size_t cs_b, acc_type* c, size_t ldc, bool accumulate) { \
+        for (size_t i = 0; i < m; ++i) { \
+            acc_type* c_row = c + i * ldc; \
+            if (!accumulate) for (size_t j = 0; j < n; ++j) c_row[j] = 0; \
+            for (size_t p = 0; p < k; ++p) { \
+                const acc_type a_ip = a[i * rs_a + p * cs_a]; \
+                const type* b_row = b + p * rs_b; \
+                for (size_t j = 0; j < n; ++j) c_row[j] += a_ip * b_row[j * cs_b]; \
+            } \
+        } \
+        return; \
+    } \
+    \
+    static void pack_a_##suffix(size_t mc, size_t kc, const type* a, size_t rs_a, size_t cs_a, type* packed) { \
+        for (size_t ir = 0; ir < mc; ir += MR) { \
+            const size_t mr = MIN(MR, mc - ir); \
+            for (size_t p = 0; p < kc; ++p) { \
+                for (size_t i = 0; i < mr; ++i) packed[i] = a[(ir + i) * rs_a + p * cs_a]; \
+                for (size_t i = mr; i < MR; ++i) packed[i] = 0; \
+                packed += MR; \
+            } \
+        } \
+        return; \
+    } \
+    \
+    static void pack_b_##suffix(size_t kc, size_t nc, const type* b, size_t rs_b, size_t cs_b, type* packed) { \
+        for (size_t jr = 0; jr < nc; jr += NR) { \
+            const size_t nr = MIN(NR, nc - jr); \
+            for (size_t p = 0; p < kc; ++p) { \
+                for (size_t j = 0; j < nr; ++j) packed[j] = b[p * rs_b + (jr + j) * cs_b]; \
+                for (size_t j = nr; j < NR; ++j) packed[j] = 0; \
+                packed += NR; \
+            } \
+        } \
+        return; \
+    } \
+    \
+    static void micro_kernel_##suffix(size_t kc, const type* a, const type* b, acc_type* c, size_t ldc, size_t mr, size_t nr, bool accumulate) { \
+        acc_type acc[MR][NR] = {0}; \
+        for (size_t p = 0; p < kc; ++p, a += MR, b += NR) { \
+            for (size_t i = 0; i < MR; ++i) { \
+                for (size_t j = 0; j < NR; ++j) acc[i][j] += (acc_type) a[i] * b[j]; \
+            } \
+        } \
+        for (size_t i = 0; i < mr; ++i) { \
+            if (accumulate) for (size_t j = 0; j < nr; ++j) c[i * ldc + j] += acc[i][j]; \
+            else for (size_t j = 0; j < nr; ++j) c[i * ldc + j] = acc[i][j]; \
+        } \
+        return; \
+    } \
+    \
+    static void gemm_pack_b_task_##suffix(void* args, size_t start, size_t end) { \
+        GemmTask* task = (GemmTask*) args; \
+        const size_t jr = start * NR; \
+        pack_b_##suffix(task -> kc, MIN(end * NR, task -> nc) - jr, CAST_PTR(task -> b, const type) + jr * task -> cs_b, task -> rs_b, task -> cs_b, CAST_PTR(task -> packed_b, type) + jr * task -> kc); \
+        return; \
+    } \
+    \
+    static void gemm_block_task_##suffix(void* args, size_t start, size_t end) { \
+        GemmTask* task = (GemmTask*) args; \
+        type* packed_a = CAST_PTR(task -> packed_a, type) + get_thread_index() * GEMM_PACKED_SIZE(type, MC + MR, KC); \
+        for (size_t block = start; block < end; ++block) { \
+            const size_t ic = block * task -> mc_step; \
+            const size_t mc = MIN(task -> mc_step, task -> m - ic); \
+            pack_a_##suffix(mc, task -> kc, CAST_PTR(task -> a, const type) + ic * task -> rs_a, task -> rs_a, task -> cs_a, packed_a); \
+            for (size_t jr = 0; jr < task -> nc; jr += NR) { \
+                for (size_t ir = 0; ir < mc; ir += MR) { \
+                    micro_kernel_##suffix(task -> kc, packed_a + ir * task -> kc, CAST_PTR(task -> packed_b, type) + jr * task -> kc, CAST_PTR(task -> c, acc_type) + (ic + ir) * task -> ldc + jr, task -> ldc, MIN(MR, mc - ir), MIN(NR, task -> nc - jr), task -> accumulate); \
+                } \
+            } \
+        } \
+        return; \
+    } \
+    \
+    static void gemm_##suffix(size_t m, size_t n, size_t k, const type* a, size_t rs_a, size_t cs_a, const type* b, size_t rs_b, size_t cs_b, acc_type* c, size_t ldc, bool accumulate) { \
+        if (m * n * k <= GEMM_SMALL_THRESHOLD || !k) { \
+            gemm_small_##suffix(m, n, k, a, rs_a, cs_a, b, rs_b, cs_b, c, ldc, accumulate); \
+            return; \
+        } \
+        const unsigned int threads = get_num_threads(); \
+        type* packed_a = (type*) alloc_memory_uninit(threads * GEMM_PACKED_SIZE(type, MC + MR, KC), sizeof(type)); \
+        type* packed_b = (type*) alloc_memory_uninit(GEMM_PACKED_SIZE(type, NC + NR, KC), sizeof(type)); \
+        GemmTask task = { .packed_a = packed_a, .packed_b = packed_b, .m = m, .rs_a = rs_a, .cs_a = cs_a, .rs_b = rs_b, .cs_b = cs_b, .ldc = ldc }; \
+        task.mc_step = MIN(MC, ((m + threads - 1) / threads + MR - 1) / MR * MR); \
+        for (size_t jc = 0; jc < n; jc += NC) { \
+            task.nc = MIN(NC, n - jc); \
+            for (size_t pc = 0; pc < k; pc += KC) { \
+                task.kc = MIN(KC, k - pc); \
+                task.accumulate = accumulate || pc; \
+                task.a = a + pc * cs_a; \
+                task.b = b + pc * rs_b + jc * cs_b; \
+                task.c = c + jc; \
+                parallel_for((task.nc + NR - 1) / NR, GEMM_PACK_GRAIN, gemm_pack_b_task_##suffix, &task); \
+                parallel_for((m + task.mc_step - 1) / task.mc_step, 1, gemm_block_task_##suffix, &task); \
+            } \
+        } \
+        DEALLOCATE_MEMORY(packed_a, packed_b); \
+        return; \
+    }
+
+GEMM_FAMILY(f32, float, float, 4, 8, 128, 256, 2048)
+GEMM_FAMILY(f64, double, double, 4, 8, 96, 256, 1024)
+#ifndef TENSOR_NO_FLOAT_128
+GEMM_FAMILY(f128, long double, long double, 2, 4, 64, 128, 512)
+#endif
+GEMM_FAMILY(i8, signed char, int, 4, 16, 128, 512, 4096)
+
+void gemm(DataType data_type, size_t m, size_t n, size_t k, void* a, size_t rs_a, size_t cs_a, void* b, size_t rs_b, size_t cs_b, void* c, size_t ldc, bool accumulate) {
+    if (data_type == FLOAT_32) gemm_f32(m, n, k, CAST_PTR(a, float), rs_a, cs_a, CAST_PTR(b, float), rs_b, cs_b, CAST_PTR(c, float), ldc, accumulate);
+    else if (data_type == FLOAT_64) gemm_f64(m, n, k, CAST_PTR(a, double), rs_a, cs_a, CAST_PTR(b, double), rs_b, cs_b, CAST_PTR(c, double), ldc, accumulate);
+#ifndef TENSOR_NO_FLOAT_128
+    else if (data_type == FLOAT_128) gemm_f128(m, n, k, CAST_PTR(a, long double), rs_a, cs_a, CAST_PTR(b, long double), rs_b, cs_b, CAST_PTR(c, long double), ldc, accumulate);
+#endif
+    else if (data_type == INT_8) gemm_i8(m, n, k, CAST_PTR(a, signed char), rs_a, cs_a, CAST_PTR(b, signed char), rs_b, cs_b, CAST_PTR(c, int), ldc, accumulate);
+    return;
+}
+
+#endif //_GEMM_H_
@@ -0,0 +1,815 @@
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+#include "./thread_pool.h"
+#include "./utils.h"
+#include "types.h"
+
+// Elements per parallel chunk, a multiple of every vector width so chunks keep the SIMD bulk aligned
+#define KERNEL_GRAIN 16384
+#define IS_BINARY_KERNEL(op_flag) (((op_flag) == SUM) || ((op_flag) == SUBTRACTION) || ((op_flag) == MULTIPLICATION) || ((op_flag) == DIVISION) || ((op_flag) == MAX) || ((op_flag) == MIN))
+// Only the compute types have kernels, they lead the data types
+#define DATA_TYPE_INDEX(data_type) (data_type)
+#define DATA_TYPES_COUNT ARR_SIZE(compute_data_types)
+// Positions reduced side by side, each one walking its own column of the reduced axes
+#define REDUCE_TILE 64
+// Elements below which a reduced row is not split across threads
+#define REDUCE_MIN_CHUNK 8192
+// The axes of a reduction are a 32 bit mask
+#define REDUCE_MAX_RANK 32
+
+// KERNEL OPERATORS
+#define KERNEL_ABS(x) ((x) > 0 ? (x) : (x) ? -(x) : 0)
+#define KERNEL_SUB(x, y) ((x) - (y))
+#define KERNEL_MUL(x, y) ((x) * (y))
+#define KERNEL_DIV(x, y) ((x) / (y))
+#define KERNEL_SUM(x, y) ((x) + (y))
+#define KERNEL_MAX(x, y) MAX(x, y)
+#define KERNEL_MIN(x, y) MIN(x, y)
+#define KERNEL_NEG(x) (-(x))
+#define KERNEL_SIGMOID(x, exp_fn) (1 / (1 + exp_fn(-(x))))
+#define KERNEL_GELU(x, type, tanh_fn) ((type) 0.5 * (x) * (1 + tanh_fn((type) GELU_SCALE * ((x) + (type) GELU_COEFFICIENT * (x) * (x) * (x)))))
+
+// Local gradients of the backward rules, scaled by the gradient dy flowing from the result: SIGMOID and TANH are derived
+// from their own output, the denominator of DIVISION from both operands
+#define KERNEL_IDENTITY_GRAD(x, dy) (dy)
+#define KERNEL_NEG_GRAD(x, dy) (-(dy))
+#define KERNEL_MUL_GRAD(x, dy) ((dy) * (x))
+#define KERNEL_DIV_GRAD(x, dy) ((dy) / (x))
+#define KERNEL_DENOMINATOR_GRAD(x, y, dy) (-((dy) * ((y) / ((x) * (x)))))
+#define KERNEL_TANH_GRAD(t, dy) ((dy) * (1 - (t) * (t)))
+#define KERNEL_LOG_GRAD(x, dy) ((dy) * (1 / (x)))
+#define KERNEL_ABS_GRAD(x, dy) ((x) > 0 ? (dy) : (x) < 0 ? -(dy) : 0)
+#define KERNEL_SIGMOID_GRAD(s, dy) ((dy) * (s) * (1 - (s)))
+#define KERNEL_EXTREMUM_GRAD(x, y, dy) ((x) == (y) ? (dy) : 0)
+#define IS_BINARY_ACCUMULATE(op_flag, operand) ((((op_flag) == DIVISION) && (operand)) || ((op_flag) == MAX) || ((op_flag) == MIN))
+
+// Element-wise loop over size elements: binary kernels read a[i] and b[i], unary kernels ignore b and scalar kernels read only *b
+typedef void (*TensorKernel)(void* res, void* a, void* b, size_t size);
+
+typedef struct KernelTask {
+    TensorKernel kernel;
+    unsigned char* res;
+    unsigned char* a;
+    unsigned char* b;
+    DataType data_type;
+    bool is_binary;
+} KernelTask;
+
+// Whether every element of a compares to the one of b as flag asks, NEGATIVE and POSITIVE leave b unread
+typedef bool (*CompareKernel)(void* a, void* b, size_t size, ComparisonFlag flag);
+
+// Fused backward rule of an operator, adding the local gradient of one of its operands times dy straight into grad.
+// x is the value the rule reads, y the numerator for the denominator of DIVISION or the exponent of POW
+typedef void (*AccumulateKernel)(void* grad, void* x, void* y, void* dy, size_t size);
+
+typedef struct AccumulateTask {
+    AccumulateKernel kernel;
+    unsigned char* grad;
+    unsigned char* x;
+    unsigned char* y;
+    unsigned char* dy;
+    DataType data_type;
+    bool is_binary;
+} AccumulateTask;
+
+// Softmax of the rows of n elements spaced by stride, or its backward when dy is set: x then holds the softmax output
+typedef void (*SoftmaxKernel)(void* res, void* x, void* dy, size_t n, size_t stride, bool is_log);
+
+// Rows of a tensor viewed as [outer, n, inner] along the softmax axis, row r starting at (r / inner) * n * inner + r % inner
+typedef struct SoftmaxTask {
+    SoftmaxKernel kernel;
+    unsigned char* res;
+    unsigned char* x;
+    unsigned char* dy;
+    size_t n;
+    size_t inner;
+    DataType data_type;
+    bool is_log;
+} SoftmaxTask;
+
+// Reduces, for count consecutive positions, the n elements spaced by stride starting at each of them. Sums are
+// Kahan-compensated and left unscaled, REDUCE_NORM sums |x|^p without taking the root and REDUCE_ARGMAX writes both the
+// maximum and its index: the partial results of the chunks of a row then combine through a second pass.
+typedef void (*ReduceKernel)(void* res, void* index, void* x, size_t n, size_t stride, size_t count, ReductionFlag flag, long double p);
+
+// Items of a reduction over a tensor viewed as [outer, n, inner]: every chunk of the row, for every outer index and
+// every tile of REDUCE_TILE inner positions. The partial results of chunk c are written at c * outer * inner.
+typedef struct ReduceTask {
+    ReduceKernel kernel;
+    unsigned char* res;
+    unsigned char* index;
+    unsigned char* x;
+    size_t outer;
+    size_t n;
+    size_t inner;
+    size_t tiles;
+    size_t chunk_size;
+    DataType data_type;
+    ReductionFlag flag;
+    long double p;
+} ReduceTask;
+
+// Adds to the gradient of x the backward of a reduction from its result y and the gradient dy flowing from it, both
+// laid out along out_strides, which are 0 across the reduced axes of shape
+typedef void (*ReduceGradKernel)(void* grad, void* x, void* y, void* dy, const size_t* shape, const size_t* out_strides, unsigned int rank, size_t start, size_t end, ReductionFlag flag, long double p);
+
+// Converts the elements [start, end) between any two data types
+typedef struct ConvertTask {
+    unsigned char* dst;
+    unsigned char* src;
+    DataType dst_type;
+    DataType src_type;
+} ConvertTask;
+
+// Quantizes x into q, or dequantizes q into x: the element i belongs to the channel (i / inner) % channels
+typedef struct QuantizeTask {
+    float* x;
+    void* q;
+    DataType q_type;
+    const float* scales;
+    const int* zero_points;
+    size_t channels;
+    size_t inner;
+    bool is_dequantize;
+} QuantizeTask;
+
+typedef struct ReduceGradTask {
+    ReduceGradKernel kernel;
+    void* grad;
+    void* x;
+    void* y;
+    void* dy;
+    const size_t* shape;
+    const size_t* out_strides;
+    unsigned int rank;
+    ReductionFlag flag;
+    long double p;
+} ReduceGradTask;
+
+#define BINARY_KERNEL(name, type, op) \
+    static void name(void* res, void* a, void* b, size_t size) { \
+        type* r = CAST_PTR(res, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type* y = CAST_PTR(b, type); \
+        for (size_t i = 0; i < size; ++i) r[i] = op(x[i], y[i]); \
+        return; \
+    }
+
+#define SCALAR_KERNEL(name, type, op) \
+    static void name(void* res, void* a, void* b, size_t size) { \
+        type* r = CAST_PTR(res, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type y = *CAST_PTR(b, type); \
+        for (size_t i = 0; i < size; ++i) r[i] = op(x[i], y); \
+        return; \
+    }
+
+#define UNARY_KERNEL(name, type, op) \
+    static void name(void* res, void* a, void* b, size_t size) { \
+        NOT_USED(b); \
+        type* r = CAST_PTR(res, type); \
+        const type* x = CAST_PTR(a, type); \
+        for (size_t i = 0; i < size; ++i) r[i] = op(x[i]); \
+        return; \
+    }
+
+// Density of the normal distribution at x, with the variance and the mean read from b[0] and b[1]
+#define NORMAL_KERNEL(name, type, exp_fn, sqrt_fn) \
+    static void name(void* res, void* a, void* b, size_t size) { \
+        type* r = CAST_PTR(res, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type variance = CAST_PTR(b, type)[0]; \
+        const type mean = CAST_PTR(b, type)[1]; \
+        const type scale = 1 / sqrt_fn(2 * (type) M_PI * variance); \
+        for (size_t i = 0; i < size; ++i) r[i] = scale * exp_fn(-((x[i] - mean) * (x[i] - mean) * (2 * variance))); \
+        return; \
+    }
+
+// Writes b[1] where x reaches the threshold b[0], b[2] elsewhere
+#define THRESHOLD_KERNEL(name, type) \
+    static void name(void* res, void* a, void* b, size_t size) { \
+        type* r = CAST_PTR(res, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type* values = CAST_PTR(b, type); \
+        for (size_t i = 0; i < size; ++i) r[i] = (x[i] >= values[0]) ? values[1] : values[2]; \
+        return; \
+    }
+
+// Run serially, so that a seeded sequence lands on the same elements whatever the thread count
+#define RANDOM_KERNEL(name, type) \
+    static void name(void* res, void* a, void* b, size_t size) { \
+        NOT_USED(a); \
+        NOT_USED(b); \
+        type* r = CAST_PTR(res, type); \
+        for (size_t i = 0; i < size; ++i) r[i] = (type) ((long double) rand() / RAND_MAX); \
+        return; \
+    }
+
+// The flag is resolved once, the loop stops at the first element failing it
+#define COMPARE_KERNEL(name, type) \
+    static bool name(void* a, void* b, size_t size, ComparisonFlag flag) { \
+        const type* x = CAST_PTR(a, type); \
+        const type* y = CAST_PTR(b, type); \
+        size_t i = 0; \
+        if (flag == EQUAL) while ((i < size) && (x[i] == y[i])) ++i; \
+        else if (flag == LESS) while ((i < size) && (x[i] < y[i])) ++i; \
+        else if (flag == LESS_OR_EQUAL) while ((i < size) && (x[i] <= y[i])) ++i; \
+        else if (flag == GREATER) while ((i < size) && (x[i] > y[i])) ++i; \
+        else if (flag == GREATER_OR_EQUAL) while ((i < size) && (x[i] >= y[i])) ++i; \
+        else if (flag == NEGATIVE) while ((i < size) && (x[i] < 0)) ++i; \
+        else if (flag == POSITIVE) while ((i < size) && (x[i] > 0)) ++i; \
+        return i == size; \
+    }
+
+// The rules passing dy through leave x unread
+#define ACCUMULATE_KERNEL(name, type, rule) \
+    static void name(void* grad, void* a, void* b, void* d, size_t size) { \
+        NOT_USED(b); \
+        type* g = CAST_PTR(grad, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type* dy = CAST_PTR(d, type); \
+        NOT_USED(x); \
+        for (size_t i = 0; i < size; ++i) g[i] += rule(x[i], dy[i]); \
+        return; \
+    }
+
+#define BINARY_ACCUMULATE_KERNEL(name, type, rule) \
+    static void name(void* grad, void* a, void* b, void* d, size_t size) { \
+        type* g = CAST_PTR(grad, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type* y = CAST_PTR(b, type); \
+        const type* dy = CAST_PTR(d, type); \
+        for (size_t i = 0; i < size; ++i) g[i] += rule(x[i], y[i], dy[i]); \
+        return; \
+    }
+
+#define SCALAR_ACCUMULATE_KERNEL(name, type, rule) \
+    static void name(void* grad, void* a, void* b, void* d, size_t size) { \
+        type* g = CAST_PTR(grad, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type y = *CAST_PTR(b, type); \
+        const type* dy = CAST_PTR(d, type); \
+        for (size_t i = 0; i < size; ++i) g[i] += rule(x[i], y, dy[i]); \
+        return; \
+    }
+
+// Numerically stable softmax of a row of n elements spaced by stride: the exponentials are taken after subtracting the
+// maximum of the row, the log-softmax is x - max - log(sum). Each element is read once after the maximum, so res may be x.
+#define SOFTMAX_KERNEL(name, type, exp_fn, log_fn) \
+    static void name(void* res, void* a, void* d, size_t n, size_t stride, bool is_log) { \
+        NOT_USED(d); \
+        type* r = CAST_PTR(res, type); \
+        const type* x = CAST_PTR(a, type); \
+        type max = x[0]; \
+        type sum = 0; \
+        for (size_t k = 1; k < n; ++k) max = MAX(max, x[k * stride]); \
+        if (is_log) { \
+            for (size_t k = 0; k < n; ++k) sum += exp_fn(x[k * stride] - max); \
+            const type shift = max + log_fn(sum); \
+            for (size_t k = 0; k < n; ++k) r[k * stride] = x[k * stride] - shift; \
+        } else { \
+            for (size_t k = 0; k < n; ++k) sum += (r[k * stride] = exp_fn(x[k * stride] - max)); \
+            const type inv_sum = 1 / sum; \
+            for (size_t k = 0; k < n; ++k) r[k * stride] *= inv_sum; \
+        } \
+        return; \
+    }
+
+// Vector-Jacobian product of the softmax of a row, accumulated into grad from its output y: y * (dy - <dy, y>), or
+// dy - e^y * sum(dy) for the log-softmax, never building the n x n Jacobian
+#define SOFTMAX_GRAD_KERNEL(name, type, exp_fn) \
+    static void name(void* grad, void* a, void* d, size_t n, size_t stride, bool is_log) { \
+        type* g = CAST_PTR(grad, type); \
+        const type* y = CAST_PTR(a, type); \
+        const type* dy = CAST_PTR(d, type); \
+        type dot = 0; \
+        if (is_log) { \
+            for (size_t k = 0; k < n; ++k) dot += dy[k * stride]; \
+            for (size_t k = 0; k < n; ++k) g[k * stride] += dy[k * stride] - exp_fn(y[k * stride]) * dot; \
+        } else { \
+            for (size_t k = 0; k < n; ++k) dot += dy[k * stride] * y[k * stride]; \
+            for (size_t k = 0; k < n; ++k) g[k * stride] += y[k * stride] * (dy[k * stride] - dot); \
+        } \
+        return; \
+    }
+
+#define REDUCE_KERNEL(name, type, exp_fn, log_fn, pow_fn) \
+    static void name(void* res, void* index, void* a, size_t n, size_t stride, size_t count, ReductionFlag flag, long double p) { \
+        type* r = CAST_PTR(res, type); \
+        type* idx = CAST_PTR(index, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type order = (type) p; \
+        const bool is_extremum = (flag == REDUCE_MAX) || (flag == REDUCE_MIN) || (flag == REDUCE_ARGMAX) || (flag == REDUCE_LOGSUMEXP); \
+        for (size_t i0 = 0; i0 < count; i0 += REDUCE_TILE) { \
+            const size_t tile = MIN(count - i0, REDUCE_TILE); \
+            const type* column = x + i0; \
+            type best[REDUCE_TILE], sum[REDUCE_TILE], compensation[REDUCE_TILE]; \
+            size_t best_k[REDUCE_TILE]; \
+            if (is_extremum) { \
+                for (size_t i = 0; i < tile; ++i) best[i] = column[i], best_k[i] = 0; \
+                for (size_t k = 1; k < n; ++k) { \
+                    for (size_t i = 0; i < tile; ++i) { \
+                        const type v = column[k * stride + i]; \
+                        if ((flag == REDUCE_MIN) ? (v < best[i]) : (v > best[i])) best[i] = v, best_k[i] = k; \
+                    } \
+                } \
+            } \
+            if (!is_extremum || (flag == REDUCE_LOGSUMEXP)) { \
+                for (size_t i = 0; i < tile; ++i) sum[i] = 0, compensation[i] = 0; \
+                for (size_t k = 0; k < n; ++k) { \
+                    for (size_t i = 0; i < tile; ++i) { \
+                        const type v = column[k * stride + i]; \
+                        const type term = (flag == REDUCE_LOGSUMEXP) ? exp_fn(v - best[i]) : (flag != REDUCE_NORM) ? v : (order == 1) ? KERNEL_ABS(v) : (order == 2) ? v * v : pow_fn(KERNEL_ABS(v), order); \
+                        const type y = term - compensation[i]; \
+                        const type t = sum[i] + y; \
+                        compensation[i] = (t - sum[i]) - y; \
+                        sum[i] = t; \
+                    } \
+                } \
+            } \
+            for (size_t i = 0; i < tile; ++i) { \
+                if (flag == REDUCE_LOGSUMEXP) r[i0 + i] = best[i] + log_fn(sum[i]); \
+                else if (is_extremum) r[i0 + i] = best[i]; \
+                else r[i0 + i] = sum[i]; \
+                if (flag == REDUCE_ARGMAX) idx[i0 + i] = (type) best_k[i]; \
+            } \
+        } \
+        return; \
+    }
+
+// Walks the elements [start, end) of x in row-major order, moving the offset of their reduced position along
+#define REDUCE_GRAD_KERNEL(name, type, exp_fn, pow_fn) \
+    static void name(void* grad, void* a, void* b, void* d, const size_t* shape, const size_t* out_strides, unsigned int rank, size_t start, size_t end, ReductionFlag flag, long double p) { \
+        type* g = CAST_PTR(grad, type); \
+        const type* x = CAST_PTR(a, type); \
+        const type* y = CAST_PTR(b, type); \
+        const type* dy = CAST_PTR(d, type); \
+        const type order = (type) p; \
+        size_t coords[REDUCE_MAX_RANK] = {0}; \
+        size_t out = 0, remainder = start; \
+        for (unsigned int dim = rank; dim-- > 0;) { \
+            coords[dim] = remainder % shape[dim]; \
+            remainder /= shape[dim]; \
+            out += coords[dim] * out_strides[dim]; \
+        } \
+        for (size_t i = start; i < end; ++i) { \
+            const type v = x[i]; \
+            if (flag == REDUCE_SUM) g[i] += dy[out]; \
+            else if (flag == REDUCE_MEAN) g[i] += dy[out] * order; \
+            else if (flag == REDUCE_LOGSUMEXP) g[i] += dy[out] * exp_fn(v - y[out]); \
+            else if (flag == REDUCE_NORM) { \
+                if (y[out] != 0) g[i] += dy[out] * ((v > 0) ? 1 : (v < 0) ? -1 : 0) * pow_fn(KERNEL_ABS(v), order - 1) / pow_fn(y[out], order - 1); \
+            } else if (v == y[out]) g[i] += dy[out]; \
+            for (unsigned int dim = rank; dim-- > 0;) { \
+                if (++coords[dim] < shape[dim]) { \
+                    out += out_strides[dim]; \
+                    break; \
+                } \
+                out -= (shape[dim] - 1) * out_strides[dim]; \
+                coords[dim] = 0; \
+            } \
+        } \
+        return; \
+    }
+
+// Single pass activations replacing their chains of element-wise operators, the backward of GELU is derived from its input
+#define ACTIVATION_FUNCTIONS(prefix, target, type, exp_fn, tanh_fn) \
+    target static inline type prefix##sigmoid(type x) { return KERNEL_SIGMOID(x, exp_fn); } \
+    target static inline type prefix##gelu(type x) { return KERNEL_GELU(x, type, tanh_fn); } \
+    target static inline type prefix##gelu_grad(type x, type dy) { \
+        const type t = tanh_fn((type) GELU_SCALE * (x + (type) GELU_COEFFICIENT * x * x * x)); \
+        return dy * ((type) 0.5 * (1 + t) + (type) 0.5 * x * (1 - t * t) * (type) GELU_SCALE * (1 + 3 * (type) GELU_COEFFICIENT * x * x)); \
+    }
+
+#define KERNEL_FAMILY(suffix, type, exp_fn, tanh_fn, sqrt_fn, log_fn, pow_fn) \
+    ACTIVATION_FUNCTIONS(activation_##suffix##_, , type, exp_fn, tanh_fn) \
+    BINARY_KERNEL(sum_kernel_##suffix, type, KERNEL_SUM) \
+    BINARY_KERNEL(sub_kernel_##suffix, type, KERNEL_SUB) \
+    BINARY_KERNEL(mul_kernel_##suffix, type, KERNEL_MUL) \
+    BINARY_KERNEL(div_kernel_##suffix, type, KERNEL_DIV) \
+    BINARY_KERNEL(max_kernel_##suffix, type, KERNEL_MAX) \
+    BINARY_KERNEL(min_kernel_##suffix, type, KERNEL_MIN) \
+    SCALAR_KERNEL(pow_kernel_##suffix, type, pow_fn) \
+    UNARY_KERNEL(exp_kernel_##suffix, type, exp_fn) \
+    UNARY_KERNEL(tanh_kernel_##suffix, type, tanh_fn) \
+    UNARY_KERNEL(sqrt_kernel_##suffix, type, sqrt_fn) \
+    UNARY_KERNEL(log_kernel_##suffix, type, log_fn) \
+    UNARY_KERNEL(abs_kernel_##suffix, type, KERNEL_ABS) \
+    UNARY_KERNEL(conjugate_kernel_##suffix, type, KERNEL_NEG) \
+    UNARY_KERNEL(sigmoid_kernel_##suffix, type, activation_##suffix##_sigmoid) \
+    UNARY_KERNEL(gelu_kernel_##suffix, type, activation_##suffix##_gelu) \
+    NORMAL_KERNEL(normal_kernel_##suffix, type, exp_fn, sqrt_fn) \
+    THRESHOLD_KERNEL(threshold_kernel_##suffix, type) \
+    RANDOM_KERNEL(random_kernel_##suffix, type) \
+    COMPARE_KERNEL(compare_kernel_##suffix, type) \
+    static inline type pow_grad_##suffix(type x, type e, type dy) { return dy * (pow_fn(x, e - 1) * e); } \
+    ACCUMULATE_KERNEL(sum_accumulate_kernel_##suffix, type, KERNEL_IDENTITY_GRAD) \
+    ACCUMULATE_KERNEL(neg_accumulate_kernel_##suffix, type, KERNEL_NEG_GRAD) \
+    ACCUMULATE_KERNEL(mul_accumulate_kernel_##suffix, type, KERNEL_MUL_GRAD) \
+    ACCUMULATE_KERNEL(div_accumulate_kernel_##suffix, type, KERNEL_DIV_GRAD) \
+    BINARY_ACCUMULATE_KERNEL(denominator_accumulate_kernel_##suffix, type, KERNEL_DENOMINATOR_GRAD) \
+    BINARY_ACCUMULATE_KERNEL(extremum_accumulate_kernel_##suffix, type, KERNEL_EXTREMUM_GRAD) \
+    SCALAR_ACCUMULATE_KERNEL(pow_accumulate_kernel_##suffix, type, pow_grad_##suffix) \
+    ACCUMULATE_KERNEL(tanh_accumulate_kernel_##suffix, type, KERNEL_TANH_GRAD) \
+    ACCUMULATE_KERNEL(log_accumulate_kernel_##suffix, type, KERNEL_LOG_GRAD) \
+    ACCUMULATE_KERNEL(abs_accumulate_kernel_##suffix, type, KERNEL_ABS_GRAD) \
+    ACCUMULATE_KERNEL(sigmoid_accumulate_kernel_##suffix, type, KERNEL_SIGMOID_GRAD) \
+    ACCUMULATE_KERNEL(gelu_accumulate_kernel_##suffix, type, activation_##suffix##_gelu_grad) \
+    SOFTMAX_KERNEL(softmax_kernel_##suffix, type, exp_fn, log_fn) \
+    SOFTMAX_GRAD_KERNEL(softmax_grad_kernel_##suffix, type, exp_fn) \
+    REDUCE_KERNEL(reduce_kernel_##suffix, type, exp_fn, log_fn, pow_fn) \
+    REDUCE_GRAD_KERNEL(reduce_grad_kernel_##suffix, type, exp_fn, pow_fn)
+
+// Runs the SIMD bulk selected at runtime, then finishes the tail with the scalar kernel
+#define VECTOR_KERNEL(name, op_flag, suffix, type, data_type, is_binary) \
+    static void name##_vector_kernel_##suffix(void* res, void* a, void* b, size_t size) { \
+        SimdKernel simd_kernel = get_simd_kernel(op_flag, data_type); \
+        size_t bulk = (simd_kernel == NULL) ? 0 : simd_kernel(res, a, b, size); \
+        name##_kernel_##suffix(CAST_PTR(res, type) + bulk, CAST_PTR(a, type) + bulk, is_binary ? (void*) (CAST_PTR(b, type) + bulk) : b, size - bulk); \
+        return; \
+    }
+
+#define VECTOR_KERNEL_FAMILY(suffix, type, data_type) \
+    VECTOR_KERNEL(sum, SUM, suffix, type, data_type, TRUE) \
+    VECTOR_KERNEL(sub, SUBTRACTION, suffix, type, data_type, TRUE) \
+    VECTOR_KERNEL(mul, MULTIPLICATION, suffix, type, data_type, TRUE) \
+    VECTOR_KERNEL(div, DIVISION, suffix, type, data_type, TRUE) \
+    VECTOR_KERNEL(max, MAX, suffix, type, data_type, TRUE) \
+    VECTOR_KERNEL(min, MIN, suffix, type, data_type, TRUE) \
+    VECTOR_KERNEL(abs, ABS, suffix, type, data_type, FALSE) \
+    VECTOR_KERNEL(conjugate, CONJUGATE, suffix, type, data_type, FALSE) \
+    VECTOR_KERNEL(sqrt, SQRT, suffix, type, data_type, FALSE)
+
+// Approximated kernels from fast_math.h, selected when the tensor context enables fast-math.
+// Each one is stamped for the baseline target and for AVX2, where the f64 bit manipulation vectorizes too
+#if SIMD_X86
+#define FAST_TARGET_AVX2 SIMD_TARGET_AVX2
+#else
+#define FAST_TARGET_AVX2
+#endif
+
+#define FAST_UNARY_KERNEL(name, target, type, op) \
+    target static void name(void* res, void* a, void* b, size_t size) { \
+        NOT_USED(b); \
+        type* r = CAST_PTR(res, type); \
+        const type* x = CAST_PTR(a, type); \
+        for (size_t i = 0; i < size; ++i) r[i] = op(x[i]); \
+        return; \
+    }
+
+#define FAST_KERNEL_ISA(isa, target, suffix, type, exp_fn, tanh_fn, log_fn, sqrt_fn) \
+    ACTIVATION_FUNCTIONS(fast_activation_##isa##_##suffix##_, target, type, exp_fn, tanh_fn) \
+    FAST_UNARY_KERNEL(fast_exp_##isa##_##suffix, target, type, exp_fn) \
+    FAST_UNARY_KERNEL(fast_tanh_##isa##_##suffix, target, type, tanh_fn) \
+    FAST_UNARY_KERNEL(fast_sigmoid_##isa##_##suffix, target, type, fast_activation_##isa##_##suffix##_sigmoid) \
+    FAST_UNARY_KERNEL(fast_gelu_##isa##_##suffix, target, type, fast_activation_##isa##_##suffix##_gelu) \
+    FAST_UNARY_KERNEL(fast_log_##isa##_##suffix, target, type, log_fn) \
+    FAST_POW(fast_pow_values_##isa##_##suffix, target, type, exp_fn, log_fn, sqrt_fn) \
+    target static void fast_pow_##isa##_##suffix(void* res, void* a, void* b, size_t size) { \
+        fast_pow_values_##isa##_##suffix(CAST_PTR(res, type), CAST_PTR(a, type), *CAST_PTR(b, type), size); \
+        return; \
+    }
+
+#define FAST_KERNEL_DISPATCH(name, suffix) \
+    static void fast_##name##_kernel_##suffix(void* res, void* a, void* b, size_t size) { \
+        if (get_simd_level() >= SIMD_AVX2) fast_##name##_avx2_##suffix(res, a, b, size); \
+        else fast_##name##_base_##suffix(res, a, b, size); \
+        return; \
+    }
+
+#define FAST_KERNEL_FAMILY(suffix, type, exp_fn, tanh_fn, log_fn, sqrt_fn) \
+    FAST_KERNEL_ISA(base, , suffix, type, exp_fn, tanh_fn, log_fn, sqrt_fn) \
+    FAST_KERNEL_ISA(avx2, FAST_TARGET_AVX2, suffix, type, exp_fn, tanh_fn, log_fn, sqrt_fn) \
+    FAST_KERNEL_DISPATCH(exp, suffix) \
+    FAST_KERNEL_DISPATCH(tanh, suffix) \
+    FAST_KERNEL_DISPATCH(log, suffix) \
+    FAST_KERNEL_DISPATCH(pow, suffix) \
+    FAST_KERNEL_DISPATCH(sigmoid, suffix) \
+    FAST_KERNEL_DISPATCH(gelu, suffix) \
+    NORMAL_KERNEL(fast_normal_kernel_##suffix, type, exp_fn, sqrt_fn)
+
+// Every row holds one kernel per compute type, the long double one only when FLOAT_128 is built
+#ifdef TENSOR_NO_FLOAT_128
+#define F128_KERNEL(kernel)
+#else
+#define F128_KERNEL(kernel) , kernel
+#endif
+
+#define KERNEL_ROW(name) { name##_kernel_f32, name##_kernel_f64 F128_KERNEL(name##_kernel_f128) }
+#define VECTOR_KERNEL_ROW(name) { name##_vector_kernel_f32, name##_vector_kernel_f64 F128_KERNEL(name##_kernel_f128) }
+#define FAST_KERNEL_ROW(name) { fast_##name##_kernel_f32, fast_##name##_kernel_f64 F128_KERNEL(name##_kernel_f128) }
+#define ACCUMULATE_KERNEL_ROW(name) { name##_accumulate_kernel_f32, name##_accumulate_kernel_f64 F128_KERNEL(name##_accumulate_kernel_f128) }
+
+KERNEL_FAMILY(f32, float, expf, tanhf, sqrtf, logf, powf)
+KERNEL_FAMILY(f64, double, exp, tanh, sqrt, log, pow)
+#ifndef TENSOR_NO_FLOAT_128
+KERNEL_FAMILY(f128, long double, expl, tanhl, sqrtl, logl, powl)
+#endif
+
+VECTOR_KERNEL_FAMILY(f32, float, FLOAT_32)
+VECTOR_KERNEL_FAMILY(f64, double, FLOAT_64)
+
+FAST_KERNEL_FAMILY(f32, float, fast_expf, fast_tanhf, fast_logf, sqrtf)
+FAST_KERNEL_FAMILY(f64, double, fast_exp, fast_tanh, fast_log, sqrt)
+
+void run_accumulate_kernel(OperatorFlag op_flag, unsigned int operand, DataType data_type, void* grad, void* x, void* y, void* dy, size_t size);
+bool has_accumulate_kernel(OperatorFlag op_flag, unsigned int operand, DataType data_type);
+void run_softmax_kernel(DataType data_type, bool is_log, void* res, void* x, size_t outer, size_t n, size_t inner);
+void run_softmax_grad_kernel(DataType data_type, bool is_log, void* grad, void* y, void* dy, size_t outer, size_t n, size_t inner);
+void run_reduce_kernel(DataType data_type, ReductionFlag flag, long double p, void* res, void* index, void* x, size_t outer, size_t n, size_t inner);
+// x and y are left unread by REDUCE_SUM and REDUCE_MEAN, whose p is the inverse of the count of the reduced elements
+void run_reduce_grad_kernel(DataType data_type, ReductionFlag flag, long double p, void* grad, void* x, void* y, void* dy, const size_t* shape, const size_t* out_strides, unsigned int rank);
+void run_dequantize_kernel(float* x, void* q, DataType q_type, const float* scales, const int* zero_points, size_t size, size_t channels, size_t inner);
+void run_quantize_kernel(void* q, float* x, const float* scales, const int* zero_points, size_t size, size_t channels, size_t inner);
+void run_convert_kernel(DataType dst_type, void* dst, DataType src_type, void* src, size_t size);
+void run_normal_kernel(DataType data_type, void* res, void* x, void* params, size_t size);
+void run_threshold_kernel(DataType data_type, void* res, void* x, void* params, size_t size);
+void run_random_kernel(DataType data_type, void* res, size_t size);
+bool run_compare_kernel(DataType data_type, ComparisonFlag flag, void* a, void* b, size_t size);
+void run_kernel(OperatorFlag op_flag, DataType data_type, void* res, void* a, void* b, size_t size);
+TensorKernel get_kernel(OperatorFlag op_flag, DataType data_type);
+bool has_kernel(OperatorFlag op_flag, DataType data_type);
+
+/* ------------------------------------------------------------------------------------------------ */
+
+// Operators without an element-wise form (DOT, NORM, SOFTMAX, LOG_SOFTMAX, REDUCE) are left NULL
+static const TensorKernel kernels_table[ARR_SIZE(operators_flags)][DATA_TYPES_COUNT] = {
+    [SUM] = VECTOR_KERNEL_ROW(sum),
+    [SUBTRACTION] = VECTOR_KERNEL_ROW(sub),
+    [MULTIPLICATION] = VECTOR_KERNEL_ROW(mul),
+    [DIVISION] = VECTOR_KERNEL_ROW(div),
+    [POW] = KERNEL_ROW(pow),
+    [EXP] = KERNEL_ROW(exp),
+    [TANH] = KERNEL_ROW(tanh),
+    [SQRT] = VECTOR_KERNEL_ROW(sqrt),
+    [LOG] = KERNEL_ROW(log),
+    [MAX] = VECTOR_KERNEL_ROW(max),
+    [MIN] = VECTOR_KERNEL_ROW(min),
+    [ABS] = VECTOR_KERNEL_ROW(abs),
+    [CONJUGATE] = VECTOR_KERNEL_ROW(conjugate),
+    [SIGMOID] = KERNEL_ROW(sigmoid),
+    [GELU] = KERNEL_ROW(gelu)
+};
+
+static const TensorKernel fast_kernels_table[ARR_SIZE(operators_flags)][DATA_TYPES_COUNT] = {
+    [POW] = FAST_KERNEL_ROW(pow),
+    [EXP] = FAST_KERNEL_ROW(exp),
+    [TANH] = FAST_KERNEL_ROW(tanh),
+    [LOG] = FAST_KERNEL_ROW(log),
+    [SIGMOID] = FAST_KERNEL_ROW(sigmoid),
+    [GELU] = FAST_KERNEL_ROW(gelu)
+};
+
+// Backward rules of the element-wise operators, indexed by the operand they derive: DOT accumulates through gemm, the
+// operators left NULL derive their contribution apart
+static const AccumulateKernel accumulate_kernels_table[ARR_SIZE(operators_flags)][2][DATA_TYPES_COUNT] = {
+    [SUM] = { ACCUMULATE_KERNEL_ROW(sum), ACCUMULATE_KERNEL_ROW(sum) },
+    [SUBTRACTION] = { ACCUMULATE_KERNEL_ROW(sum), ACCUMULATE_KERNEL_ROW(neg) },
+    [MULTIPLICATION] = { ACCUMULATE_KERNEL_ROW(mul), ACCUMULATE_KERNEL_ROW(mul) },
+    [DIVISION] = { ACCUMULATE_KERNEL_ROW(div), ACCUMULATE_KERNEL_ROW(denominator) },
+    [MAX] = { ACCUMULATE_KERNEL_ROW(extremum), ACCUMULATE_KERNEL_ROW(extremum) },
+    [MIN] = { ACCUMULATE_KERNEL_ROW(extremum), ACCUMULATE_KERNEL_ROW(extremum) },
+    [POW] = { ACCUMULATE_KERNEL_ROW(pow) },
+    [EXP] = { ACCUMULATE_KERNEL_ROW(mul) },
+    [TANH] = { ACCUMULATE_KERNEL_ROW(tanh) },
+    [SQRT] = { ACCUMULATE_KERNEL_ROW(pow) },
+    [LOG] = { ACCUMULATE_KERNEL_ROW(log) },
+    [ABS] = { ACCUMULATE_KERNEL_ROW(abs) },
+    [SIGMOID] = { ACCUMULATE_KERNEL_ROW(sigmoid) },
+    [GELU] = { ACCUMULATE_KERNEL_ROW(gelu) }
+};
+
+static const SoftmaxKernel softmax_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(softmax);
+static const SoftmaxKernel softmax_grad_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(softmax_grad);
+static const ReduceKernel reduce_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(reduce);
+static const ReduceGradKernel reduce_grad_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(reduce_grad);
+static const TensorKernel normal_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(normal);
+static const TensorKernel fast_normal_kernels_table[DATA_TYPES_COUNT] = FAST_KERNEL_ROW(normal);
+static const TensorKernel threshold_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(threshold);
+static const TensorKernel random_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(random);
+static const CompareKernel compare_kernels_table[DATA_TYPES_COUNT] = KERNEL_ROW(compare);
+
+TensorKernel get_kernel(OperatorFlag op_flag, DataType data_type) {
+    ASSERT(!is_valid_enum(op_flag, (unsigned char*) operators_flags, ARR_SIZE(operators_flags)), "INVALID_OPERATOR_FLAG");
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    TensorKernel kernel = IS_FAST_MATH() ? fast_kernels_table[op_flag][DATA_TYPE_INDEX(data_type)] : NULL;
+    if (kernel == NULL) kernel = kernels_table[op_flag][DATA_TYPE_INDEX(data_type)];
+    ASSERT(kernel == NULL, "MISSING_KERNEL");
+    return kernel;
+}
+
+bool has_kernel(OperatorFlag op_flag, DataType data_type) {
+    if (!is_valid_enum(op_flag, (unsigned char*) operators_flags, ARR_SIZE(operators_flags)) || !IS_COMPUTE_TYPE(data_type)) return FALSE;
+    return kernels_table[op_flag][DATA_TYPE_INDEX(data_type)] != NULL;
+}
+
+static void kernel_task(void* args, size_t start, size_t end) {
+    KernelTask* task = (KernelTask*) args;
+    void* b = task -> is_binary ? (void*) (task -> b + start * DATA_TYPE_SIZE(task -> data_type)) : (void*) task -> b;
+    task -> kernel(task -> res + start * DATA_TYPE_SIZE(task -> data_type), task -> a + start * DATA_TYPE_SIZE(task -> data_type), b, end - start);
+    return;
+}
+
+void run_kernel(OperatorFlag op_flag, DataType data_type, void* res, void* a, void* b, size_t size) {
+    KernelTask task = { .kernel = get_kernel(op_flag, data_type), .res = res, .a = a, .b = b, .data_type = data_type, .is_binary = IS_BINARY_KERNEL(op_flag) };
+    // Resolve the SIMD level before the workers read it
+    NOT_USED(get_simd_level());
+    parallel_for(size, KERNEL_GRAIN, kernel_task, &task);
+    return;
+}
+
+// params holds the variance, then the mean
+void run_normal_kernel(DataType data_type, void* res, void* x, void* params, size_t size) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    TensorKernel kernel = IS_FAST_MATH() ? fast_normal_kernels_table[DATA_TYPE_INDEX(data_type)] : normal_kernels_table[DATA_TYPE_INDEX(data_type)];
+    KernelTask task = { .kernel = kernel, .res = res, .a = x, .b = params, .data_type = data_type, .is_binary = FALSE };
+    parallel_for(size, KERNEL_GRAIN, kernel_task, &task);
+    return;
+}
+
+// params holds the threshold, then the values written at or above it and below it
+void run_threshold_kernel(DataType data_type, void* res, void* x, void* params, size_t size) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    KernelTask task = { .kernel = threshold_kernels_table[DATA_TYPE_INDEX(data_type)], .res = res, .a = x, .b = params, .data_type = data_type, .is_binary = FALSE };
+    parallel_for(size, KERNEL_GRAIN, kernel_task, &task);
+    return;
+}
+
+void run_random_kernel(DataType data_type, void* res, size_t size) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    random_kernels_table[DATA_TYPE_INDEX(data_type)](res, NULL, NULL, size);
+    return;
+}
+
+// Stops at the first mismatch, so the elements are walked by the calling thread alone
+bool run_compare_kernel(DataType data_type, ComparisonFlag flag, void* a, void* b, size_t size) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    ASSERT(!is_valid_enum(flag, (unsigned char*) comparison_flags, ARR_SIZE(comparison_flags)), "INVALID_COMPARISON_FLAG");
+    return compare_kernels_table[DATA_TYPE_INDEX(data_type)](a, b, size, flag);
+}
+
+bool has_accumulate_kernel(OperatorFlag op_flag, unsigned int operand, DataType data_type) {
+    if (!is_valid_enum(op_flag, (unsigned char*) operators_flags, ARR_SIZE(operators_flags)) || !IS_COMPUTE_TYPE(data_type) || (operand > 1)) return FALSE;
+    return accumulate_kernels_table[op_flag][operand][DATA_TYPE_INDEX(data_type)] != NULL;
+}
+
+static void accumulate_task(void* args, size_t start, size_t end) {
+    AccumulateTask* task = (AccumulateTask*) args;
+    const size_t offset = start * DATA_TYPE_SIZE(task -> data_type);
+    void* y = task -> is_binary ? (void*) (task -> y + offset) : (void*) task -> y;
+    task -> kernel(task -> grad + offset, task -> x + offset, y, task -> dy + offset, end - start);
+    return;
+}
+
+void run_accumulate_kernel(OperatorFlag op_flag, unsigned int operand, DataType data_type, void* grad, void* x, void* y, void* dy, size_t size) {
+    ASSERT(!has_accumulate_kernel(op_flag, operand, data_type), "MISSING_KERNEL");
+    AccumulateTask task = { .kernel = accumulate_kernels_table[op_flag][operand][DATA_TYPE_INDEX(data_type)], .grad = grad, .x = x, .y = y, .dy = dy, .data_type = data_type, .is_binary = IS_BINARY_ACCUMULATE(op_flag, operand) };
+    parallel_for(size, KERNEL_GRAIN, accumulate_task, &task);
+    return;
+}
+
+static void softmax_task(void* args, size_t start, size_t end) {
+    SoftmaxTask* task = (SoftmaxTask*) args;
+    for (size_t row = start; row < end; ++row) {
+        const size_t offset = ((row / task -> inner) * task -> n * task -> inner + row % task -> inner) * DATA_TYPE_SIZE(task -> data_type);
+        task -> kernel(task -> res + offset, task -> x + offset, (task -> dy != NULL) ? (void*) (task -> dy + offset) : NULL, task -> n, task -> inner, task -> is_log);
+    }
+    return;
+}
+
+void run_softmax_kernel(DataType data_type, bool is_log, void* res, void* x, size_t outer, size_t n, size_t inner) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    SoftmaxTask task = { .kernel = softmax_kernels_table[DATA_TYPE_INDEX(data_type)], .res = res, .x = x, .dy = NULL, .n = n, .inner = inner, .data_type = data_type, .is_log = is_log };
+    parallel_for(outer * inner, MAX(KERNEL_GRAIN / MAX(n, 1), 1), softmax_task, &task);
+    return;
+}
+
+void run_softmax_grad_kernel(DataType data_type, bool is_log, void* grad, void* y, void* dy, size_t outer, size_t n, size_t inner) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    SoftmaxTask task = { .kernel = softmax_grad_kernels_table[DATA_TYPE_INDEX(data_type)], .res = grad, .x = y, .dy = dy, .n = n, .inner = inner, .data_type = data_type, .is_log = is_log };
+    parallel_for(outer * inner, MAX(KERNEL_GRAIN / MAX(n, 1), 1), softmax_task, &task);
+    return;
+}
+
+static void reduce_task(void* args, size_t start, size_t end) {
+    ReduceTask* task = (ReduceTask*) args;
+    const size_t outputs = task -> outer * task -> inner;
+    for (size_t item = start; item < end; ++item) {
+        const size_t tile = item % task -> tiles;
+        const size_t o = (item / task -> tiles) % task -> outer;
+        const size_t chunk = item / task -> tiles / task -> outer;
+        const size_t k0 = chunk * task -> chunk_size;
+        const size_t i0 = tile * REDUCE_TILE;
+        const size_t out = chunk * outputs + o * task -> inner + i0;
+        const size_t in = (o * task -> n + k0) * task -> inner + i0;
+        unsigned char* index = (task -> index != NULL) ? task -> index + out * DATA_TYPE_SIZE(task -> data_type) : NULL;
+        const size_t count = MIN(task -> inner - i0, REDUCE_TILE);
+        task -> kernel(task -> res + out * DATA_TYPE_SIZE(task -> data_type), index, task -> x + in * DATA_TYPE_SIZE(task -> data_type), MIN(task -> n - k0, task -> chunk_size), task -> inner, count, task -> flag, task -> p);
+        // The indices found by a chunk are relative to its first element
+        for (size_t i = 0; (index != NULL) && k0 && (i < count); ++i) ASSIGN(CAST_PTR_AT_INDEX(index, i, task -> data_type), read_data_type(CAST_PTR_AT_INDEX(index, i, task -> data_type), task -> data_type) + k0, task -> data_type);
+    }
+    return;
+}
+
+// Rows too long for the outputs to keep every thread busy are split into chunks, whose partial results are then
+// reduced together: the sums and the norms add up, the extrema and the log-sum-exps combine with themselves
+void run_reduce_kernel(DataType data_type, ReductionFlag flag, long double p, void* res, void* index, void* x, size_t outer, size_t n, size_t inner) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    ASSERT(!is_valid_enum(flag, (unsigned char*) reduction_flags, ARR_SIZE(reduction_flags)), "INVALID_REDUCTION_FLAG");
+    const size_t tiles = (inner + REDUCE_TILE - 1) / REDUCE_TILE;
+    const size_t outputs = outer * inner;
+    const unsigned int threads = get_num_threads();
+    size_t chunks = 1;
+    if ((outer * tiles < threads) && (n >= 2 * REDUCE_MIN_CHUNK)) chunks = MIN(threads, n / REDUCE_MIN_CHUNK);
+    const size_t chunk_size = (n + chunks - 1) / chunks;
+    chunks = (n + chunk_size - 1) / chunk_size;
+
+    ReduceKernel kernel = reduce_kernels_table[DATA_TYPE_INDEX(data_type)];
+    void* partial = (chunks > 1) ? alloc_memory_uninit(chunks * outputs, DATA_TYPE_SIZE(data_type)) : res;
+    void* partial_index = ((chunks > 1) && (flag == REDUCE_ARGMAX)) ? alloc_memory_uninit(chunks * outputs, DATA_TYPE_SIZE(data_type)) : index;
+    ReduceTask task = { .kernel = kernel, .res = partial, .index = partial_index, .x = x, .outer = outer, .n = n, .inner = inner, .tiles = tiles, .chunk_size = chunk_size, .data_type = data_type, .flag = flag, .p = p };
+    const size_t item_size = MIN(chunk_size, n) * MIN(inner, REDUCE_TILE);
+    parallel_for(chunks * outer * tiles, MAX(KERNEL_GRAIN / MAX(item_size, 1), 1), reduce_task, &task);
+    if (chunks == 1) return;
+
+    const ReductionFlag combine_flag = ((flag == REDUCE_MEAN) || (flag == REDUCE_NORM)) ? REDUCE_SUM : flag;
+    void* chunk_index = (flag == REDUCE_ARGMAX) ? alloc_memory_uninit(outputs, DATA_TYPE_SIZE(data_type)) : NULL;
+    kernel(res, chunk_index, partial, chunks, outputs, outputs, combine_flag, p);
+    for (size_t i = 0; (chunk_index != NULL) && (i < outputs); ++i) {
+        const size_t chunk = (size_t) read_data_type(CAST_PTR_AT_INDEX(chunk_index, i, data_type), data_type);
+        mem_copy(CAST_PTR_AT_INDEX(index, i, data_type), CAST_PTR_AT_INDEX(partial_index, chunk * outputs + i, data_type), DATA_TYPE_SIZE(data_type), 1);
+    }
+    DEALLOCATE_MEMORY(partial, chunk_index, (flag == REDUCE_ARGMAX) ? partial_index : NULL);
+
+    return;
+}
+
+static void reduce_grad_task(void* args, size_t start, size_t end) {
+    ReduceGradTask* task = (ReduceGradTask*) args;
+    task -> kernel(task -> grad, task -> x, task -> y, task -> dy, task -> shape, task -> out_strides, task -> rank, start, end, task -> flag, task -> p);
+    return;
+}
+
+void run_reduce_grad_kernel(DataType data_type, ReductionFlag flag, long double p, void* grad, void* x, void* y, void* dy, const size_t* shape, const size_t* out_strides, unsigned int rank) {
+    ASSERT(!IS_COMPUTE_TYPE(data_type), "INVALID_DATA_TYPE");
+    ASSERT(rank > REDUCE_MAX_RANK, "INVALID_RANK");
+    ReduceGradTask task = { .kernel = reduce_grad_kernels_table[DATA_TYPE_INDEX(data_type)], .grad = grad, .x = x, .y = y, .dy = dy, .shape = shape, .out_strides = out_strides, .rank = rank, .flag = flag, .p = p };
+    size_t size = 1;
+    for (unsigned int i = 0; i < rank; ++i) size *= shape[i];
+    parallel_for(size, KERNEL_GRAIN, reduce_grad_task, &task);
+    return;
+}
+
+// The storage types widen to their compute type, and narrow back from it, through loops of their own: any other pair
+// of data types goes through long double
+static void convert_task(void* args, size_t start, size_t end) {
+    ConvertTask* task = (ConvertTask*) args;
+    void* dst = CAST_PTR_AT_INDEX(task -> dst, start, task -> dst_type);
+    void* src = CAST_PTR_AT_INDEX(task -> src, start, task -> src_type);
+    const size_t size = end - start;
+    if ((task -> dst_type == FLOAT_32) && (task -> src_type == FLOAT_16)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, float)[i] = half_to_float(CAST_PTR(src, unsigned short)[i]);
+    else if ((task -> dst_type == FLOAT_16) && (task -> src_type == FLOAT_32)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, unsigned short)[i] = float_to_half(CAST_PTR(src, float)[i]);
+    else if ((task -> dst_type == FLOAT_32) && (task -> src_type == BFLOAT_16)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, float)[i] = bfloat_to_float(CAST_PTR(src, unsigned short)[i]);
+    else if ((task -> dst_type == BFLOAT_16) && (task -> src_type == FLOAT_32)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, unsigned short)[i] = float_to_bfloat(CAST_PTR(src, float)[i]);
+    else if ((task -> dst_type == FLOAT_32) && (task -> src_type == INT_8)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, float)[i] = CAST_PTR(src, signed char)[i];
+    else if ((task -> dst_type == INT_8) && (task -> src_type == FLOAT_32)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, signed char)[i] = saturate_int8(CAST_PTR(src, float)[i]);
+    else if ((task -> dst_type == FLOAT_64) && (task -> src_type == INT_32)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, double)[i] = CAST_PTR(src, int)[i];
+    else if ((task -> dst_type == INT_32) && (task -> src_type == FLOAT_64)) for (size_t i = 0; i < size; ++i) CAST_PTR(dst, int)[i] = saturate_int32(CAST_PTR(src, double)[i]);
+    else for (size_t i = 0; i < size; ++i) assign_data_type(CAST_PTR_AT_INDEX(dst, i, task -> dst_type), read_data_type(CAST_PTR_AT_INDEX(src, i, task -> src_type), task -> src_type), task -> dst_type);
+    return;
+}
+
+void run_convert_kernel(DataType dst_type, void* dst, DataType src_type, void* src, size_t size) {
+    ASSERT(!is_valid_enum(dst_type, (unsigned char*) data_types, ARR_SIZE(data_types)) || !is_valid_enum(src_type, (unsigned char*) data_types, ARR_SIZE(data_types)), "INVALID_DATA_TYPE");
+    ConvertTask task = { .dst = dst, .src = src, .dst_type = dst_type, .src_type = src_type };
+    parallel_for(size, KERNEL_GRAIN, convert_task, &task);
+    return;
+}
+
+static void quantize_task(void* args, size_t start, size_t end) {
+    QuantizeTask* task = (QuantizeTask*) args;
+    for (size_t i = start; i < end; ++i) {
+        const size_t channel = (i / task -> inner) % task -> channels;
+        if (!task -> is_dequantize) CAST_PTR(task -> q, signed char)[i] = saturate_int8(task -> x[i] / task -> scales[channel] + task -> zero_points[channel]);
+        else if (task -> q_type == INT_8) task -> x[i] = task -> scales[channel] * (CAST_PTR(task -> q, signed char)[i] - task -> zero_points[channel]);
+        else task -> x[i] = task -> scales[channel] * (float) ((long long) CAST_PTR(task -> q, int)[i] - task -> zero_points[channel]);
+    }
+    return;
+}
+
+void run_quantize_kernel(void* q, float* x, const float* scales, const int* zero_points, size_t size, size_t channels, size_t inner) {
+    QuantizeTask task = { .x = x, .q = q, .q_type = INT_8, .scales = scales, .zero_points = zero_points, .channels = channels, .inner = MAX(inner, 1), .is_dequantize = FALSE };
+    parallel_for(size, KERNEL_GRAIN, quantize_task, &task);
+    return;
+}
+
+// q holds INT_8 values, or the INT_32 results of an integer gemm
+void run_dequantize_kernel(float* x, void* q, DataType q_type, const float* scales, const int* zero_points, size_t size, size_t channels, size_t inner) {
+    ASSERT((q_type != INT_8) && (q_type != INT_32), "INVALID_DATA_TYPE");
+    QuantizeTask task = { .x = x, .q = q, .q_type = q_type, .scales = scales, .zero_points = zero_points, .channels = channels, .inner = MAX(inner, 1), .is_dequantize = TRUE };
+    parallel_for(size, KERNEL_GRAIN, quantize_task, &task);
+    return;
+}
+
+#endif //_KERNELS_H_
@@ -0,0 +1,314 @@
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "types.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_X86 0
+#endif
+
+#define SIMD_FILL_BLOCK 64
+// Bytes past which copies and fills go through non-temporal stores, as a buffer this large would only evict the
+// working set from the cache on its way through it
+#define SIMD_STREAM_THRESHOLD (8 * 1024 * 1024)
+
+typedef enum SimdLevel { SIMD_SCALAR, SIMD_SSE, SIMD_AVX2, SIMD_AVX512 } SimdLevel;
+
+// Vectorized bulk of an element-wise operator: processes a prefix of size elements and returns its length,
+// the remaining tail is left to the scalar kernel so that every ISA yields bit-identical results
+typedef size_t (*SimdKernel)(void* res, void* a, void* b, size_t size);
+
+SimdKernel get_simd_kernel(OperatorFlag op_flag, DataType data_type);
+void simd_fill(void* dest, void* src, size_t size, size_t n);
+void simd_copy(void* dest, void* src, size_t bytes);
+void set_simd_level(SimdLevel level);
+SimdLevel detect_simd_level(void);
+SimdLevel get_simd_level(void);
+
+/* ------------------------------------------------------------------------------------------------ */
+
+static SimdLevel current_simd_level = SIMD_SCALAR;
+static bool is_simd_level_set = FALSE;
+
+SimdLevel detect_simd_level(void) {
+#if SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return SIMD_AVX512;
+    else if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    else if (__builtin_cpu_supports("sse2")) return SIMD_SSE;
+#endif
+    return SIMD_SCALAR;
+}
+
+SimdLevel get_simd_level(void) {
+    if (!is_simd_level_set) set_simd_level(detect_simd_level());
+    return current_simd_level;
+}
+
+void set_simd_level(SimdLevel level) {
+    SimdLevel max_level = detect_simd_level();
+    current_simd_level = level > max_level ? max_level : level;
+    is_simd_level_set = TRUE;
+    return;
+}
+
+#if SIMD_X86
+
+#define SIMD_TARGET_SSE __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f")))
+
+// MAX and MIN follow the scalar (a >= b ? a : b) selection, so NaNs and signed zeros resolve as in the scalar kernels.
+// ABS follows ABS_T: positive values are kept, zeros become +0 and everything else (NaNs included) gets its sign flipped.
+#define SIMD_SSE_HELPERS(suffix, vec, ps) \
+    SIMD_TARGET_SSE static inline vec sse_select_##suffix(vec mask, vec a, vec b) { return _mm_or_##ps(_mm_and_##ps(mask, a), _mm_andnot_##ps(mask, b)); } \
+    SIMD_TARGET_SSE static inline vec sse_max_##suffix(vec a, vec b) { return sse_select_##suffix(_mm_cmpge_##ps(a, b), a, b); } \
+    SIMD_TARGET_SSE static inline vec sse_min_##suffix(vec a, vec b) { return sse_select_##suffix(_mm_cmple_##ps(a, b), a, b); } \
+    SIMD_TARGET_SSE static inline vec sse_neg_##suffix(vec a) { return _mm_xor_##ps(a, _mm_set1_##ps(-0.0)); } \
+    SIMD_TARGET_SSE static inline vec sse_abs_##suffix(vec a) { \
+        vec zero = _mm_setzero_##ps(); \
+        vec res = sse_select_##suffix(_mm_cmpgt_##ps(a, zero), a, sse_neg_##suffix(a)); \
+        return _mm_andnot_##ps(_mm_cmpeq_##ps(a, zero), res); \
+    }
+
+#define SIMD_AVX2_HELPERS(suffix, vec, ps) \
+    SIMD_TARGET_AVX2 static inline vec avx2_max_##suffix(vec a, vec b) { return _mm256_blendv_##ps(b, a, _mm256_cmp_##ps(a, b, _CMP_GE_OQ)); } \
+    SIMD_TARGET_AVX2 static inline vec avx2_min_##suffix(vec a, vec b) { return _mm256_blendv_##ps(b, a, _mm256_cmp_##ps(a, b, _CMP_LE_OQ)); } \
+    SIMD_TARGET_AVX2 static inline vec avx2_neg_##suffix(vec a) { return _mm256_xor_##ps(a, _mm256_set1_##ps(-0.0)); } \
+    SIMD_TARGET_AVX2 static inline vec avx2_abs_##suffix(vec a) { \
+        vec zero = _mm256_setzero_##ps(); \
+        vec res = _mm256_blendv_##ps(avx2_neg_##suffix(a), a, _mm256_cmp_##ps(a, zero, _CMP_GT_OQ)); \
+        return _mm256_andnot_##ps(_mm256_cmp_##ps(a, zero, _CMP_EQ_OQ), res); \
+    }
+
+#define SIMD_AVX512_HELPERS(suffix, vec, ps) \
+    SIMD_TARGET_AVX512 static inline vec avx512_max_##suffix(vec a, vec b) { return _mm512_mask_blend_##ps(_mm512_cmp_##ps##_mask(a, b, _CMP_GE_OQ), b, a); } \
+    SIMD_TARGET_AVX512 static inline vec avx512_min_##suffix(vec a, vec b) { return _mm512_mask_blend_##ps(_mm512_cmp_##ps##_mask(a, b, _CMP_LE_OQ), b, a); } \
+    SIMD_TARGET_AVX512 static inline vec avx512_neg_##suffix(vec a) { return _mm512_castsi512_##ps(_mm512_xor_si512(_mm512_cast##ps##_si512(a), _mm512_cast##ps##_si512(_mm512_set1_##ps(-0.0)))); } \
+    SIMD_TARGET_AVX512 static inline vec avx512_abs_##suffix(vec a) { \
+        vec zero = _mm512_setzero_##ps(); \
+        vec res = _mm512_mask_blend_##ps(_mm512_cmp_##ps##_mask(a, zero, _CMP_GT_OQ), avx512_neg_##suffix(a), a); \
+        return _mm512_mask_blend_##ps(_mm512_cmp_##ps##_mask(a, zero, _CMP_EQ_OQ), res, zero); \
+    }
+
+#define SIMD_BINARY_KERNEL(name, target, type, width, load, store, op) \
+    target static size_t name(void* res, void* a, void* b, size_t size) { \
+        const size_t bulk = size - (size % width); \
+        for (size_t i = 0; i < bulk; i += width) store((type*) res + i, op(load((type*) a + i), load((type*) b + i))); \
+        return bulk; \
+    }
+
+#define SIMD_UNARY_KERNEL(name, target, type, width, load, store, op) \
+    target static size_t name(void* res, void* a, void* b, size_t size) { \
+        (void) b; \
+        const size_t bulk = size - (size % width); \
+        for (size_t i = 0; i < bulk; i += width) store((type*) res + i, op(load((type*) a + i))); \
+        return bulk; \
+    }
+
+#define SIMD_KERNEL_FAMILY(isa, prefix, suffix, type, width, load, store, add, sub, mul, div, sqrt_op) \
+    SIMD_BINARY_KERNEL(simd_sum_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, add) \
+    SIMD_BINARY_KERNEL(simd_sub_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, sub) \
+    SIMD_BINARY_KERNEL(simd_mul_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, mul) \
+    SIMD_BINARY_KERNEL(simd_div_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, div) \
+    SIMD_BINARY_KERNEL(simd_max_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, prefix##_max_##suffix) \
+    SIMD_BINARY_KERNEL(simd_min_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, prefix##_min_##suffix) \
+    SIMD_UNARY_KERNEL(simd_abs_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, prefix##_abs_##suffix) \
+    SIMD_UNARY_KERNEL(simd_neg_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, prefix##_neg_##suffix) \
+    SIMD_UNARY_KERNEL(simd_sqrt_##isa##_##suffix, SIMD_TARGET_##isa, type, width, load, store, sqrt_op)
+
+SIMD_SSE_HELPERS(f32, __m128, ps)
+SIMD_SSE_HELPERS(f64, __m128d, pd)
+SIMD_AVX2_HELPERS(f32, __m256, ps)
+SIMD_AVX2_HELPERS(f64, __m256d, pd)
+SIMD_AVX512_HELPERS(f32, __m512, ps)
+SIMD_AVX512_HELPERS(f64, __m512d, pd)
+
+SIMD_KERNEL_FAMILY(SSE, sse, f32, float, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_add_ps, _mm_sub_ps, _mm_mul_ps, _mm_div_ps, _mm_sqrt_ps)
+SIMD_KERNEL_FAMILY(SSE, sse, f64, double, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd, _mm_sqrt_pd)
+SIMD_KERNEL_FAMILY(AVX2, avx2, f32, float, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_add_ps, _mm256_sub_ps, _mm256_mul_ps, _mm256_div_ps, _mm256_sqrt_ps)
+SIMD_KERNEL_FAMILY(AVX2, avx2, f64, double, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd, _mm256_sqrt_pd)
+SIMD_KERNEL_FAMILY(AVX512, avx512, f32, float, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_add_ps, _mm512_sub_ps, _mm512_mul_ps, _mm512_div_ps, _mm512_sqrt_ps)
+SIMD_KERNEL_FAMILY(AVX512, avx512, f64, double, 8, _mm512_loadu_pd, _mm512_storeu_pd, _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd, _mm512_sqrt_pd)
+
+#define SIMD_KERNEL_ROW(name, isa) { simd_##name##_##isa##_f32, simd_##name##_##isa##_f64 }
+#define SIMD_KERNEL_LEVEL(isa) { \
+        [SUM] = SIMD_KERNEL_ROW(sum, isa), \
+        [SUBTRACTION] = SIMD_KERNEL_ROW(sub, isa), \
+        [MULTIPLICATION] = SIMD_KERNEL_ROW(mul, isa), \
+        [DIVISION] = SIMD_KERNEL_ROW(div, isa), \
+        [MAX] = SIMD_KERNEL_ROW(max, isa), \
+        [MIN] = SIMD_KERNEL_ROW(min, isa), \
+        [ABS] = SIMD_KERNEL_ROW(abs, isa), \
+        [CONJUGATE] = SIMD_KERNEL_ROW(neg, isa), \
+        [SQRT] = SIMD_KERNEL_ROW(sqrt, isa) \
+    }
+
+// Indexed by [SimdLevel - SIMD_SSE][OperatorFlag][FLOAT_32, FLOAT_64]
+static const SimdKernel simd_kernels_table[3][sizeof(operators_flags)][2] = {
+    SIMD_KERNEL_LEVEL(SSE),
+    SIMD_KERNEL_LEVEL(AVX2),
+    SIMD_KERNEL_LEVEL(AVX512)
+};
+
+// The streaming stores need dest aligned on the block, the pattern and the source are read unaligned
+SIMD_TARGET_SSE static void simd_fill_sse(unsigned char* dest, unsigned char* pattern, size_t blocks, bool is_streaming) {
+    __m128i v[4];
+    for (unsigned int i = 0; i < 4; ++i) v[i] = _mm_loadu_si128((__m128i*) (pattern + 16 * i));
+    if (is_streaming) {
+        for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK) {
+            for (unsigned int i = 0; i < 4; ++i) _mm_stream_si128((__m128i*) (dest + 16 * i), v[i]);
+        }
+        _mm_sfence();
+        return;
+    }
+    for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK) {
+        for (unsigned int i = 0; i < 4; ++i) _mm_storeu_si128((__m128i*) (dest + 16 * i), v[i]);
+    }
+    return;
+}
+
+SIMD_TARGET_AVX2 static void simd_fill_avx2(unsigned char* dest, unsigned char* pattern, size_t blocks, bool is_streaming) {
+    __m256i lo = _mm256_loadu_si256((__m256i*) pattern);
+    __m256i hi = _mm256_loadu_si256((__m256i*) (pattern + 32));
+    if (is_streaming) {
+        for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK) {
+            _mm256_stream_si256((__m256i*) dest, lo);
+            _mm256_stream_si256((__m256i*) (dest + 32), hi);
+        }
+        _mm_sfence();
+        return;
+    }
+    for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK) {
+        _mm256_storeu_si256((__m256i*) dest, lo);
+        _mm256_storeu_si256((__m256i*) (dest + 32), hi);
+    }
+    return;
+}
+
+SIMD_TARGET_AVX512 static void simd_fill_avx512(unsigned char* dest, unsigned char* pattern, size_t blocks, bool is_streaming) {
+    __m512i v = _mm512_loadu_si512((void*) pattern);
+    if (is_streaming) {
+        for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK) _mm512_stream_si512((void*) dest, v);
+        _mm_sfence();
+        return;
+    }
+    for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK) _mm512_storeu_si512((void*) dest, v);
+    return;
+}
+
+SIMD_TARGET_SSE static void simd_stream_sse(unsigned char* dest, unsigned char* src, size_t blocks) {
+    for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK, src += SIMD_FILL_BLOCK) {
+        for (unsigned int i = 0; i < 4; ++i) _mm_stream_si128((__m128i*) (dest + 16 * i), _mm_loadu_si128((__m128i*) (src + 16 * i)));
+    }
+    _mm_sfence();
+    return;
+}
+
+SIMD_TARGET_AVX2 static void simd_stream_avx2(unsigned char* dest, unsigned char* src, size_t blocks) {
+    for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK, src += SIMD_FILL_BLOCK) {
+        _mm256_stream_si256((__m256i*) dest, _mm256_loadu_si256((__m256i*) src));
+        _mm256_stream_si256((__m256i*) (dest + 32), _mm256_loadu_si256((__m256i*) (src + 32)));
+    }
+    _mm_sfence();
+    return;
+}
+
+SIMD_TARGET_AVX512 static void simd_stream_avx512(unsigned char* dest, unsigned char* src, size_t blocks) {
+    for (size_t j = 0; j < blocks; ++j, dest += SIMD_FILL_BLOCK, src += SIMD_FILL_BLOCK) _mm512_stream_si512((void*) dest, _mm512_loadu_si512((void*) src));
+    _mm_sfence();
+    return;
+}
+
+#endif //SIMD_X86
+
+SimdKernel get_simd_kernel(OperatorFlag op_flag, DataType data_type) {
+#if SIMD_X86
+    SimdLevel level = get_simd_level();
+    if (level == SIMD_SCALAR || op_flag < 0 || (data_type != FLOAT_32 && data_type != FLOAT_64)) return NULL;
+    return simd_kernels_table[level - SIMD_SSE][op_flag][data_type == FLOAT_64];
+#else
+    (void) op_flag;
+    (void) data_type;
+    return NULL;
+#endif
+}
+
+// Bytes from dest up to the next block boundary
+static size_t simd_block_head(unsigned char* dest) {
+    return (SIMD_FILL_BLOCK - (uintptr_t) dest % SIMD_FILL_BLOCK) % SIMD_FILL_BLOCK;
+}
+
+void simd_fill(void* dest, void* src, size_t size, size_t n) {
+    unsigned char* dest_ptr = (unsigned char*) dest;
+    unsigned char* src_ptr = (unsigned char*) src;
+    const size_t bytes = size * n;
+    if (!bytes) return;
+
+    // Values made of a single repeated byte, zero above all, are left to memset
+    bool is_byte_value = TRUE;
+    for (size_t i = 1; i < size; ++i) is_byte_value &= (src_ptr[i] == src_ptr[0]);
+    if (is_byte_value) {
+        memset(dest_ptr, src_ptr[0], bytes);
+        return;
+    }
+
+    if (!(SIMD_FILL_BLOCK % size) && bytes >= SIMD_FILL_BLOCK) {
+        // Elements never straddle a block, so a single 64-byte pattern tiles the whole buffer
+        unsigned char pattern[SIMD_FILL_BLOCK];
+        for (unsigned int i = 0; i < SIMD_FILL_BLOCK; i += size) memcpy(pattern + i, src_ptr, size);
+        // Streaming starts at the first block boundary, which a whole number of elements must lead to
+        const size_t head = simd_block_head(dest_ptr);
+        const bool is_streaming = (bytes >= SIMD_STREAM_THRESHOLD) && !(head % size);
+        const size_t start = is_streaming ? head : 0;
+        const size_t blocks = (bytes - start) / SIMD_FILL_BLOCK;
+        memcpy(dest_ptr, pattern, start);
+        SimdLevel level = get_simd_level();
+#if SIMD_X86
+        if (level == SIMD_AVX512) simd_fill_avx512(dest_ptr + start, pattern, blocks, is_streaming);
+        else if (level == SIMD_AVX2) simd_fill_avx2(dest_ptr + start, pattern, blocks, is_streaming);
+        else if (level == SIMD_SSE) simd_fill_sse(dest_ptr + start, pattern, blocks, is_streaming);
+        else for (size_t j = 0; j < blocks; ++j) memcpy(dest_ptr + start + j * SIMD_FILL_BLOCK, pattern, SIMD_FILL_BLOCK);
+#else
+        (void) level;
+        for (size_t j = 0; j < blocks; ++j) memcpy(dest_ptr + start + j * SIMD_FILL_BLOCK, pattern, SIMD_FILL_BLOCK);
+#endif
+        memcpy(dest_ptr + start + blocks * SIMD_FILL_BLOCK, pattern, (bytes - start) % SIMD_FILL_BLOCK);
+        return;
+    }
+
+    // Any other element size doubles the filled prefix at every copy
+    memcpy(dest_ptr, src_ptr, size);
+    for (size_t filled = size; filled < bytes; filled *= 2) memcpy(dest_ptr + filled, dest_ptr, (filled < bytes - filled) ? filled : bytes - filled);
+    return;
+}
+
+// Copies below SIMD_STREAM_THRESHOLD, and the overlapping ones, are left to memmove
+void simd_copy(void* dest, void* src, size_t bytes) {
+    unsigned char* dest_ptr = (unsigned char*) dest;
+    unsigned char* src_ptr = (unsigned char*) src;
+#if SIMD_X86
+    SimdLevel level = get_simd_level();
+    const bool is_overlapping = (dest_ptr < src_ptr + bytes) && (src_ptr < dest_ptr + bytes);
+    if ((bytes >= SIMD_STREAM_THRESHOLD) && (level != SIMD_SCALAR) && !is_overlapping) {
+        const size_t head = simd_block_head(dest_ptr);
+        const size_t blocks = (bytes - head) / SIMD_FILL_BLOCK;
+        const size_t copied = head + blocks * SIMD_FILL_BLOCK;
+        memcpy(dest_ptr, src_ptr, head);
+        if (level == SIMD_AVX512) simd_stream_avx512(dest_ptr + head, src_ptr + head, blocks);
+        else if (level == SIMD_AVX2) simd_stream_avx2(dest_ptr + head, src_ptr + head, blocks);
+        else simd_stream_sse(dest_ptr + head, src_ptr + head, blocks);
+        memcpy(dest_ptr + copied, src_ptr + copied, bytes - copied);
+        return;
+    }
+#endif
+    memmove(dest_ptr, src_ptr, bytes);
+    return;
+}
+
+#endif //_SIMD_H_
@@ -1,28 +1,62 @@
 #ifndef _TENSOR_H_
 #define _TENSOR_H_
 
+#include "./thread_pool.h"
+#include "./allocator.h"
+#include "./kernels.h"
+#include "./gemm.h"
 #include "./utils.h"
 #include "types.h"
 
 #define EMPTY_TENSORS(data_type, ...) empty_tensors((sizeof((Tensor*[]){__VA_ARGS__}) / sizeof(Tensor*)), data_type, __VA_ARGS__)
 #define DEALLOCATE_TENSORS(...) deallocate_tensors(sizeof((Tensor[]){__VA_ARGS__}) / sizeof(Tensor), __VA_ARGS__)
 #define RESHAPE_TENSOR(dest, tensor) reshape_tensor(dest, (tensor).shape, (tensor).rank, (tensor).data_type)
+#define GATHER_ROW(dest, src, stride, n, size) for (size_t i = 0; i < (n); ++i) memcpy(CAST_PTR(dest, unsigned char) + (size) * i, CAST_PTR(src, unsigned char) + (size) * i * (stride), size)
 #define DEALLOCATE_TEMP_TENSORS() alloc_temp_tensor(NULL, 0, FLOAT_32, TRUE)
+#define PUSH_TEMP_SCOPE() push_temp_scope()
+#define POP_TEMP_SCOPE() pop_temp_scope()
 #define PRINT_TENSOR(tensor, prefix) print_tensor(tensor, prefix, #tensor)
 #define PRINT_SHAPE(tensor) print_shape((tensor).shape, (tensor).rank)
 #define TENSOR_SIZE(tensor) tensor_size((tensor).shape, (tensor).rank)
+#define TENSOR_STORAGE(tensor) ((tensor).storage != NULL ? (tensor).storage : (tensor).data)
+
+// Elements per parallel chunk for the loops running one scalar_op per element
+#define TENSOR_GRAIN 4096
+
+#define TEMP_SCOPES_MAX 64
+#define TEMP_BUCKETS_COUNT 64
+#define TEMP_CACHE_MAX_BYTES (64 * 1024 * 1024)
+
+// Elements gathered at once from a strided row, before handing them to a kernel
+#define STRIDED_TILE 256
 
 // TENSOR FUNCTIONS OPERATIONS
 #define NORM_TENSOR(c, a, norm) op_tensor(c, a, (Tensor) {.data = norm, .data_type = (a).data_type}, NORM)
 #define POW_TENSOR(c, a, exp) op_tensor(c, a, (Tensor) {.data = exp, .data_type = (a).data_type}, POW)
 #define CONJUGATE_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, CONJUGATE)
 #define SOFTMAX_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, SOFTMAX)
+#define SOFTMAX_AXIS_TENSOR(c, a, axis) op_tensor(c, a, (Tensor) {.data = &(unsigned int) {axis}, .data_type = (a).data_type}, SOFTMAX)
+#define LOG_SOFTMAX_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, LOG_SOFTMAX)
+#define LOG_SOFTMAX_AXIS_TENSOR(c, a, axis) op_tensor(c, a, (Tensor) {.data = &(unsigned int) {axis}, .data_type = (a).data_type}, LOG_SOFTMAX)
 #define TANH_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, TANH)
+#define SIGMOID_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, SIGMOID)
+#define GELU_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, GELU)
 #define SQRT_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, SQRT)
 #define EXP_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, EXP)
 #define LOG_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, LOG)
 #define ABS_TENSOR(c, a) op_tensor(c, a, (Tensor) {.data_type = (a).data_type}, ABS)
 
+// Reductions over the axes set in the mask built with AXIS, every axis when it is 0
+#define AXIS(index) (1u << (index))
+#define REDUCE_TENSOR(c, a, flag, axes, keepdims, p) op_tensor(c, a, (Tensor) {.data = &(Reduction) {flag, axes, keepdims, p}, .data_type = (a).data_type}, REDUCE)
+#define REDUCE_SUM_TENSOR(c, a, axes, keepdims) REDUCE_TENSOR(c, a, REDUCE_SUM, axes, keepdims, 0.0L)
+#define REDUCE_MEAN_TENSOR(c, a, axes, keepdims) REDUCE_TENSOR(c, a, REDUCE_MEAN, axes, keepdims, 0.0L)
+#define REDUCE_MAX_TENSOR(c, a, axes, keepdims) REDUCE_TENSOR(c, a, REDUCE_MAX, axes, keepdims, 0.0L)
+#define REDUCE_MIN_TENSOR(c, a, axes, keepdims) REDUCE_TENSOR(c, a, REDUCE_MIN, axes, keepdims, 0.0L)
+#define ARGMAX_TENSOR(c, a, axes, keepdims) REDUCE_TENSOR(c, a, REDUCE_ARGMAX, axes, keepdims, 0.0L)
+#define REDUCE_NORM_TENSOR(c, a, axes, keepdims, p) REDUCE_TENSOR(c, a, REDUCE_NORM, axes, keepdims, p)
+#define LOGSUMEXP_TENSOR(c, a, axes, keepdims) REDUCE_TENSOR(c, a, REDUCE_LOGSUMEXP, axes, keepdims, 0.0L)
+
 // TENSORS OPERATIONS
 #define MULTIPLY_TENSOR(c, a, b) op_tensor(c, a, b, MULTIPLICATION)
 #define SUBTRACT_TENSOR(c, a, b) op_tensor(c, a, b, SUBTRACTION)
@@ -36,6 +70,21 @@
 #define SCALAR_DIV_TENSOR(a, val) scalar_op_tensor(a, val, DIVISION)
 #define SCALAR_SUM_TENSOR(a, val) scalar_op_tensor(a, val, SUM)
 
+// IN-PLACE TENSOR OPERATIONS
+#define INPLACE_MULTIPLY_TENSOR(a, b) op_tensor_inplace(a, b, MULTIPLICATION)
+#define INPLACE_SUBTRACT_TENSOR(a, b) op_tensor_inplace(a, b, SUBTRACTION)
+#define INPLACE_DIVIDE_TENSOR(a, b) op_tensor_inplace(a, b, DIVISION)
+#define INPLACE_SUM_TENSOR(a, b) op_tensor_inplace(a, b, SUM)
+#define INPLACE_MAX_TENSOR(a, b) op_tensor_inplace(a, b, MAX)
+#define INPLACE_MIN_TENSOR(a, b) op_tensor_inplace(a, b, MIN)
+#define INPLACE_TANH_TENSOR(a) op_tensor_inplace(a, (Tensor) {.data_type = (a) -> data_type}, TANH)
+#define INPLACE_SIGMOID_TENSOR(a) op_tensor_inplace(a, (Tensor) {.data_type = (a) -> data_type}, SIGMOID)
+#define INPLACE_GELU_TENSOR(a) op_tensor_inplace(a, (Tensor) {.data_type = (a) -> data_type}, GELU)
+#define INPLACE_SQRT_TENSOR(a) op_tensor_inplace(a, (Tensor) {.data_type = (a) -> data_type}, SQRT)
+#define INPLACE_EXP_TENSOR(a) op_tensor_inplace(a, (Tensor) {.data_type = (a) -> data_type}, EXP)
+#define INPLACE_LOG_TENSOR(a) op_tensor_inplace(a, (Tensor) {.data_type = (a) -> data_type}, LOG)
+#define INPLACE_ABS_TENSOR(a) op_tensor_inplace(a, (Tensor) {.data_type = (a) -> data_type}, ABS)
+
 // TENSOR COMPARISON OPERATIONS_TENSOR
 #define IS_GREATER_OR_EQUAL_TENSOR(a, b) comparison_op_tensor(a, b, GREATER_OR_EQUAL)
 #define IS_LESS_OR_EQUAL_TENSOR(a, b) comparison_op_tensor(a, b, LESS_OR_EQUAL)
@@ -45,26 +94,75 @@
 #define IS_EQUAL_TENSOR(a, b) comparison_op_tensor(a, b, EQUAL)
 #define IS_LESS_TENSOR(a, b) comparison_op_tensor(a, b, LESS)
 
-Tensor alloc_temp_tensor(unsigned int* shape, unsigned int rank, DataType data_type, bool clean_cache_flag);
+typedef struct GatherTask {
+    Tensor* src;
+    void* dest;
+    size_t cols;
+} GatherTask;
+
+typedef struct StridedTask {
+    TensorKernel kernel;
+    Tensor* res;
+    Tensor* a;
+    Tensor* b;
+    size_t cols;
+    bool is_binary;
+} StridedTask;
+
+// Links a recycled temporary buffer into its bucket, stored inside the buffer while it sits unused
+typedef struct TempBuffer {
+    struct TempBuffer* next;
+    size_t size;
+} TempBuffer;
+
+// Per-thread bookkeeping of the temporaries: scopes hold the tensors_count at the time they were pushed
+typedef struct TempContext {
+    Tensor* tensors;
+    unsigned int tensors_count;
+    unsigned int tensors_capacity;
+    unsigned int scopes[TEMP_SCOPES_MAX];
+    unsigned int scopes_count;
+    TempBuffer* buckets[TEMP_BUCKETS_COUNT];
+    size_t cached_bytes;
+} TempContext;
+
+Tensor alloc_temp_tensor(size_t* shape, unsigned int rank, DataType data_type, bool clean_cache_flag);
 Tensor* contract_tensor(Tensor* tensor, unsigned int contraction_index_a, unsigned int contraction_index_b);
-Tensor* reshape_tensor(Tensor* dest, unsigned int* shape, unsigned int rank, DataType data_type);
-Tensor* extract_tensor(Tensor* out, Tensor tensor, unsigned int index, unsigned int index_dim);
-Tensor identity_tensor(unsigned int shape_base, unsigned int rank, DataType data_type);
-Tensor alloc_tensor(unsigned int* shape, unsigned int rank, DataType data_type);
+Tensor* reshape_tensor(Tensor* dest, size_t* shape, unsigned int rank, DataType data_type);
+Tensor* reshape_tensor_uninit(Tensor* dest, size_t* shape, unsigned int rank, DataType data_type);
+Tensor* slice_tensor(Tensor* dest, Tensor src, unsigned int axis, size_t start, size_t end);
+Tensor* view_tensor(Tensor* dest, Tensor src, size_t* shape, unsigned int rank);
+Tensor* extract_tensor(Tensor* out, Tensor tensor, size_t index, unsigned int index_dim);
+Tensor identity_tensor(size_t shape_base, unsigned int rank, DataType data_type);
+Tensor alloc_tensor(size_t* shape, unsigned int rank, DataType data_type);
+Tensor alloc_tensor_uninit(size_t* shape, unsigned int rank, DataType data_type);
 Tensor* scalar_op_tensor(Tensor* tensor, void* scalar, OperatorFlag op_flag);
 void threshold_tensor(Tensor a, void* threshold, void* upper, void* lower);
 Tensor* op_tensor(Tensor* c, Tensor a, Tensor b, OperatorFlag op_flag);
+Tensor* op_tensor_inplace(Tensor* a, Tensor b, OperatorFlag op_flag);
+Tensor* accumulate_dot_tensor(Tensor* c, Tensor a, Tensor b);
+Tensor* reduce_tensor(Tensor* c, Tensor a, Reduction reduction);
+Tensor* permute_tensor(Tensor* tensor, unsigned int* axes);
 bool comparison_op_tensor(Tensor a, Tensor b, ComparisonFlag cmp_flag);
 void print_tensor(Tensor tensor, char* prefix_str, char* tensor_name);
-unsigned int tensor_size(unsigned int* shape, unsigned int rank);
+void push_temp_scope(void);
+void pop_temp_scope(void);
+size_t tensor_size(size_t* shape, unsigned int rank);
 Tensor alloc_scalar_tensor(void* val, DataType data_type);
 void* tensor_norm(Tensor tensor, void* norm, void* res);
 Tensor* flatten_tensor(Tensor* dest, Tensor src);
 Tensor* concat_tensors(Tensor* dest, Tensor src);
+Tensor* sum_to_shape(Tensor* dest, Tensor src, size_t* shape, unsigned int rank);
 void set_tensor(void* new_data, Tensor tensor);
 Tensor* copy_tensor(Tensor* dest, Tensor src);
+Tensor* cast_tensor(Tensor* dest, Tensor src, DataType data_type);
+Quantization compute_quantization(Tensor tensor, int axis, bool is_symmetric);
+Tensor* quantize_tensor(Tensor* dest, Tensor src, Quantization quantization);
+Tensor* dequantize_tensor(Tensor* dest, Tensor src, Quantization quantization);
+void deallocate_quantization(Quantization* quantization);
 Tensor* cut_tensor(Tensor* dest, Tensor* src);
 void fill_tensor(void* val, Tensor tensor);
+Tensor* contiguous_tensor(Tensor* tensor);
 Tensor* transpose_tensor(Tensor* tensor);
 Tensor empty_tensor(DataType data_type);
 void deallocate_tensors(int len, ...);
@@ -74,14 +172,14 @@ Tensor* normal(Tensor* tensor);
 
 /* ------------------------------------------------------------------------------------------------------------------------- */
 
-static unsigned int calc_shape_offset(unsigned int* shape, unsigned int shape_index, unsigned int rank) {
-    unsigned int offset = 1;
+static size_t calc_shape_offset(size_t* shape, unsigned int shape_index, unsigned int rank) {
+    size_t offset = 1;
     for (unsigned int i = shape_index + 1; i < rank; ++i) offset *= shape[i];
     return offset;
 }
 
-static void insert_spacing(unsigned int index, char* prefix_str, Tensor tensor) {
-    unsigned int temp = 1;
+static void insert_spacing(size_t index, char* prefix_str, Tensor tensor) {
+    size_t temp = 1;
     if ((index + 1) % tensor.shape[tensor.rank - 1]) printf(", ");
     for (int i = tensor.rank - 1; i >= 0; --i) {
         temp *= tensor.shape[i];
@@ -90,14 +188,14 @@ static void insert_spacing(unsigned int index, char* prefix_str, Tensor tensor)
     return;
 }
 
-static void print_shape(unsigned int* shape, unsigned int rank) {
+static void print_shape(size_t* shape, unsigned int rank) {
     printf("(%u): [ ", rank);
-    for (unsigned int i = 0; i < rank; ++i) printf("%u%s", shape[i], i == rank - 1 ? " " : ", ");
+    for (unsigned int i = 0; i < rank; ++i) printf("%zu%s", shape[i], i == rank - 1 ? " " : ", ");
     printf("]\n");
     return;
 }
 
-static bool is_valid_shape(unsigned int* shape, unsigned int rank) {
+static bool is_valid_shape(size_t* shape, unsigned int rank) {
     if (shape == NULL) return FALSE;
     for (unsigned int i = 0; i < rank; ++i) {
         if (!shape[i]) return FALSE;
@@ -105,49 +203,240 @@ static bool is_valid_shape(unsigned int* shape, unsigned int rank) {
     return TRUE;
 }
 
-static void matricize_tensor(Tensor tensor, unsigned int* rows, unsigned int* cols) {
-    *rows = 1, *cols = 1;
-    for (unsigned int i = 0; i < tensor.rank - 1; ++i) *rows *= tensor.shape[i];
-    *cols = tensor.shape[tensor.rank - 1];
+static bool has_shape(Tensor tensor, size_t* shape, unsigned int rank, DataType data_type) {
+    if ((tensor.data == NULL) || (tensor.rank != rank) || (tensor.data_type != data_type)) return FALSE;
+    for (unsigned int i = 0; (tensor.shape != shape) && (i < rank); ++i) {
+        if (tensor.shape[i] != shape[i]) return FALSE;
+    }
+    return TRUE;
+}
+
+// Hands the buffers of src over to dest, whose previous ones are released: the grad node of dest is kept
+static Tensor* move_tensor(Tensor* dest, Tensor src) {
+    DEALLOCATE_MEMORY(TENSOR_STORAGE(*dest), dest -> shape, dest -> strides);
+    dest -> shape = src.shape;
+    dest -> strides = src.strides;
+    dest -> rank = src.rank;
+    dest -> data = src.data;
+    dest -> storage = src.storage;
+    dest -> data_type = src.data_type;
+    return dest;
+}
+
+// Tensors without strides are laid out in row-major order
+static size_t stride_at(Tensor tensor, unsigned int dim) {
+    return tensor.strides != NULL ? tensor.strides[dim] : calc_shape_offset(tensor.shape, dim, tensor.rank);
+}
+
+static bool is_contiguous(Tensor tensor) {
+    if (tensor.strides == NULL) return TRUE;
+    size_t expected_stride = 1;
+    for (unsigned int d = tensor.rank; d-- > 0;) {
+        if (tensor.shape[d] != 1 && tensor.strides[d] != expected_stride) return FALSE;
+        expected_stride *= tensor.shape[d];
+    }
+    return TRUE;
+}
+
+// Position in the buffer of the element with the given row-major index
+static size_t strided_offset(Tensor tensor, size_t index) {
+    if (tensor.strides == NULL) return index;
+    size_t offset = 0;
+    for (unsigned int d = tensor.rank; d-- > 0;) {
+        offset += (index % tensor.shape[d]) * tensor.strides[d];
+        index /= tensor.shape[d];
+    }
+    return offset;
+}
+
+// A tensor sharing the buffer of src, its shape and strides are left for the caller to fill
+static Tensor make_view(Tensor src, unsigned int rank) {
+    Tensor view = { .shape = NULL, .strides = NULL, .rank = rank, .data = src.data, .storage = NULL, .data_type = src.data_type, .grad_node = NULL };
+    view.shape = (size_t*) alloc_memory(rank, sizeof(size_t));
+    view.strides = (size_t*) alloc_memory(rank, sizeof(size_t));
+    view.storage = retain_memory(TENSOR_STORAGE(src));
+    return view;
+}
+
+// Stride of the dimensions [from, to) walked as a single one, which fails when they do not evenly nest into each other
+static bool merge_dims(Tensor tensor, unsigned int from, unsigned int to, size_t* stride) {
+    bool is_stride_set = FALSE;
+    size_t span = 0;
+    for (unsigned int d = to; d-- > from;) {
+        if (tensor.shape[d] == 1) continue;
+        else if (!is_stride_set) {
+            *stride = tensor.strides[d];
+            is_stride_set = TRUE;
+        } else if (tensor.strides[d] != span) return FALSE;
+        span = tensor.strides[d] * tensor.shape[d];
+    }
+    return TRUE;
+}
+
+// Row and column strides of tensor seen as a matrix, whose rows span the dimensions before split
+static bool matrix_strides(Tensor tensor, unsigned int split, size_t* rs, size_t* cs) {
+    *rs = tensor_size(tensor.shape + split, tensor.rank - split);
+    *cs = 1;
+    if (tensor.strides == NULL) return TRUE;
+    return merge_dims(tensor, 0, split, rs) && merge_dims(tensor, split, tensor.rank, cs);
+}
+
+// Every element size is a constant of its own loop, so that the copy of each element compiles to a single move
+static void* gather_row(void* dest, void* src, size_t stride, size_t n, DataType data_type) {
+    const unsigned char size = DATA_TYPE_SIZE(data_type);
+    if (size == 4) GATHER_ROW(dest, src, stride, n, 4);
+    else if (size == 8) GATHER_ROW(dest, src, stride, n, 8);
+    else if (size == 2) GATHER_ROW(dest, src, stride, n, 2);
+    else if (size == 1) GATHER_ROW(dest, src, stride, n, 1);
+    else GATHER_ROW(dest, src, stride, n, size);
+    return dest;
+}
+
+static void gather_task(void* args, size_t start, size_t end) {
+    GatherTask* task = (GatherTask*) args;
+    Tensor* src = task -> src;
+    const size_t inner_stride = stride_at(*src, src -> rank - 1);
+    for (size_t row = start; row < end; ++row) {
+        void* src_row = CAST_PTR_AT_INDEX(src -> data, strided_offset(*src, row * task -> cols), src -> data_type);
+        gather_row(CAST_PTR_AT_INDEX(task -> dest, row * task -> cols, src -> data_type), src_row, inner_stride, task -> cols, src -> data_type);
+    }
+    return;
+}
+
+// Copies the elements of src in row-major order into the contiguous dest
+static void gather_tensor(void* dest, Tensor src) {
+    const size_t size = tensor_size(src.shape, src.rank);
+    if (is_contiguous(src)) {
+        mem_copy(dest, src.data, DATA_TYPE_SIZE(src.data_type), size);
+        return;
+    }
+    const size_t cols = src.shape[src.rank - 1];
+    GatherTask task = { .src = &src, .dest = dest, .cols = cols };
+    parallel_for(size / cols, MAX(TENSOR_GRAIN / cols, 1), gather_task, &task);
+    return;
+}
+
+// Unit-stride elements are handed to the kernel as they are, the others through a gathered tile: a zero stride repeats
+// a single element, so its tile is filled again only once the row moves on to a different one
+static void* load_strided(void* tile, void** tile_src, unsigned char* src, size_t stride, size_t n, DataType data_type) {
+    if (stride == 1) return src;
+    else if (!stride && (*tile_src == src)) return tile;
+    *tile_src = stride ? NULL : src;
+    return gather_row(tile, src, stride, n, data_type);
+}
+
+static void strided_task(void* args, size_t start, size_t end) {
+    StridedTask* task = (StridedTask*) args;
+    const DataType data_type = task -> res -> data_type;
+    const size_t cols = task -> cols;
+    const size_t a_stride = stride_at(*(task -> a), task -> a -> rank - 1);
+    const size_t b_stride = task -> is_binary ? stride_at(*(task -> b), task -> b -> rank - 1) : 1;
+    _Alignas(ALLOCATOR_ALIGNMENT) unsigned char a_tile[STRIDED_TILE * sizeof(long double)];
+    _Alignas(ALLOCATOR_ALIGNMENT) unsigned char b_tile[STRIDED_TILE * sizeof(long double)];
+    void* a_tile_src = NULL;
+    void* b_tile_src = NULL;
+
+    for (size_t row = start; row < end; ++row) {
+        unsigned char* res_row = CAST_PTR_AT_INDEX(task -> res -> data, row * cols, data_type);
+        unsigned char* a_row = CAST_PTR_AT_INDEX(task -> a -> data, strided_offset(*(task -> a), row * cols), data_type);
+        unsigned char* b_row = task -> is_binary ? CAST_PTR_AT_INDEX(task -> b -> data, strided_offset(*(task -> b), row * cols), data_type) : task -> b -> data;
+        for (size_t j = 0; j < cols; j += STRIDED_TILE) {
+            const size_t n = MIN(STRIDED_TILE, cols - j);
+            void* a_ptr = load_strided(a_tile, &a_tile_src, CAST_PTR_AT_INDEX(a_row, j * a_stride, data_type), a_stride, n, data_type);
+            void* b_ptr = task -> is_binary ? load_strided(b_tile, &b_tile_src, CAST_PTR_AT_INDEX(b_row, j * b_stride, data_type), b_stride, n, data_type) : b_row;
+            task -> kernel(CAST_PTR_AT_INDEX(res_row, j, data_type), a_ptr, b_ptr, n);
+        }
+    }
+
+    return;
+}
+
+static void run_strided_kernel(OperatorFlag op_flag, Tensor res, Tensor a, Tensor b) {
+    const size_t cols = a.shape[a.rank - 1];
+    StridedTask task = { .kernel = get_kernel(op_flag, a.data_type), .res = &res, .a = &a, .b = &b, .cols = cols, .is_binary = IS_BINARY_KERNEL(op_flag) };
+    // Resolve the SIMD level before the workers read it
+    NOT_USED(get_simd_level());
+    parallel_for(tensor_size(a.shape, a.rank) / cols, MAX(KERNEL_GRAIN / cols, 1), strided_task, &task);
     return;
 }
 
-unsigned int tensor_size(unsigned int* shape, unsigned int rank) {
+// Gives tensor a contiguous buffer of its own, dropping its reference to the shared one
+static Tensor* detach_tensor(Tensor* tensor) {
+    Tensor temp = empty_tensor(tensor -> data_type);
+    copy_tensor(&temp, *tensor);
+    return move_tensor(tensor, temp);
+}
+
+// Two tensors overlap unless they live in different buffers, or share the very same layout
+static bool is_overlapping(Tensor a, Tensor b) {
+    if (a.data == NULL || b.data == NULL || TENSOR_STORAGE(a) != TENSOR_STORAGE(b)) return FALSE;
+    return (a.data != b.data) || (TENSOR_SIZE(a) != TENSOR_SIZE(b)) || !is_contiguous(a) || !is_contiguous(b);
+}
+
+// Shape of the element-wise result of a and b, aligned on their trailing dimensions: each pair must match, or one be 1
+static bool broadcast_shape(Tensor a, Tensor b, size_t* shape, unsigned int rank) {
+    for (unsigned int i = 0; i < rank; ++i) {
+        const size_t dim_a = (i < a.rank) ? a.shape[a.rank - i - 1] : 1;
+        const size_t dim_b = (i < b.rank) ? b.shape[b.rank - i - 1] : 1;
+        if ((dim_a != dim_b) && (dim_a != 1) && (dim_b != 1)) return FALSE;
+        shape[rank - i - 1] = MAX(dim_a, dim_b);
+    }
+    return TRUE;
+}
+
+// The operand laid over shape, repeated through a zero stride along the dimensions it lacks: only the strides are allocated
+static Tensor broadcast_operand(Tensor operand, size_t* shape, unsigned int rank) {
+    Tensor view = { .shape = shape, .strides = NULL, .rank = rank, .data = operand.data, .storage = TENSOR_STORAGE(operand), .data_type = operand.data_type, .grad_node = NULL };
+    view.strides = (size_t*) alloc_memory(rank, sizeof(size_t));
+    for (unsigned int i = 0; i < MIN(rank, operand.rank); ++i) {
+        if (operand.shape[operand.rank - i - 1] == shape[rank - i - 1]) view.strides[rank - i - 1] = stride_at(operand, operand.rank - i - 1);
+    }
+    return view;
+}
+
+size_t tensor_size(size_t* shape, unsigned int rank) {
     if (shape == NULL) return 0;
-    unsigned int size = 1;
-    for (unsigned int i = 0; i < rank; ++i) size *= shape[i];
+    size_t size = 1;
+    for (unsigned int i = 0; i < rank; ++i) size = checked_mul(size, shape[i]);
     return size;
 }
 
-Tensor alloc_tensor(unsigned int* shape, unsigned int rank, DataType data_type) {
+static Tensor alloc_tensor_data(size_t* shape, unsigned int rank, DataType data_type, bool clean_flag) {
     ASSERT(!is_valid_enum(data_type, (unsigned char*) data_types, ARR_SIZE(data_types)), "INVALID_DATA_TYPE");
     ASSERT(!is_valid_shape(shape, rank), "INVALID_TENSOR_SHAPE");
     Tensor tensor = { .shape = NULL, .rank = rank, .data_type = data_type, .data = NULL };
-    tensor.shape = tensor.rank ? (unsigned int*) calloc(tensor.rank, sizeof(unsigned int)) : NULL;
+    tensor.shape = tensor.rank ? (size_t*) alloc_memory(tensor.rank, sizeof(size_t)) : NULL;
     ASSERT(tensor.shape == NULL && tensor.rank, "BAD_MEMORY");
-    mem_copy(tensor.shape, shape, sizeof(unsigned int), tensor.rank);
-    tensor.data = calloc(tensor_size(shape, rank), tensor.data_type);
+    mem_copy(tensor.shape, shape, sizeof(size_t), tensor.rank);
+    const size_t size = tensor_size(shape, rank);
+    tensor.data = clean_flag ? alloc_memory(size, DATA_TYPE_SIZE(tensor.data_type)) : alloc_memory_uninit(size, DATA_TYPE_SIZE(tensor.data_type));
     ASSERT(tensor.data == NULL, "BAD_MEMORY");
     return tensor;
 }
 
+Tensor alloc_tensor(size_t* shape, unsigned int rank, DataType data_type) {
+    return alloc_tensor_data(shape, rank, data_type, TRUE);
+}
+
+// The data is left uninitialized, for results that get written in full
+Tensor alloc_tensor_uninit(size_t* shape, unsigned int rank, DataType data_type) {
+    return alloc_tensor_data(shape, rank, data_type, FALSE);
+}
+
 void deallocate_tensors(int len, ...) {
     va_list args;
     va_start(args, len);
     for (int i = 0; i < len; ++i) {
         Tensor tensor = va_arg(args, Tensor);
-        free(tensor.data);
-        free(tensor.shape);
+        DEALLOCATE_MEMORY(TENSOR_STORAGE(tensor), tensor.shape, tensor.strides);
     }
     va_end(args);
     return;
 }
 
 Tensor empty_tensor(DataType data_type) {
-    unsigned int shape[] = { 1 };
-    Tensor tensor = alloc_tensor(shape, 0, data_type);
-    free(tensor.data);
-    tensor.data = NULL;
+    ASSERT(!is_valid_enum(data_type, (unsigned char*) data_types, ARR_SIZE(data_types)), "INVALID_DATA_TYPE");
+    Tensor tensor = { .shape = NULL, .rank = 0, .data_type = data_type, .data = NULL };
     return tensor;
 }
 
@@ -163,40 +452,117 @@ void empty_tensors(int len, ...) {
     return;
 }
 
-Tensor alloc_temp_tensor(unsigned int* shape, unsigned int rank, DataType data_type, bool clean_cache_flag) {
-    static Tensor* cache_tensor = NULL;
-    static unsigned int cache_size = 0;
+static _Thread_local TempContext temp_context = {0};
+
+static size_t temp_buffer_size(Tensor tensor) {
+    // The shape is kept in the same buffer, right after the aligned data
+    return ALLOCATOR_ALIGNED_SIZE(checked_mul(tensor_size(tensor.shape, tensor.rank), DATA_TYPE_SIZE(tensor.data_type))) + sizeof(size_t) * tensor.rank;
+}
+
+static void* acquire_temp_buffer(size_t size) {
+    TempBuffer** link = temp_context.buckets + (size / ALLOCATOR_ALIGNMENT) % TEMP_BUCKETS_COUNT;
+    while (*link != NULL && (*link) -> size != size) link = &((*link) -> next);
+    // Temporaries always come from the pool, as a recycled buffer may outlive a reset of the current allocator
+    if (*link == NULL) return alloc_memory_from(get_pool_allocator(), 1, size);
+
+    TempBuffer* buffer = *link;
+    *link = buffer -> next;
+    temp_context.cached_bytes -= size;
+    memset(buffer, 0, size);
+
+    return buffer;
+}
+
+static void release_temp_buffer(void* ptr, size_t size) {
+    // A buffer still referenced by some view is left to the last of them
+    if (size < sizeof(TempBuffer) || temp_context.cached_bytes + size > TEMP_CACHE_MAX_BYTES || is_memory_shared(ptr)) {
+        free_memory(ptr);
+        return;
+    }
+
+    TempBuffer** bucket = temp_context.buckets + (size / ALLOCATOR_ALIGNMENT) % TEMP_BUCKETS_COUNT;
+    TempBuffer* buffer = (TempBuffer*) ptr;
+    buffer -> next = *bucket;
+    buffer -> size = size;
+    *bucket = buffer;
+    temp_context.cached_bytes += size;
+
+    return;
+}
+
+void push_temp_scope(void) {
+    ASSERT(temp_context.scopes_count == TEMP_SCOPES_MAX, "TOO_MANY_TEMP_SCOPES");
+    temp_context.scopes[(temp_context.scopes_count)++] = temp_context.tensors_count;
+    return;
+}
+
+// Hands the buffers of the temporaries allocated since the matching push back to the per-thread cache
+void pop_temp_scope(void) {
+    ASSERT(!temp_context.scopes_count, "NO_TEMP_SCOPE");
+    const unsigned int mark = temp_context.scopes[--(temp_context.scopes_count)];
+    while (temp_context.tensors_count > mark) {
+        Tensor temp = temp_context.tensors[--(temp_context.tensors_count)];
+        release_temp_buffer(temp.data, temp_buffer_size(temp));
+    }
+    return;
+}
 
+// Temporaries live until the enclosing temp scope is popped, or until DEALLOCATE_TEMP_TENSORS when outside of any scope,
+// they must never be passed to DEALLOCATE_TENSORS; as the cache is per-thread, each thread cleans its own before exiting
+Tensor alloc_temp_tensor(size_t* shape, unsigned int rank, DataType data_type, bool clean_cache_flag) {
     if (clean_cache_flag) {
-        for (unsigned int i = 0; i < cache_size; ++i) DEALLOCATE_TENSORS(cache_tensor[i]);
-        free(cache_tensor);
-        cache_tensor = NULL;
-        cache_size = 0;
+        for (size_t i = 0; i < temp_context.tensors_count; ++i) free_memory(temp_context.tensors[i].data);
+        for (size_t i = 0; i < TEMP_BUCKETS_COUNT; ++i) {
+            while (temp_context.buckets[i] != NULL) {
+                TempBuffer* buffer = temp_context.buckets[i];
+                temp_context.buckets[i] = buffer -> next;
+                free_memory(buffer);
+            }
+        }
+        free(temp_context.tensors);
+        temp_context = (TempContext) {0};
         return (Tensor) {0};
-    } else if (cache_tensor == NULL) cache_tensor = (Tensor*) calloc(1, sizeof(Tensor));
-    else cache_tensor = (Tensor*) realloc(cache_tensor, sizeof(Tensor) * (cache_size + 1));
+    }
+
+    ASSERT(!is_valid_enum(data_type, (unsigned char*) data_types, ARR_SIZE(data_types)), "INVALID_DATA_TYPE");
+    ASSERT(!is_valid_shape(shape, rank), "INVALID_TENSOR_SHAPE");
+
+    if (temp_context.tensors_count == temp_context.tensors_capacity) {
+        temp_context.tensors_capacity = MAX(2 * temp_context.tensors_capacity, 16);
+        temp_context.tensors = (Tensor*) realloc(temp_context.tensors, sizeof(Tensor) * temp_context.tensors_capacity);
+        ASSERT(temp_context.tensors == NULL, "BAD_MEMORY");
+    }
+
+    Tensor temp = { .shape = shape, .rank = rank, .data_type = data_type, .data = NULL };
+    const size_t buffer_size = temp_buffer_size(temp);
+    temp.data = acquire_temp_buffer(buffer_size);
+    temp.shape = rank ? (size_t*) (CAST_PTR(temp.data, unsigned char) + buffer_size - sizeof(size_t) * rank) : NULL;
+    mem_copy(temp.shape, shape, sizeof(size_t), rank);
+    temp_context.tensors[(temp_context.tensors_count)++] = temp;
 
-    Tensor temp = alloc_tensor(shape, rank, data_type);
-    cache_tensor[cache_size++] = temp;
     return temp;
 }
 
 Tensor alloc_scalar_tensor(void* val, DataType data_type) {
+    // The value is copied, so that the tensor owns its data like any other
     Tensor tensor = empty_tensor(data_type);
-    free(tensor.data);
-    tensor.data = val;
+    tensor.data = alloc_memory(1, DATA_TYPE_SIZE(data_type));
+    mem_copy(tensor.data, val, DATA_TYPE_SIZE(data_type), 1);
     return tensor;
 }
 
 void print_tensor(Tensor tensor, char* prefix_str, char* tensor_name) {
-    const unsigned int size = tensor_size(tensor.shape, tensor.rank);
+    const size_t size = tensor_size(tensor.shape, tensor.rank);
     printf("%sTensor '%s' with shape ", prefix_str, tensor_name);
     print_shape(tensor.shape, tensor.rank);
     printf("\n%s", prefix_str);
-    for (unsigned int i = 0; i < size; ++i) {
-        if (tensor.data_type == FLOAT_32) printf("%f", CAST_PTR(tensor.data, float)[i]);
-        else if (tensor.data_type == FLOAT_64) printf("%lf", CAST_PTR(tensor.data, double)[i]);
-        else if (tensor.data_type == FLOAT_128) printf("%Lf", CAST_PTR(tensor.data, long double)[i]);
+    for (size_t i = 0; i < size; ++i) {
+        const size_t offset = strided_offset(tensor, i);
+        if (tensor.data_type == FLOAT_32) printf("%f", CAST_PTR(tensor.data, float)[offset]);
+        else if (tensor.data_type == FLOAT_64) printf("%lf", CAST_PTR(tensor.data, double)[offset]);
+        else if (tensor.data_type == FLOAT_128) printf("%Lf", CAST_PTR(tensor.data, long double)[offset]);
+        else if ((tensor.data_type == INT_8) || (tensor.data_type == INT_32)) printf("%d", (int) read_data_type(CAST_PTR_AT_INDEX(tensor.data, offset, tensor.data_type), tensor.data_type));
+        else printf("%f", (double) read_data_type(CAST_PTR_AT_INDEX(tensor.data, offset, tensor.data_type), tensor.data_type));
         insert_spacing(i, prefix_str, tensor);
     }
     printf("\n");
@@ -204,201 +570,421 @@ void print_tensor(Tensor tensor, char* prefix_str, char* tensor_name) {
 }
 
 void fill_tensor(void* val, Tensor tensor) {
-    unsigned int size = tensor_size(tensor.shape, tensor.rank);
-    mem_set(tensor.data, val, tensor.data_type, size);
+    size_t size = tensor_size(tensor.shape, tensor.rank);
+    if (is_contiguous(tensor)) mem_set(tensor.data, val, DATA_TYPE_SIZE(tensor.data_type), size);
+    else for (size_t i = 0; i < size; ++i) mem_copy(CAST_PTR_AT_INDEX(tensor.data, strided_offset(tensor, i), tensor.data_type), val, DATA_TYPE_SIZE(tensor.data_type), 1);
     return;
 }
 
 void set_tensor(void* new_data, Tensor tensor) {
-    unsigned int size = tensor_size(tensor.shape, tensor.rank);
-    mem_copy(tensor.data, new_data, tensor.data_type, size);
+    size_t size = tensor_size(tensor.shape, tensor.rank);
+    if (is_contiguous(tensor)) mem_copy(tensor.data, new_data, DATA_TYPE_SIZE(tensor.data_type), size);
+    else for (size_t i = 0; i < size; ++i) mem_copy(CAST_PTR_AT_INDEX(tensor.data, strided_offset(tensor, i), tensor.data_type), CAST_PTR_AT_INDEX(new_data, i, tensor.data_type), DATA_TYPE_SIZE(tensor.data_type), 1);
+    return;
+}
+
+// The typed kernels walk contiguous compute types: any other tensor is gathered into a copy in its compute type
+static void* compute_data(Tensor* copy, Tensor tensor) {
+    if (IS_COMPUTE_TYPE(tensor.data_type) && is_contiguous(tensor)) return tensor.data;
+    return cast_tensor(copy, tensor, COMPUTE_DATA_TYPE(tensor.data_type)) -> data;
+}
+
+// Writes the copy taken by compute_data back over tensor, rounded to its data type, then releases it
+static void store_compute_data(Tensor tensor, Tensor* copy) {
+    if (copy -> data == NULL) return;
+    if (copy -> data_type != tensor.data_type) cast_tensor(copy, *copy, tensor.data_type);
+    set_tensor(copy -> data, tensor);
+    DEALLOCATE_TENSORS(*copy);
     return;
 }
 
 void randomize_tensor(Tensor tensor) {
-    unsigned int size = tensor_size(tensor.shape, tensor.rank);
-    for (unsigned int i = 0; i < size; ++i) ASSIGN(CAST_PTR_AT_INDEX(tensor.data, i, tensor.data_type), (long double) rand() / RAND_MAX, tensor.data_type);
+    const DataType compute_type = COMPUTE_DATA_TYPE(tensor.data_type);
+    const size_t size = tensor_size(tensor.shape, tensor.rank);
+    Tensor copy = empty_tensor(compute_type);
+    if (!IS_COMPUTE_TYPE(tensor.data_type) || !is_contiguous(tensor)) copy = alloc_tensor_uninit(tensor.shape, tensor.rank, compute_type);
+    run_random_kernel(compute_type, (copy.data != NULL) ? copy.data : tensor.data, size);
+    store_compute_data(tensor, &copy);
     return;
 }
 
-Tensor* reshape_tensor(Tensor* dest, unsigned int* shape, unsigned int rank, DataType data_type) {
-    dest -> shape = (unsigned int*) realloc(dest -> shape, sizeof(unsigned int) * rank);
+static Tensor* resize_tensor(Tensor* dest, size_t* shape, unsigned int rank, DataType data_type, bool clean_flag) {
+    dest -> shape = (size_t*) realloc_memory(dest -> shape, sizeof(size_t) * rank);
     ASSERT(dest -> shape == NULL, "BAD_MEMORY");
-    mem_copy(dest -> shape, shape, sizeof(unsigned int), rank);
+    mem_copy(dest -> shape, shape, sizeof(size_t), rank);
     dest -> rank = rank;
     dest -> data_type = data_type;
-    free(dest -> data);
-    dest -> data = calloc(tensor_size(dest -> shape, dest -> rank), dest -> data_type);
+    DEALLOCATE_MEMORY(TENSOR_STORAGE(*dest), dest -> strides);
+    dest -> strides = NULL;
+    dest -> storage = NULL;
+    const size_t size = tensor_size(dest -> shape, dest -> rank);
+    dest -> data = clean_flag ? alloc_memory(size, DATA_TYPE_SIZE(dest -> data_type)) : alloc_memory_uninit(size, DATA_TYPE_SIZE(dest -> data_type));
     ASSERT(dest -> data == NULL, "BAD_MEMORY");
     return dest;
 }
 
+Tensor* reshape_tensor(Tensor* dest, size_t* shape, unsigned int rank, DataType data_type) {
+    return resize_tensor(dest, shape, rank, data_type, TRUE);
+}
+
+// Like reshape_tensor, without zeroing the new buffer
+Tensor* reshape_tensor_uninit(Tensor* dest, size_t* shape, unsigned int rank, DataType data_type) {
+    return resize_tensor(dest, shape, rank, data_type, FALSE);
+}
+
 Tensor* copy_tensor(Tensor* dest, Tensor src) {
-    reshape_tensor(dest, src.shape, src.rank, src.data_type);
-    unsigned int size = tensor_size(src.shape, src.rank);
-    mem_copy(dest -> data, src.data, size, src.data_type);
+    reshape_tensor_uninit(dest, src.shape, src.rank, src.data_type);
+    gather_tensor(dest -> data, src);
     return dest;
 }
 
+// Converts src to data_type, the floating types rounding to nearest even and the integer ones saturating
+Tensor* cast_tensor(Tensor* dest, Tensor src, DataType data_type) {
+    ASSERT(!is_valid_enum(data_type, (unsigned char*) data_types, ARR_SIZE(data_types)), "INVALID_DATA_TYPE");
+    Tensor res = alloc_tensor_uninit(src.shape, src.rank, data_type);
+    Tensor src_copy = empty_tensor(src.data_type);
+    if (!is_contiguous(src)) copy_tensor(&src_copy, src);
+    run_convert_kernel(data_type, res.data, src.data_type, src_copy.data != NULL ? src_copy.data : src.data, tensor_size(src.shape, src.rank));
+    DEALLOCATE_TENSORS(src_copy);
+    return move_tensor(dest, res);
+}
+
+// The storage types run through the kernels of their compute type, the result being rounded back once. b is converted
+// along with a, unless it holds the axis of a softmax or a reduction.
+static Tensor* storage_op_tensor(Tensor* c, Tensor a, Tensor b, OperatorFlag op_flag) {
+    const DataType compute_type = COMPUTE_DATA_TYPE(a.data_type);
+    Tensor a_copy = empty_tensor(compute_type);
+    Tensor b_copy = empty_tensor(compute_type);
+    Tensor res = empty_tensor(compute_type);
+    Tensor b_compute = b;
+    long double scalar = 0.0L;
+    cast_tensor(&a_copy, a, compute_type);
+    b_compute.data_type = compute_type;
+    if (b.rank) b_compute = *cast_tensor(&b_copy, b, compute_type);
+    else if ((b.data != NULL) && (op_flag != SOFTMAX) && (op_flag != LOG_SOFTMAX) && (op_flag != REDUCE)) b_compute.data = ASSIGN(&scalar, read_data_type(b.data, b.data_type), compute_type);
+    op_tensor(&res, a_copy, b_compute, op_flag);
+    cast_tensor(c, res, a.data_type);
+    DEALLOCATE_TENSORS(a_copy, b_copy, res);
+    return c;
+}
+
+// Count of the trailing dimensions of a contracted by DOT with the matching leading ones of b
+static unsigned int dot_similar_indices(Tensor a, Tensor b) {
+    unsigned int similar_indices_count = 0;
+    for (unsigned int i = 0; i < (a.rank - 1) && i < (b.rank - 1); ++i, ++similar_indices_count) {
+        if (b.shape[i] != a.shape[a.rank - i - 1]) break;
+    }
+    return similar_indices_count;
+}
+
+// Writes a . b into the contiguous res, or adds it to res when accumulate is set. Strided operands go straight to gemm,
+// unless their dimensions can not be walked as a matrix.
+static void gemm_tensors(Tensor res, Tensor a, Tensor b, unsigned int similar_indices_count, bool accumulate) {
+    const size_t ext_size = tensor_size(a.shape, a.rank - similar_indices_count);
+    const size_t int_size = tensor_size(b.shape + similar_indices_count, b.rank - similar_indices_count);
+    const size_t common_size = tensor_size(a.shape + (a.rank - similar_indices_count), similar_indices_count);
+    Tensor a_copy = empty_tensor(a.data_type);
+    Tensor b_copy = empty_tensor(b.data_type);
+    size_t rs_a = 0, cs_a = 0, rs_b = 0, cs_b = 0;
+    if (!matrix_strides(a, a.rank - similar_indices_count, &rs_a, &cs_a)) {
+        copy_tensor(&a_copy, a);
+        matrix_strides(a_copy, a.rank - similar_indices_count, &rs_a, &cs_a);
+    }
+    if (!matrix_strides(b, similar_indices_count, &rs_b, &cs_b)) {
+        copy_tensor(&b_copy, b);
+        matrix_strides(b_copy, similar_indices_count, &rs_b, &cs_b);
+    }
+    gemm(a.data_type, ext_size, int_size, common_size, a_copy.data != NULL ? a_copy.data : a.data, rs_a, cs_a, b_copy.data != NULL ? b_copy.data : b.data, rs_b, cs_b, res.data, int_size, accumulate);
+    DEALLOCATE_TENSORS(a_copy, b_copy);
+    return;
+}
+
 Tensor* op_tensor(Tensor* c, Tensor a, Tensor b, OperatorFlag op_flag) {
-    const bool is_special_operand_flag = (op_flag == EXP) || (op_flag == TANH) || (op_flag == POW) || (op_flag == LOG) || (op_flag == ABS) || (op_flag == NORM) || (op_flag == SOFTMAX) || (op_flag == CONJUGATE) || (op_flag == DOT);
     ASSERT(!is_valid_enum(op_flag, (unsigned char*) operators_flags, ARR_SIZE(operators_flags)), "INVALID_OPERATOR");
-    ASSERT(!is_special_operand_flag && (a.rank != b.rank), "DIM_MISMATCH");
     ASSERT(a.data_type != b.data_type, "DATA_TYPE_MISMATCH");
-    for (unsigned int i = 0; !is_special_operand_flag && (i < a.rank); ++i) ASSERT(a.shape[i] != b.shape[i], "SHAPE_MISMATCH");
+    // INT_8 operands of DOT run the integer gemm, accumulating into INT_32
+    const bool is_integer_dot = (op_flag == DOT) && (a.data_type == INT_8);
+    if (!IS_COMPUTE_TYPE(a.data_type) && !is_integer_dot) return storage_op_tensor(c, a, b, op_flag);
+    if (op_flag == REDUCE) return reduce_tensor(c, a, *CAST_PTR(b.data, Reduction));
+    const DataType res_type = is_integer_dot ? INT_32 : a.data_type;
 
-    Tensor temp = alloc_tensor(a.shape, a.rank, a.data_type);
-    unsigned int size = tensor_size(a.shape, a.rank);
+    size_t size = tensor_size(a.shape, a.rank);
     unsigned int similar_indices_count = 0;
+    size_t* new_shape = a.shape;
+    unsigned int new_rank = a.rank;
+
+    // Element-wise operands broadcast against each other, none of them is ever expanded in memory
+    const bool is_broadcast = IS_BINARY_KERNEL(op_flag) && !has_shape(b, a.shape, a.rank, a.data_type);
+    if (is_broadcast) {
+        new_rank = MAX(a.rank, b.rank);
+        new_shape = (size_t*) alloc_memory(new_rank, sizeof(size_t));
+        ASSERT(!broadcast_shape(a, b, new_shape, new_rank), "SHAPE_MISMATCH");
+    } else if (op_flag == DOT) {
+        similar_indices_count = dot_similar_indices(a, b);
+        new_rank = a.rank + b.rank - (2 * similar_indices_count);
+        new_shape = (size_t*) alloc_memory(new_rank, sizeof(size_t));
+        mem_copy(new_shape, a.shape, sizeof(size_t), a.rank - similar_indices_count);
+        mem_copy(new_shape + (a.rank - similar_indices_count), b.shape + similar_indices_count, sizeof(size_t), b.rank - similar_indices_count);
+    }
 
-    if (op_flag == DOT) {
-        for (unsigned int i = 0; i < (a.rank - 1) && i < (b.rank - 1); ++i, ++similar_indices_count) {
-            if (b.shape[i] != a.shape[a.rank - i - 1]) break;
-        }
-        unsigned int new_rank = a.rank + b.rank - (2 * similar_indices_count);
-        unsigned int* new_shape = (unsigned int*) calloc(new_rank, sizeof(unsigned int));
-        mem_copy(new_shape, a.shape, a.rank - similar_indices_count, sizeof(unsigned int));
-        mem_copy(new_shape + (a.rank - similar_indices_count), b.shape + similar_indices_count, b.rank - similar_indices_count, sizeof(unsigned int));
-        reshape_tensor(&temp, new_shape, new_rank, a.data_type);
-        free(new_shape);
-
-        unsigned int ext_size = tensor_size(a.shape, a.rank - similar_indices_count);
-        unsigned int int_size = tensor_size(b.shape + similar_indices_count, b.rank - similar_indices_count);
-        unsigned int common_size = tensor_size(a.shape + (a.rank - similar_indices_count), similar_indices_count);
-
-        void* tmp = (void*) calloc(1, a.data_type);
-        for (unsigned int i = 0; i < ext_size; ++i) {
-            for (unsigned int j = 0; j < int_size; ++j) {
-                for (unsigned int k = 0; k < common_size; ++k) {
-                    SCALAR_MUL(tmp, CAST_PTR_AT_INDEX(a.data, i * common_size + k, a.data_type), CAST_PTR_AT_INDEX(b.data, k * int_size + j, b.data_type), a.data_type);
-                    SCALAR_SUM(CAST_PTR_AT_INDEX(temp.data, i * int_size + j, temp.data_type), CAST_PTR_AT_INDEX(temp.data, i * int_size + j, temp.data_type), tmp, temp.data_type);
-                }
-            }
-        }
+    // c is written in place when it already has the result shape and a contiguous layout, a DOT result, or an operand
+    // laid out differently in the same buffer, would be overwritten while still being read though. Otherwise the result
+    // goes to a new buffer, swapped into c once the operands have been read.
+    const bool is_binary = IS_BINARY_KERNEL(op_flag) || (op_flag == DOT);
+    const bool is_aliased = (c -> data != NULL) && ((TENSOR_STORAGE(*c) == TENSOR_STORAGE(a)) || (is_binary && (TENSOR_STORAGE(*c) == TENSOR_STORAGE(b))));
+    const bool is_overlapped = is_overlapping(*c, a) || (is_binary && is_overlapping(*c, b));
+    const bool is_reusable = has_shape(*c, new_shape, new_rank, res_type) && is_contiguous(*c) && !is_overlapped && !((op_flag == DOT) && is_aliased);
+    Tensor res = is_reusable ? *c : alloc_tensor_uninit(new_shape, new_rank, res_type);
+    if (new_shape != a.shape) free_memory(new_shape);
+    new_shape = res.shape;
+
+    if (op_flag == DOT) gemm_tensors(res, a, b, similar_indices_count, FALSE);
+    else if (op_flag == NORM) {
+        Tensor norm = empty_tensor(a.data_type);
+        reduce_tensor(&norm, a, (Reduction) { .flag = REDUCE_NORM, .axes = 0, .keepdims = FALSE, .p = read_data_type(b.data, b.data_type) });
+        fill_tensor(norm.data, res);
+        DEALLOCATE_TENSORS(norm);
+    } else if ((op_flag == SOFTMAX) || (op_flag == LOG_SOFTMAX)) {
+        // b holds the axis the rows run along, the last one when unset
+        const unsigned int axis = (b.data != NULL) ? *CAST_PTR(b.data, unsigned int) : a.rank - 1;
+        ASSERT(axis >= a.rank, "INVALID_AXIS");
+        Tensor a_copy = empty_tensor(a.data_type);
+        if (!is_contiguous(a)) copy_tensor(&a_copy, a);
+        run_softmax_kernel(a.data_type, op_flag == LOG_SOFTMAX, res.data, a_copy.data != NULL ? a_copy.data : a.data, tensor_size(a.shape, axis), a.shape[axis], tensor_size(a.shape + axis + 1, a.rank - axis - 1));
+        DEALLOCATE_TENSORS(a_copy);
+    }
+    else if (is_broadcast) {
+        Tensor a_broadcast = broadcast_operand(a, new_shape, new_rank);
+        Tensor b_broadcast = broadcast_operand(b, new_shape, new_rank);
+        run_strided_kernel(op_flag, res, a_broadcast, b_broadcast);
+        DEALLOCATE_MEMORY(a_broadcast.strides, b_broadcast.strides);
+    }
+    else if (is_contiguous(a) && (!IS_BINARY_KERNEL(op_flag) || is_contiguous(b))) run_kernel(op_flag, res.data_type, res.data, a.data, b.data, size);
+    else run_strided_kernel(op_flag, res, a, b);
 
-        free(tmp);
-
-    } else if (op_flag == NORM) {
-        void* tmp = calloc(1, a.data_type);
-        void* tpm = calloc(1, a.data_type);
-        unsigned int size = tensor_size(a.shape, a.rank);
-        for (unsigned int i = 0; i < size; ++i) SCALAR_SUM(tmp, SCALAR_POW(tpm, SCALAR_ABS(tpm, CAST_PTR_AT_INDEX(a.data, i, a.data_type), a.data_type), b.data, a.data_type), tmp, a.data_type);
-        SCALAR_POW(tmp, tmp, SCALAR_DIV(tpm, ASSIGN(tpm, 1.0L, a.data_type), b.data, a.data_type), a.data_type);
-        fill_tensor(tmp, temp);
-        DEALLOCATE_PTRS(tmp, tpm);
-    } else if (op_flag == SOFTMAX) {
-        Tensor norm_tensor = empty_tensor(a.data_type);
-        void* val = calloc(1, a.data_type);
-        ASSIGN(val, 1.0L, a.data_type);
-        NORM_TENSOR(&norm_tensor, a, val);
-        DIVIDE_TENSOR(&temp, a, norm_tensor);
-        DEALLOCATE_TENSORS(norm_tensor);
-        free(val);
-    }
-    else if (op_flag == POW) for (unsigned int i = 0; i < size; ++i) SCALAR_POW(CAST_PTR_AT_INDEX(temp.data, i, temp.data_type), CAST_PTR_AT_INDEX(a.data, i, temp.data_type), b.data, temp.data_type);
-    else if (is_special_operand_flag) for (unsigned int i = 0; i < size; ++i) CAST_AND_SINGLE_OP_INDEX(a.data, temp.data, i, temp.data_type, op_flag);
-    else for (unsigned int i = 0; i < size; ++i) CAST_AND_OP_INDEX(a.data, b.data, temp.data, i, temp.data_type, op_flag);
-
-    copy_tensor(c, temp);
-    DEALLOCATE_TENSORS(temp);
+    if (!is_reusable) move_tensor(c, res);
 
     return c;
 }
 
-Tensor* scalar_op_tensor(Tensor* tensor, void* scalar, OperatorFlag op_flag) {
-    ASSERT(!is_valid_enum(op_flag, (unsigned char*) operators_flags, ARR_SIZE(operators_flags)), "INVALID_OPERATOR");
-    Tensor scalar_tensor = alloc_tensor(tensor -> shape, tensor -> rank, tensor -> data_type);
-    fill_tensor(scalar, scalar_tensor);
-    op_tensor(tensor, *tensor, scalar_tensor, op_flag);
-    DEALLOCATE_TENSORS(scalar_tensor);
-    return tensor;
+Tensor* op_tensor_inplace(Tensor* a, Tensor b, OperatorFlag op_flag) {
+    return op_tensor(a, *a, b, op_flag);
 }
 
-Tensor* contract_tensor(Tensor* tensor, unsigned int contraction_index_a, unsigned int contraction_index_b) {
-    ASSERT((contraction_index_a == contraction_index_b) || (contraction_index_a >= tensor -> rank) || (contraction_index_b >= tensor -> rank), "INVALID_CONTRACTION_INDICES");
-    ASSERT(tensor -> rank % 2, "INVALID_CONTRACTION_NUM");
+// Adds a . b to c in place, c holding the shape of the product in a contiguous buffer none of the operands overlaps
+Tensor* accumulate_dot_tensor(Tensor* c, Tensor a, Tensor b) {
+    ASSERT(a.data_type != b.data_type || a.data_type != c -> data_type, "DATA_TYPE_MISMATCH");
+    const unsigned int similar_indices_count = dot_similar_indices(a, b);
+    const unsigned int ext_rank = a.rank - similar_indices_count;
+    ASSERT(c -> rank != ext_rank + b.rank - similar_indices_count, "SHAPE_MISMATCH");
+    for (unsigned int i = 0; i < c -> rank; ++i) ASSERT(c -> shape[i] != (i < ext_rank ? a.shape[i] : b.shape[similar_indices_count + i - ext_rank]), "SHAPE_MISMATCH");
+    ASSERT(!is_contiguous(*c) || is_overlapping(*c, a) || is_overlapping(*c, b), "INVALID_ACCUMULATOR");
+    gemm_tensors(*c, a, b, similar_indices_count, TRUE);
+    return c;
+}
 
-    unsigned int* new_shape = (unsigned int*) calloc(tensor -> rank - 2, sizeof(unsigned int));
-    for (unsigned int i = 0; i < MIN(contraction_index_a, contraction_index_b); ++i) new_shape[i] = tensor -> shape[i];
-    for (unsigned int i = MAX(contraction_index_a, contraction_index_b) + 1; i < tensor -> rank; ++i) new_shape[i - 2] = tensor -> shape[i];
-    unsigned int* counter = (unsigned int*) calloc(tensor -> rank - 2, sizeof(unsigned int));
-    Tensor temp = alloc_tensor(new_shape, tensor -> rank - 2, tensor -> data_type);
-    free(new_shape);
-
-    unsigned int new_size = tensor_size(temp.shape, temp.rank);
-    for (unsigned int ind = 0; ind < new_size; ++ind) {
-        unsigned int tensor_index = 0;
-        unsigned int temp_index = 0;
-        for (unsigned int d = tensor -> rank - 1; (int) d >= 0; --d) {
-            if ((d == contraction_index_a) || (d == contraction_index_b)) continue;
-            unsigned int counter_index = (d > MAX(contraction_index_a, contraction_index_b)) ? d - 2 : d;
-            tensor_index += calc_shape_offset(tensor -> shape, d, tensor -> rank) * counter[counter_index];
-            temp_index += calc_shape_offset(temp.shape, counter_index, temp.rank) * counter[counter_index];
+// Reduces a over a run of consecutive axes at a time, from the innermost one, the axes reduced by a pass being kept
+// with size 1 for the next ones. Only the first pass reads a: the later ones combine partial results, so the norms and
+// the means are finalized once every axis has been reduced. The indices of REDUCE_ARGMAX are stored as values of the
+// data type of a, counted along the run of axes, that must therefore be a single one.
+Tensor* reduce_tensor(Tensor* c, Tensor a, Reduction reduction) {
+    ASSERT(!is_valid_enum(reduction.flag, (unsigned char*) reduction_flags, ARR_SIZE(reduction_flags)), "INVALID_REDUCTION_FLAG");
+    ASSERT(!a.rank || (a.rank > REDUCE_MAX_RANK), "INVALID_RANK");
+    const unsigned int all_axes = (a.rank == REDUCE_MAX_RANK) ? ~0u : AXIS(a.rank) - 1;
+    const unsigned int axes = reduction.axes ? reduction.axes : all_axes;
+    ASSERT(axes & ~all_axes, "INVALID_AXIS");
+    const unsigned int highest_axis = 31 - __builtin_clz(axes);
+    ASSERT((reduction.flag == REDUCE_ARGMAX) && ((axes >> __builtin_ctz(axes)) & ((axes >> __builtin_ctz(axes)) + 1)), "ARGMAX_AXES_NOT_CONSECUTIVE");
+    ASSERT((reduction.flag == REDUCE_NORM) && (reduction.p <= 0.0L), "INVALID_NORM_ORDER");
+
+    size_t* shape = (size_t*) alloc_memory(a.rank, sizeof(size_t));
+    mem_copy(shape, a.shape, sizeof(size_t), a.rank);
+    Tensor res = empty_tensor(a.data_type);
+    if (!is_contiguous(a)) copy_tensor(&res, a);
+    void* src = (res.data != NULL) ? res.data : a.data;
+
+    size_t count = 1;
+    ReductionFlag flag = reduction.flag;
+    for (unsigned int d = highest_axis + 1; d-- > 0;) {
+        if (!(axes & AXIS(d))) continue;
+        unsigned int from = d;
+        while (from && (axes & AXIS(from - 1))) from--;
+        const size_t outer = tensor_size(shape, from);
+        const size_t n = tensor_size(shape + from, d + 1 - from);
+        const size_t inner = tensor_size(shape + d + 1, a.rank - d - 1);
+        for (unsigned int i = from; i <= d; ++i) shape[i] = 1;
+
+        Tensor out = alloc_tensor_uninit(shape, a.rank, a.data_type);
+        Tensor index = (flag == REDUCE_ARGMAX) ? alloc_tensor_uninit(shape, a.rank, a.data_type) : empty_tensor(a.data_type);
+        run_reduce_kernel(a.data_type, flag, reduction.p, out.data, index.data, src, outer, n, inner);
+        DEALLOCATE_TENSORS(res);
+        if (flag == REDUCE_ARGMAX) {
+            res = index;
+            DEALLOCATE_TENSORS(out);
+        } else {
+            res = out;
+            DEALLOCATE_TENSORS(index);
         }
+        src = res.data;
+        count *= n;
+        flag = ((flag == REDUCE_MEAN) || (flag == REDUCE_NORM)) ? REDUCE_SUM : flag;
+        d = from;
+    }
+
+    void* scalar = &(long double) {0};
+    if (reduction.flag == REDUCE_MEAN) SCALAR_MUL_TENSOR(&res, ASSIGN(scalar, 1.0L / count, a.data_type));
+    else if ((reduction.flag == REDUCE_NORM) && (reduction.p == 2.0L)) INPLACE_SQRT_TENSOR(&res);
+    else if ((reduction.flag == REDUCE_NORM) && (reduction.p != 1.0L)) scalar_op_tensor(&res, ASSIGN(scalar, 1.0L / reduction.p, a.data_type), POW);
 
-        const unsigned int offset_a = calc_shape_offset(tensor -> shape, contraction_index_a, tensor -> rank);
-        const unsigned int offset_b = calc_shape_offset(tensor -> shape, contraction_index_b, tensor -> rank);
-        for (unsigned int s = 0; s < tensor -> shape[contraction_index_a]; ++s) {
-            SCALAR_SUM(CAST_PTR_AT_INDEX(temp.data, temp_index, temp.data_type), CAST_PTR_AT_INDEX(temp.data, temp_index, temp.data_type), CAST_PTR_AT_INDEX(tensor -> data, tensor_index + s * offset_a + s * offset_b, tensor -> data_type), temp.data_type);
+    // A reduction over every axis keeps a single one, of size 1
+    if (!reduction.keepdims) {
+        unsigned int rank = 0;
+        for (unsigned int i = 0; i < a.rank; ++i) {
+            if (!(axes & AXIS(i))) shape[rank++] = a.shape[i];
         }
+        if (!rank) shape[rank++] = 1;
+        free_memory(res.shape);
+        res.shape = (size_t*) alloc_memory(rank, sizeof(size_t));
+        mem_copy(res.shape, shape, sizeof(size_t), rank);
+        res.rank = rank;
+    }
+    free_memory(shape);
+
+    return move_tensor(c, res);
+}
+
+Tensor* scalar_op_tensor(Tensor* tensor, void* scalar, OperatorFlag op_flag) {
+    ASSERT(!is_valid_enum(op_flag, (unsigned char*) operators_flags, ARR_SIZE(operators_flags)), "INVALID_OPERATOR");
+    // A rank 0 operand broadcasts the scalar over the whole tensor
+    Tensor scalar_tensor = { .shape = NULL, .strides = NULL, .rank = 0, .data = scalar, .storage = NULL, .data_type = tensor -> data_type, .grad_node = NULL };
+    return op_tensor(tensor, *tensor, scalar_tensor, op_flag);
+}
 
-        unsigned int p = 0;
-        for (p = 0; p < temp.rank; ++p) if (!((ind + 1) % calc_shape_offset(temp.shape, p, temp.rank))) break;
-        (counter[p])++;
-        for (unsigned int index = p + 1; index < temp.rank; ++index) counter[index] = 0;
+Tensor* contract_tensor(Tensor* tensor, unsigned int contraction_index_a, unsigned int contraction_index_b) {
+    ASSERT((contraction_index_a == contraction_index_b) || (contraction_index_a >= tensor -> rank) || (contraction_index_b >= tensor -> rank), "INVALID_CONTRACTION_INDICES");
+    ASSERT(tensor -> rank % 2, "INVALID_CONTRACTION_NUM");
+    ASSERT(tensor -> shape[contraction_index_a] != tensor -> shape[contraction_index_b], "SHAPE_MISMATCH");
+
+    // The diagonal of the two indices is a view stepping along both at once, which the reduction engine sums away
+    const unsigned int index_a = MIN(contraction_index_a, contraction_index_b);
+    const unsigned int index_b = MAX(contraction_index_a, contraction_index_b);
+    Tensor diagonal = { .shape = NULL, .strides = NULL, .rank = tensor -> rank - 1, .data = tensor -> data, .storage = TENSOR_STORAGE(*tensor), .data_type = tensor -> data_type, .grad_node = NULL };
+    diagonal.shape = (size_t*) alloc_memory(diagonal.rank, sizeof(size_t));
+    diagonal.strides = (size_t*) alloc_memory(diagonal.rank, sizeof(size_t));
+    for (unsigned int d = 0, i = 0; d < tensor -> rank; ++d) {
+        if (d == index_b) continue;
+        diagonal.shape[i] = tensor -> shape[d];
+        diagonal.strides[i++] = stride_at(*tensor, d) + ((d == index_a) ? stride_at(*tensor, index_b) : 0);
     }
 
-    copy_tensor(tensor, temp);
-    DEALLOCATE_TENSORS(temp);
-    free(counter);
+    Tensor res = empty_tensor(tensor -> data_type);
+    REDUCE_SUM_TENSOR(&res, diagonal, AXIS(index_a), FALSE);
+    // Contracting the only two indices leaves a rank 0 tensor
+    res.rank = tensor -> rank - 2;
+    DEALLOCATE_MEMORY(diagonal.shape, diagonal.strides);
 
+    return move_tensor(tensor, res);
+}
+
+Tensor* contiguous_tensor(Tensor* tensor) {
+    if (!is_contiguous(*tensor)) detach_tensor(tensor);
     return tensor;
 }
 
-Tensor* transpose_tensor(Tensor* tensor) {
-    unsigned int rows = 0, cols = 0;
-    matricize_tensor(*tensor, &rows, &cols);
+// Reorders the dimensions of the tensor, which stays a view of the same buffer
+Tensor* permute_tensor(Tensor* tensor, unsigned int* axes) {
+    size_t* old_layout = (size_t*) alloc_memory(2 * tensor -> rank, sizeof(size_t));
+    for (unsigned int i = 0; i < tensor -> rank; ++i) {
+        ASSERT(axes[i] >= tensor -> rank || old_layout[axes[i]], "INVALID_PERMUTATION");
+        old_layout[axes[i]] = 1;
+    }
 
-    unsigned int* new_shape = (unsigned int*) calloc(tensor -> rank, sizeof(unsigned int));
     for (unsigned int i = 0; i < tensor -> rank; ++i) {
-        new_shape[i] = tensor -> shape[tensor -> rank - i - 1];
+        old_layout[i] = tensor -> shape[i];
+        old_layout[tensor -> rank + i] = stride_at(*tensor, i);
+    }
+    if (tensor -> strides == NULL) tensor -> strides = (size_t*) alloc_memory(tensor -> rank, sizeof(size_t));
+    for (unsigned int i = 0; i < tensor -> rank; ++i) {
+        tensor -> shape[i] = old_layout[axes[i]];
+        tensor -> strides[i] = old_layout[tensor -> rank + axes[i]];
     }
-    free(tensor -> shape);
-    tensor -> shape = new_shape;
+    free_memory(old_layout);
 
-    if (tensor -> rank == 1) return tensor;
+    return tensor;
+}
 
-    Tensor temp = alloc_tensor(new_shape, tensor -> rank, tensor -> data_type);
+// Reverses the order of the dimensions without moving any data, see contiguous_tensor to lay it out again
+Tensor* transpose_tensor(Tensor* tensor) {
+    if (tensor -> rank < 2) return tensor;
 
-    for (unsigned int i = 0; i < rows; ++i) {
-        for (unsigned int j = 0; j < cols; ++j) {
-            mem_copy(CAST_PTR_AT_INDEX(temp.data, j * rows + i, temp.data_type), CAST_PTR_AT_INDEX(tensor -> data, i * cols + j, tensor -> data_type), tensor -> data_type, 1);
-        }
+    if (tensor -> strides == NULL) {
+        tensor -> strides = (size_t*) alloc_memory(tensor -> rank, sizeof(size_t));
+        for (unsigned int i = 0; i < tensor -> rank; ++i) tensor -> strides[i] = calc_shape_offset(tensor -> shape, i, tensor -> rank);
     }
 
-    copy_tensor(tensor, temp);
-    DEALLOCATE_TENSORS(temp);
+    for (unsigned int i = 0; i < tensor -> rank / 2; ++i) {
+        const unsigned int j = tensor -> rank - i - 1;
+        size_t temp = tensor -> shape[i];
+        tensor -> shape[i] = tensor -> shape[j];
+        tensor -> shape[j] = temp;
+        temp = tensor -> strides[i];
+        tensor -> strides[i] = tensor -> strides[j];
+        tensor -> strides[j] = temp;
+    }
 
     return tensor;
 }
 
-Tensor identity_tensor(unsigned int shape_base, unsigned int rank, DataType data_type) {
-    unsigned int shape[] = {shape_base, shape_base};
+Tensor identity_tensor(size_t shape_base, unsigned int rank, DataType data_type) {
+    size_t shape[] = {shape_base, shape_base};
     Tensor tensor = alloc_tensor(shape, rank, data_type);
-    for (unsigned int i = 0; i < shape_base; ++i) ASSIGN(CAST_PTR_AT_INDEX(tensor.data, i * shape_base + i, tensor.data_type), 1.0L, tensor.data_type);
+    for (size_t i = 0; i < shape_base; ++i) ASSIGN(CAST_PTR_AT_INDEX(tensor.data, i * shape_base + i, tensor.data_type), 1.0L, tensor.data_type);
     return tensor;
 }
 
-Tensor* extract_tensor(Tensor* out, Tensor tensor, unsigned int index, unsigned int index_dim) {
+Tensor* extract_tensor(Tensor* out, Tensor tensor, size_t index, unsigned int index_dim) {
     unsigned int new_dim = tensor.rank - index_dim;
-    unsigned int* new_shape = (unsigned int*) calloc(new_dim, sizeof(unsigned int));
-    new_shape[0] = 1;
-    for (unsigned int i = 1; i < new_dim; ++i) new_shape[i] = tensor.shape[i + index_dim];
-    reshape_tensor(out, new_shape, new_dim, tensor.data_type);
-    free(new_shape);
-    unsigned int offset = calc_shape_offset(tensor.shape, index_dim, tensor.rank) * index;
-    mem_copy(out -> data, CAST_PTR_AT_INDEX(tensor.data, offset, tensor.data_type), tensor.data_type, tensor_size(out -> shape, out -> rank));
-    return out;
+    Tensor view = make_view(tensor, new_dim);
+    view.shape[0] = 1;
+    view.strides[0] = stride_at(tensor, index_dim);
+    for (unsigned int i = 1; i < new_dim; ++i) {
+        view.shape[i] = tensor.shape[i + index_dim];
+        view.strides[i] = stride_at(tensor, i + index_dim);
+    }
+    view.data = CAST_PTR_AT_INDEX(tensor.data, stride_at(tensor, index_dim) * index, tensor.data_type);
+    return move_tensor(out, view);
+}
+
+Tensor* slice_tensor(Tensor* dest, Tensor src, unsigned int axis, size_t start, size_t end) {
+    ASSERT(axis >= src.rank, "INVALID_AXIS");
+    ASSERT(start >= end || end > src.shape[axis], "INVALID_SLICE");
+    Tensor view = make_view(src, src.rank);
+    for (unsigned int i = 0; i < src.rank; ++i) {
+        view.shape[i] = src.shape[i];
+        view.strides[i] = stride_at(src, i);
+    }
+    view.shape[axis] = end - start;
+    view.data = CAST_PTR_AT_INDEX(src.data, view.strides[axis] * start, src.data_type);
+    return move_tensor(dest, view);
+}
+
+// Only a strided src, whose elements can not be walked in row-major order, gets copied first
+Tensor* view_tensor(Tensor* dest, Tensor src, size_t* shape, unsigned int rank) {
+    ASSERT(!is_valid_shape(shape, rank), "INVALID_TENSOR_SHAPE");
+    ASSERT(tensor_size(shape, rank) != tensor_size(src.shape, src.rank), "SIZE_MISMATCH");
+
+    Tensor view = { 0 };
+    if (is_contiguous(src)) view = make_view(src, rank);
+    else {
+        Tensor temp = empty_tensor(src.data_type);
+        view = make_view(*copy_tensor(&temp, src), rank);
+        DEALLOCATE_TENSORS(temp);
+    }
+
+    mem_copy(view.shape, shape, sizeof(size_t), rank);
+    for (unsigned int i = 0; i < rank; ++i) view.strides[i] = calc_shape_offset(shape, i, rank);
+
+    return move_tensor(dest, view);
 }
 
 Tensor* concat_tensors(Tensor* dest, Tensor src) {
@@ -408,79 +994,180 @@ Tensor* concat_tensors(Tensor* dest, Tensor src) {
     }
 
     ASSERT(dest -> data_type != src.data_type, "DATA_TYPE_MISMATCH");
-    unsigned int size = tensor_size(src.shape, src.rank);
-    unsigned int offset = tensor_size(dest -> shape, dest -> rank);
+    // A view can not grow the buffer it shares
+    if (dest -> storage != NULL || !is_contiguous(*dest)) detach_tensor(dest);
+    size_t size = tensor_size(src.shape, src.rank);
+    size_t offset = tensor_size(dest -> shape, dest -> rank);
     ASSERT(size % (offset / dest -> shape[0]), "INVALID_SHAPE");
+    ASSERT(size > SIZE_MAX - offset, "SIZE_OVERFLOW");
     dest -> shape[0] += size / (offset / dest -> shape[0]);
-    dest -> data = realloc(dest -> data, dest -> data_type * (size + offset));
+    dest -> data = realloc_memory(dest -> data, checked_mul(size + offset, DATA_TYPE_SIZE(dest -> data_type)));
 
-    mem_copy(CAST_PTR_AT_INDEX(dest -> data, offset, dest -> data_type), src.data, dest -> data_type, size);
+    gather_tensor(CAST_PTR_AT_INDEX(dest -> data, offset, dest -> data_type), src);
     return dest;
 }
 
+// Sums src over the dimensions it was broadcast along, bringing it back to shape
+Tensor* sum_to_shape(Tensor* dest, Tensor src, size_t* shape, unsigned int rank) {
+    ASSERT(rank > src.rank, "DIM_MISMATCH");
+    for (unsigned int i = 0; i < rank; ++i) ASSERT((shape[rank - i - 1] != 1) && (shape[rank - i - 1] != src.shape[src.rank - i - 1]), "SHAPE_MISMATCH");
+
+    // The leading dimensions missing from shape and those it holds as 1 are summed through the reduction engine
+    unsigned int axes = 0;
+    for (unsigned int d = 0; d < src.rank; ++d) {
+        if ((d < src.rank - rank) || ((shape[d - (src.rank - rank)] == 1) && (src.shape[d] != 1))) axes |= AXIS(d);
+    }
+
+    Tensor res = empty_tensor(src.data_type);
+    if (axes) REDUCE_SUM_TENSOR(&res, src, axes, TRUE);
+    else copy_tensor(&res, src);
+    free_memory(res.shape);
+    res.shape = (size_t*) alloc_memory(rank, sizeof(size_t));
+    mem_copy(res.shape, shape, sizeof(size_t), rank);
+    res.rank = rank;
+
+    return move_tensor(dest, res);
+}
+
 Tensor* flatten_tensor(Tensor* dest, Tensor src) {
     ASSERT(dest -> data_type != src.data_type, "DATA_TYPE_MISMATCH");
-    unsigned int size = tensor_size(src.shape, src.rank);
-    unsigned int new_shape[] = { size };
-    reshape_tensor(dest, new_shape, 1, dest -> data_type);
-    mem_copy(dest -> data, src.data, dest -> data_type, size);
-    return dest;
+    size_t new_shape[] = { tensor_size(src.shape, src.rank) };
+    return view_tensor(dest, src, new_shape, 1);
 }
 
+// The leading rows of src are copied into dest, src is left as a view of the remaining ones
 Tensor* cut_tensor(Tensor* dest, Tensor* src) {
     ASSERT(dest -> data_type != src -> data_type, "DATA_TYPE_MISMATCH");
 
-    unsigned int cut_size = tensor_size(dest -> shape, dest -> rank);
-    unsigned int src_size = tensor_size(src -> shape, src -> rank);
+    size_t cut_size = tensor_size(dest -> shape, dest -> rank);
+    size_t src_size = tensor_size(src -> shape, src -> rank);
     ASSERT(src_size < cut_size, "SIZE_MISMATCH");
     ASSERT(cut_size % (src_size / src -> shape[0]), "INVALID_SHAPE");
-    mem_copy(dest -> data, src -> data, dest -> data_type, cut_size);
 
-    void* new_ptr = calloc(src_size - cut_size, src -> data_type);
-    mem_copy(new_ptr, CAST_PTR_AT_INDEX(src -> data, cut_size, src -> data_type), src -> data_type, src_size - cut_size);
-    free(src -> data);
-    src -> data = new_ptr;
-    src -> shape[0] -= cut_size / (src_size / src -> shape[0]);
+    const size_t cut_rows = cut_size / (src_size / src -> shape[0]);
+    Tensor head = empty_tensor(src -> data_type);
+    gather_tensor(dest -> data, *slice_tensor(&head, *src, 0, 0, cut_rows));
+    DEALLOCATE_TENSORS(head);
+
+    if (src -> storage == NULL) src -> storage = src -> data;
+    src -> data = CAST_PTR_AT_INDEX(src -> data, stride_at(*src, 0) * cut_rows, src -> data_type);
+    src -> shape[0] -= cut_rows;
 
     return dest;
 }
 
+// Picks the scales and zero points mapping the range of every channel, widened to hold 0, onto the INT_8 values: the
+// symmetric quantizations map [-max |x|, max |x|] onto [-127, 127] with a zero point of 0, as the integer gemm expects
+Quantization compute_quantization(Tensor tensor, int axis, bool is_symmetric) {
+    ASSERT((axis != QUANTIZE_PER_TENSOR) && ((axis < 0) || ((unsigned int) axis >= tensor.rank)), "INVALID_AXIS");
+    Quantization quantization = { .scales = NULL, .zero_points = NULL, .channels = (axis == QUANTIZE_PER_TENSOR) ? 1 : tensor.shape[axis], .axis = axis };
+    quantization.scales = (float*) alloc_memory(quantization.channels, sizeof(float));
+    quantization.zero_points = (int*) alloc_memory(quantization.channels, sizeof(int));
+    ASSERT(quantization.scales == NULL || quantization.zero_points == NULL, "BAD_MEMORY");
+
+    // The range of every channel is reduced over all the other axes
+    Tensor values = empty_tensor(FLOAT_32);
+    Tensor mins = empty_tensor(FLOAT_32);
+    Tensor maxs = empty_tensor(FLOAT_32);
+    cast_tensor(&values, tensor, FLOAT_32);
+    if ((axis != QUANTIZE_PER_TENSOR) && (tensor.rank == 1)) {
+        copy_tensor(&mins, values);
+        copy_tensor(&maxs, values);
+    } else {
+        const unsigned int axes = (axis == QUANTIZE_PER_TENSOR) ? 0 : ((tensor.rank == REDUCE_MAX_RANK) ? ~0u : AXIS(tensor.rank) - 1) & ~AXIS(axis);
+        REDUCE_MIN_TENSOR(&mins, values, axes, FALSE);
+        REDUCE_MAX_TENSOR(&maxs, values, axes, FALSE);
+    }
+
+    for (size_t c = 0; c < quantization.channels; ++c) {
+        const float min = MIN(CAST_PTR(mins.data, float)[c], 0.0f);
+        const float max = MAX(CAST_PTR(maxs.data, float)[c], 0.0f);
+        float scale = is_symmetric ? MAX(-min, max) / 127.0f : (max - min) / 255.0f;
+        if (scale == 0.0f) scale = 1.0f;
+        quantization.scales[c] = scale;
+        quantization.zero_points[c] = is_symmetric ? 0 : saturate_int8(-128.0f - min / scale);
+    }
+    DEALLOCATE_TENSORS(values, mins, maxs);
+
+    return quantization;
+}
+
+void deallocate_quantization(Quantization* quantization) {
+    DEALLOCATE_MEMORY(quantization -> scales, quantization -> zero_points);
+    quantization -> scales = NULL;
+    quantization -> zero_points = NULL;
+    return;
+}
+
+// Elements sharing a channel sit in runs of the size of the dimensions after its axis
+static size_t quantization_inner_size(Tensor tensor, Quantization quantization) {
+    if (quantization.axis == QUANTIZE_PER_TENSOR) return tensor_size(tensor.shape, tensor.rank);
+    ASSERT(((unsigned int) quantization.axis >= tensor.rank) || (tensor.shape[quantization.axis] != quantization.channels), "SHAPE_MISMATCH");
+    return tensor_size(tensor.shape + quantization.axis + 1, tensor.rank - quantization.axis - 1);
+}
+
+Tensor* quantize_tensor(Tensor* dest, Tensor src, Quantization quantization) {
+    const size_t inner = quantization_inner_size(src, quantization);
+    Tensor values = empty_tensor(FLOAT_32);
+    if ((src.data_type != FLOAT_32) || !is_contiguous(src)) cast_tensor(&values, src, FLOAT_32);
+    Tensor res = alloc_tensor_uninit(src.shape, src.rank, INT_8);
+    run_quantize_kernel(res.data, values.data != NULL ? values.data : src.data, quantization.scales, quantization.zero_points, tensor_size(src.shape, src.rank), quantization.channels, inner);
+    DEALLOCATE_TENSORS(values);
+    return move_tensor(dest, res);
+}
+
+// src holds INT_8 values, or the INT_32 product of two of them quantized with the product of their scales
+Tensor* dequantize_tensor(Tensor* dest, Tensor src, Quantization quantization) {
+    const size_t inner = quantization_inner_size(src, quantization);
+    Tensor src_copy = empty_tensor(src.data_type);
+    if (!is_contiguous(src)) copy_tensor(&src_copy, src);
+    Tensor res = alloc_tensor_uninit(src.shape, src.rank, FLOAT_32);
+    run_dequantize_kernel(res.data, src_copy.data != NULL ? src_copy.data : src.data, src.data_type, quantization.scales, quantization.zero_points, tensor_size(src.shape, src.rank), quantization.channels, inner);
+    DEALLOCATE_TENSORS(src_copy);
+    return move_tensor(dest, res);
+}
+
 void* tensor_norm(Tensor tensor, void* norm, void* res) {
-    Tensor temp_tensor = empty_tensor(tensor.data_type);
-    flatten_tensor(&temp_tensor, tensor);
-    void* temp = calloc(1, tensor.data_type);
-    unsigned int size = tensor_size(temp_tensor.shape, temp_tensor.rank);
-    for (unsigned int i = 0; i < size; ++i) SCALAR_SUM(temp, CAST_PTR_AT_INDEX(temp_tensor.data, i, temp_tensor.data_type), temp, temp_tensor.data_type);
-    SCALAR_POW(res, temp, norm, tensor.data_type);
-    DEALLOCATE_TENSORS(temp_tensor);
-    free(temp);
+    Tensor sum = empty_tensor(tensor.data_type);
+    REDUCE_SUM_TENSOR(&sum, tensor, 0, FALSE);
+    SCALAR_POW(res, sum.data, norm, tensor.data_type);
+    DEALLOCATE_TENSORS(sum);
     return res;
 }
 
 Tensor* normal(Tensor* tensor) {
-    void* variance = calloc(1, tensor -> data_type);
-    void* mean = calloc(1, tensor -> data_type);
-    ASSIGN(variance, 2.0L / (tensor -> shape[0] + tensor -> shape[1]), tensor -> data_type);
-    unsigned int size = tensor_size(tensor -> shape, tensor -> rank);
-    for (unsigned int i = 0; i < size; ++i) normal_func(CAST_PTR_AT_INDEX(tensor -> data, i, tensor -> data_type), CAST_PTR_AT_INDEX(tensor -> data, i, tensor -> data_type), variance, mean, tensor -> data_type);
-    DEALLOCATE_PTRS(variance, mean);
+    const DataType compute_type = COMPUTE_DATA_TYPE(tensor -> data_type);
+    long double params[2] = {0};
+    ASSIGN(CAST_PTR_AT_INDEX(params, 0, compute_type), 2.0L / (tensor -> shape[0] + tensor -> shape[1]), compute_type);
+    ASSIGN(CAST_PTR_AT_INDEX(params, 1, compute_type), 0.0L, compute_type);
+    Tensor copy = empty_tensor(compute_type);
+    void* data = compute_data(&copy, *tensor);
+    run_normal_kernel(compute_type, data, data, params, tensor_size(tensor -> shape, tensor -> rank));
+    store_compute_data(*tensor, &copy);
     return tensor;
 }
 
 bool comparison_op_tensor(Tensor a, Tensor b, ComparisonFlag cmp_flag) {
     ASSERT(a.data_type != b.data_type, "DATA_TYPE_MISMATCH");
     ASSERT(TENSOR_SIZE(a) != TENSOR_SIZE(b), "SIZE_MISMATCH");
-    for (unsigned int i = 0; i < TENSOR_SIZE(a); ++i) {
-        if (comparison_op(CAST_PTR_AT_INDEX(a.data, i, a.data_type), CAST_PTR_AT_INDEX(b.data, i, b.data_type), a.data_type, cmp_flag) == FALSE) return FALSE;
-    }
-    return TRUE;
+    const DataType compute_type = COMPUTE_DATA_TYPE(a.data_type);
+    Tensor a_copy = empty_tensor(compute_type);
+    Tensor b_copy = empty_tensor(compute_type);
+    const bool is_matching = run_compare_kernel(compute_type, cmp_flag, compute_data(&a_copy, a), compute_data(&b_copy, b), TENSOR_SIZE(a));
+    DEALLOCATE_TENSORS(a_copy, b_copy);
+    return is_matching;
 }
 
 void threshold_tensor(Tensor a, void* threshold, void* upper, void* lower) {
-    for (unsigned int i = 0; i < TENSOR_SIZE(a); ++i) {
-        if (IS_GREATER_OR_EQUAL(CAST_PTR_AT_INDEX(a.data, i, a.data_type), threshold, a.data_type)) mem_copy(CAST_PTR_AT_INDEX(a.data, i, a.data_type), upper, a.data_type, 1);
-        else mem_copy(CAST_PTR_AT_INDEX(a.data, i, a.data_type), lower, a.data_type, 1);
-    }
+    const DataType compute_type = COMPUTE_DATA_TYPE(a.data_type);
+    long double params[3] = {0};
+    ASSIGN(CAST_PTR_AT_INDEX(params, 0, compute_type), read_data_type(threshold, a.data_type), compute_type);
+    ASSIGN(CAST_PTR_AT_INDEX(params, 1, compute_type), read_data_type(upper, a.data_type), compute_type);
+    ASSIGN(CAST_PTR_AT_INDEX(params, 2, compute_type), read_data_type(lower, a.data_type), compute_type);
+    Tensor copy = empty_tensor(compute_type);
+    void* data = compute_data(&copy, a);
+    run_threshold_kernel(compute_type, data, data, params, TENSOR_SIZE(a));
+    store_compute_data(a, &copy);
     return;
 }
 
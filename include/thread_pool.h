@@ -0,0 +1,189 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <pthread.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include "./utils.h"
+#include "types.h"
+
+#define THREAD_POOL_MAX_THREADS 256
+#define THREAD_POOL_CACHE_LINE 64
+
+// Processes the elements [start, end) of a parallel loop, args is shared by every chunk
+typedef void (*ParallelTask)(void* args, size_t start, size_t end);
+
+// Chunks [next, end) still owned by a participant: the owner and the thieves both claim them through next
+typedef struct ThreadPoolRange {
+    _Alignas(THREAD_POOL_CACHE_LINE) atomic_size_t next;
+    size_t end;
+} ThreadPoolRange;
+
+typedef struct ThreadPool {
+    pthread_t* workers;
+    unsigned int workers_count;
+    pthread_mutex_t submit_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    pthread_cond_t done_cond;
+    unsigned long long generation;
+    unsigned int pending;
+    bool is_shutting_down;
+    ParallelTask task;
+    void* args;
+    size_t size;
+    size_t grain;
+    ThreadPoolRange ranges[THREAD_POOL_MAX_THREADS];
+} ThreadPool;
+
+void parallel_for(size_t size, size_t grain, ParallelTask task, void* args);
+void set_num_threads(unsigned int num_threads);
+unsigned int get_num_threads(void);
+unsigned int get_thread_index(void);
+void shutdown_thread_pool(void);
+
+/* ------------------------------------------------------------------------------------------------ */
+
+static ThreadPool thread_pool = { .submit_lock = PTHREAD_MUTEX_INITIALIZER, .lock = PTHREAD_MUTEX_INITIALIZER, .job_cond = PTHREAD_COND_INITIALIZER, .done_cond = PTHREAD_COND_INITIALIZER };
+static unsigned int current_num_threads = 0;
+static _Thread_local bool is_pool_worker = FALSE;
+static _Thread_local unsigned int pool_participant = 0;
+
+unsigned int get_num_threads(void) {
+    if (!current_num_threads) {
+        long online_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        current_num_threads = online_cores < 1 ? 1 : MIN((unsigned int) online_cores, THREAD_POOL_MAX_THREADS);
+    }
+    return current_num_threads;
+}
+
+// Participant of the pool running the calling thread, below get_num_threads(): the workers count from 1, any other
+// thread is 0. The chunks of a parallel loop running at the same time never share it.
+unsigned int get_thread_index(void) {
+    return pool_participant;
+}
+
+static void run_parallel_chunks(unsigned int participant) {
+    // Drain the own range first, then steal the leftovers of the others
+    const unsigned int participants = thread_pool.workers_count + 1;
+    for (unsigned int v = 0; v < participants; ++v) {
+        ThreadPoolRange* range = thread_pool.ranges + (participant + v) % participants;
+        size_t chunk = 0;
+        while ((chunk = atomic_fetch_add_explicit(&(range -> next), 1, memory_order_relaxed)) < range -> end) {
+            const size_t start = chunk * thread_pool.grain;
+            thread_pool.task(thread_pool.args, start, MIN(thread_pool.size, start + thread_pool.grain));
+        }
+    }
+    return;
+}
+
+static void* thread_pool_worker(void* arg) {
+    const unsigned int participant = (unsigned int) (uintptr_t) arg;
+    unsigned long long seen_generation = 0;
+    is_pool_worker = TRUE;
+    pool_participant = participant;
+
+    pthread_mutex_lock(&(thread_pool.lock));
+    while (TRUE) {
+        while (!thread_pool.is_shutting_down && thread_pool.generation == seen_generation) pthread_cond_wait(&(thread_pool.job_cond), &(thread_pool.lock));
+        if (thread_pool.is_shutting_down) break;
+        seen_generation = thread_pool.generation;
+        pthread_mutex_unlock(&(thread_pool.lock));
+
+        run_parallel_chunks(participant);
+
+        pthread_mutex_lock(&(thread_pool.lock));
+        if (--(thread_pool.pending) == 0) pthread_cond_signal(&(thread_pool.done_cond));
+    }
+    pthread_mutex_unlock(&(thread_pool.lock));
+
+    return NULL;
+}
+
+static void start_thread_pool(void) {
+    static bool is_exit_handler_set = FALSE;
+    if (!is_exit_handler_set) is_exit_handler_set = !atexit(shutdown_thread_pool);
+
+    thread_pool.is_shutting_down = FALSE;
+    thread_pool.generation = 0;
+    thread_pool.workers_count = get_num_threads() - 1;
+    thread_pool.workers = (pthread_t*) calloc(thread_pool.workers_count, sizeof(pthread_t));
+    ASSERT(thread_pool.workers == NULL, "BAD_MEMORY");
+    for (unsigned int i = 0; i < thread_pool.workers_count; ++i) {
+        ASSERT(pthread_create(thread_pool.workers + i, NULL, thread_pool_worker, (void*) (uintptr_t) (i + 1)), "THREAD_CREATION_FAILED");
+    }
+    return;
+}
+
+static void stop_thread_pool(void) {
+    if (thread_pool.workers == NULL) return;
+    pthread_mutex_lock(&(thread_pool.lock));
+    thread_pool.is_shutting_down = TRUE;
+    pthread_cond_broadcast(&(thread_pool.job_cond));
+    pthread_mutex_unlock(&(thread_pool.lock));
+    for (unsigned int i = 0; i < thread_pool.workers_count; ++i) pthread_join(thread_pool.workers[i], NULL);
+    free(thread_pool.workers);
+    thread_pool.workers = NULL;
+    thread_pool.workers_count = 0;
+    return;
+}
+
+void shutdown_thread_pool(void) {
+    pthread_mutex_lock(&(thread_pool.submit_lock));
+    stop_thread_pool();
+    pthread_mutex_unlock(&(thread_pool.submit_lock));
+    return;
+}
+
+void set_num_threads(unsigned int num_threads) {
+    ASSERT(!num_threads, "INVALID_THREADS_COUNT");
+    pthread_mutex_lock(&(thread_pool.submit_lock));
+    stop_thread_pool();
+    current_num_threads = MIN(num_threads, THREAD_POOL_MAX_THREADS);
+    pthread_mutex_unlock(&(thread_pool.submit_lock));
+    return;
+}
+
+void parallel_for(size_t size, size_t grain, ParallelTask task, void* args) {
+    grain = MAX(grain, 1);
+    const size_t chunks_count = size / grain + (size % grain != 0);
+
+    // Small loops, nested calls and calls racing with another submitter run on the calling thread
+    if (chunks_count < 2 || is_pool_worker || get_num_threads() < 2 || pthread_mutex_trylock(&(thread_pool.submit_lock))) {
+        if (size) task(args, 0, size);
+        return;
+    }
+
+    if (thread_pool.workers == NULL) start_thread_pool();
+    // The first chunks_count % participants ranges take one chunk more than the others
+    const unsigned int participants = thread_pool.workers_count + 1;
+    const size_t range_size = chunks_count / participants;
+    const size_t extra_chunks = chunks_count % participants;
+    for (unsigned int i = 0; i < participants; ++i) {
+        atomic_store_explicit(&(thread_pool.ranges[i].next), i * range_size + MIN(i, extra_chunks), memory_order_relaxed);
+        thread_pool.ranges[i].end = (i + 1) * range_size + MIN(i + 1, extra_chunks);
+    }
+
+    pthread_mutex_lock(&(thread_pool.lock));
+    thread_pool.task = task;
+    thread_pool.args = args;
+    thread_pool.size = size;
+    thread_pool.grain = grain;
+    thread_pool.pending = thread_pool.workers_count;
+    (thread_pool.generation)++;
+    pthread_cond_broadcast(&(thread_pool.job_cond));
+    pthread_mutex_unlock(&(thread_pool.lock));
+
+    is_pool_worker = TRUE;
+    run_parallel_chunks(0);
+    is_pool_worker = FALSE;
+
+    pthread_mutex_lock(&(thread_pool.lock));
+    while (thread_pool.pending) pthread_cond_wait(&(thread_pool.done_cond), &(thread_pool.lock));
+    pthread_mutex_unlock(&(thread_pool.lock));
+    pthread_mutex_unlock(&(thread_pool.submit_lock));
+
+    return;
+}
+
+#endif //_THREAD_POOL_H_
@@ -1,27 +1,69 @@
 #ifndef _TYPES_H_
 #define _TYPES_H_
 
+#include <stddef.h>
+
 #define FALSE 0
 #define TRUE 1
+#define GRAD_NODE_MAX_PARENTS 2
+#define GRAD_NODE_INLINE_CHILDREN 2
+#define QUANTIZE_PER_TENSOR -1
 
 typedef unsigned char bool;
 
-typedef enum DataType { FLOAT_32 = sizeof(float), FLOAT_64 = sizeof(double), FLOAT_128 = sizeof(long double) } DataType;
-typedef enum OperatorFlag { NO_OP = -1, SUM, SUBTRACTION, MULTIPLICATION, DIVISION, POW, EXP, TANH, DOT, SQRT, LOG, MAX, MIN, ABS, CONJUGATE, NORM, SOFTMAX } OperatorFlag;
+// The values only tag the data types, their element sizes are listed in data_types_sizes
+typedef enum DataType { FLOAT_32, FLOAT_64, FLOAT_128, FLOAT_16, BFLOAT_16, INT_8, INT_32 } DataType;
+typedef enum OperatorFlag { NO_OP = -1, SUM, SUBTRACTION, MULTIPLICATION, DIVISION, POW, EXP, TANH, DOT, SQRT, LOG, MAX, MIN, ABS, CONJUGATE, NORM, SOFTMAX, SIGMOID, GELU, LOG_SOFTMAX, REDUCE } OperatorFlag;
+typedef enum ReductionFlag { REDUCE_SUM, REDUCE_MEAN, REDUCE_MAX, REDUCE_MIN, REDUCE_ARGMAX, REDUCE_NORM, REDUCE_LOGSUMEXP } ReductionFlag;
 typedef enum ComparisonFlag { EQUAL, LESS, LESS_OR_EQUAL, GREATER, GREATER_OR_EQUAL, NEGATIVE, POSITIVE } ComparisonFlag;
 
-const unsigned char data_types[] = { FLOAT_32, FLOAT_64, FLOAT_128 };
-const unsigned char operators_flags[] = { SUM, SUBTRACTION, MULTIPLICATION, DIVISION, POW, EXP, TANH, DOT, SQRT, LOG, MAX, MIN, ABS, CONJUGATE, NORM, SOFTMAX };
+// Builds defining TENSOR_NO_FLOAT_128 leave out the long double kernels: the tag is kept, but no longer a valid data type
+#ifdef TENSOR_NO_FLOAT_128
+const unsigned char data_types[] = { FLOAT_32, FLOAT_64, FLOAT_16, BFLOAT_16, INT_8, INT_32 };
+#else
+const unsigned char data_types[] = { FLOAT_32, FLOAT_64, FLOAT_128, FLOAT_16, BFLOAT_16, INT_8, INT_32 };
+#endif
+const unsigned char data_types_sizes[] = { sizeof(float), sizeof(double), sizeof(long double), sizeof(unsigned short), sizeof(unsigned short), sizeof(signed char), sizeof(int) };
+// The data types with kernels of their own, the others are only stored and compute through one of these
+#ifdef TENSOR_NO_FLOAT_128
+const unsigned char compute_data_types[] = { FLOAT_32, FLOAT_64 };
+#else
+const unsigned char compute_data_types[] = { FLOAT_32, FLOAT_64, FLOAT_128 };
+#endif
+const unsigned char operators_flags[] = { SUM, SUBTRACTION, MULTIPLICATION, DIVISION, POW, EXP, TANH, DOT, SQRT, LOG, MAX, MIN, ABS, CONJUGATE, NORM, SOFTMAX, SIGMOID, GELU, LOG_SOFTMAX, REDUCE };
+const unsigned char reduction_flags[] = { REDUCE_SUM, REDUCE_MEAN, REDUCE_MAX, REDUCE_MIN, REDUCE_ARGMAX, REDUCE_NORM, REDUCE_LOGSUMEXP };
 const unsigned char comparison_flags[] = { EQUAL, LESS, LESS_OR_EQUAL, GREATER, GREATER_OR_EQUAL, NEGATIVE, POSITIVE };
 
 typedef struct Tensor {
-    unsigned int* shape;
+    size_t* shape;
+    size_t* strides;
     unsigned int rank;
     void* data;
+    void* storage;
     DataType data_type;
     void* grad_node;
 } Tensor;
 
+// Reduction over the axes whose bits are set in axes, every axis when it is 0: the reduced axes are kept with size 1
+// when keepdims is set, p is the order of REDUCE_NORM
+typedef struct Reduction {
+    ReductionFlag flag;
+    unsigned int axes;
+    bool keepdims;
+    long double p;
+} Reduction;
+
+// Affine mapping of the INT_8 values q to the real ones scale * (q - zero_point): a scale and a zero point for every
+// index along axis, or a single pair when axis is QUANTIZE_PER_TENSOR
+typedef struct Quantization {
+    float* scales;
+    int* zero_points;
+    size_t channels;
+    int axis;
+} Quantization;
+
+// Every operation reads at most two operands, so the parents are stored inline; the children start in the inline
+// slots and move to an array grown by doubling once they outnumber them
 typedef struct GradNode {
     Tensor derived_value;
     Tensor* value;
@@ -29,11 +71,26 @@ typedef struct GradNode {
     OperatorFlag operation;
     struct GradNode** children;
     unsigned int children_count;
-    struct GradNode** parents;
+    unsigned int children_capacity;
+    struct GradNode* parents[GRAD_NODE_MAX_PARENTS];
     unsigned int parents_count;
+    unsigned int epoch;
+    bool is_checkpoint;
+    bool is_value_shared;
     void* exp;
+    struct GradNode* inline_children[GRAD_NODE_INLINE_CHILDREN];
 } GradNode;
 
+// Forward values kept through the reverse sweep, the others are released and recomputed from the nearest kept ones:
+// every value, the marked nodes only, the marked nodes and every checkpoint_segment-th node, or every sqrt(N)-th one
+typedef enum CheckpointPolicy { CHECKPOINT_NONE, CHECKPOINT_MARKED, CHECKPOINT_EVERY, CHECKPOINT_SQRT } CheckpointPolicy;
+
+typedef struct TensorContext {
+    bool fast_math;
+    CheckpointPolicy checkpoint_policy;
+    unsigned int checkpoint_segment;
+} TensorContext;
+
 typedef struct Value {
     void* data;
     DataType data_type;
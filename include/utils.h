@@ -5,7 +5,10 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include "./fast_math.h"
+#include "./simd.h"
 #include "./types.h"
 
 #define CAST_AND_OP_INDEX(a, b, c, index, data_type, op) scalar_op(CAST_PTR_AT_INDEX(c, index, data_type), CAST_PTR_AT_INDEX(a, index, data_type), CAST_PTR_AT_INDEX(b, index, data_type), data_type, op)
@@ -13,10 +16,19 @@
 #define DEALLOCATE_PTRS(...) deallocate_ptrs(sizeof((void*[]){__VA_ARGS__}) / sizeof(void*), __VA_ARGS__)
 #define ASSIGN(val, new_val, data_type) assign_data_type(val, (long double) new_val, data_type)
 #define ASSERT(condition, err_msg) assert(condition, #condition, __LINE__, __FILE__, err_msg)
-#define CAST_PTR_AT_INDEX(a, index, type_size) (CAST_PTR(a, unsigned char) + (type_size * (index)))
+#define CAST_PTR_AT_INDEX(a, index, data_type) (CAST_PTR(a, unsigned char) + (DATA_TYPE_SIZE(data_type) * (index)))
+#define DATA_TYPE_SIZE(data_type) (data_types_sizes[data_type])
+#define IS_COMPUTE_TYPE(data_type) is_valid_enum(data_type, (unsigned char*) compute_data_types, ARR_SIZE(compute_data_types))
+// The storage types compute in FLOAT_32, but for INT_32 whose values FLOAT_64 holds exactly
+#define COMPUTE_DATA_TYPE(data_type) (IS_COMPUTE_TYPE(data_type) ? (data_type) : ((data_type) == INT_32) ? FLOAT_64 : FLOAT_32)
+// The scalar helpers keep their long double path even without the FLOAT_128 kernels, the storage types compute through it
+#define IS_SCALAR_TYPE(data_type) (IS_COMPUTE_TYPE(data_type) || ((data_type) == FLOAT_128))
 #define CAST_AND_OP(a, b, type, op) *CAST_PTR(a, type) op *CAST_PTR(b, type)
 #define ABS_T(x, type) (type) (x ? (long double) x > 0.0L ? x : -x : 0.0L)
 #define ARR_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+#define SET_FAST_MATH(flag) (get_tensor_context() -> fast_math = (flag))
+#define IS_FAST_MATH() (get_tensor_context() -> fast_math)
+#define SET_CHECKPOINT_POLICY(policy, segment) (get_tensor_context() -> checkpoint_policy = (policy), get_tensor_context() -> checkpoint_segment = (segment))
 #define CAST_PTR(ptr, type) ((type*) (ptr))
 #define MAX(a, b) (a >= b ? a : b)
 #define MIN(a, b) (a <= b ? a : b)
@@ -37,6 +49,8 @@
 #define SCALAR_LOG(res, a, data_type) scalar_op(res, a, NULL, data_type, LOG)
 #define SCALAR_MAX(res, a, b, data_type) scalar_op(res, a, b, data_type, MAX)
 #define SCALAR_MIN(res, a, b, data_type) scalar_op(res, a, b, data_type, MIN)
+#define SCALAR_SIGMOID(res, a, data_type) scalar_op(res, a, NULL, data_type, SIGMOID)
+#define SCALAR_GELU(res, a, data_type) scalar_op(res, a, NULL, data_type, GELU)
 
 // COMPARISON OPERATIONS
 #define IS_GREATER_OR_EQUAL(a, b, data_type) comparison_op(a, b, data_type, GREATER_OR_EQUAL)
@@ -49,6 +63,9 @@
 
 // CONSTANT VALUES
 #define M_PI 3.14159265358979323846
+// Constants of the tanh approximation of GELU, the scale is \sqrt{2/\pi}
+#define GELU_COEFFICIENT 0.044715L
+#define GELU_SCALE 0.79788456080286535588L
 
 bool is_valid_enum(unsigned char enum_value, unsigned char* enum_values, unsigned int enum_values_count);
 void assert(bool condition, char* condition_str, unsigned int line, char* file, char* err_msg);
@@ -56,9 +73,19 @@ void* normal_func(void* res, void* value, void* variance, void* mean, DataType d
 void* scalar_op(void* res, void* a, void* b, DataType data_type, OperatorFlag operation);
 bool comparison_op(void* a, void* b, DataType data_type, ComparisonFlag comparison);
 void* assign_data_type(void* val, long double new_val, DataType data_type);
-void mem_copy(void* dest, void* src, unsigned char size, unsigned int n);
-void mem_set(void* dest, void* src, unsigned char size, unsigned int n);
+long double read_data_type(void* val, DataType data_type);
+unsigned short float_to_bfloat(float value);
+unsigned short float_to_half(float value);
+float bfloat_to_float(unsigned short value);
+float half_to_float(unsigned short value);
+signed char saturate_int8(long double value);
+int saturate_int32(long double value);
+void mem_copy(void* dest, void* src, size_t size, size_t n);
+size_t checked_mul(size_t a, size_t b);
+void mem_set(void* dest, void* src, size_t size, size_t n);
 void* sigmoid_func(void* value, void* result, DataType data_type);
+void* gelu_func(void* value, void* result, DataType data_type);
+TensorContext* get_tensor_context(void);
 void deallocate_ptrs(int len, ...);
 void init_seed(void);
 
@@ -72,17 +99,27 @@ void assert(bool condition, char* condition_str, unsigned int line, char* file,
     return;
 }
 
-void mem_copy(void* dest, void* src, unsigned char size, unsigned int n) {
+TensorContext* get_tensor_context(void) {
+    static TensorContext context = { .fast_math = FALSE, .checkpoint_policy = CHECKPOINT_NONE, .checkpoint_segment = 0 };
+    return &context;
+}
+
+// Sizes of tensors and of their buffers go through here, so that an overflow stops instead of wrapping around
+size_t checked_mul(size_t a, size_t b) {
+    size_t res = 0;
+    ASSERT(__builtin_mul_overflow(a, b, &res), "SIZE_OVERFLOW");
+    return res;
+}
+
+void mem_copy(void* dest, void* src, size_t size, size_t n) {
     ASSERT(src == NULL, "NULL_POINTER");
-    for (unsigned int i = 0; i < size * n; ++i) CAST_PTR(dest, unsigned char)[i] = CAST_PTR(src, unsigned char)[i];
+    simd_copy(dest, src, checked_mul(size, n));
     return;
 }
 
-void mem_set(void* dest, void* src, unsigned char size, unsigned int n) {
+void mem_set(void* dest, void* src, size_t size, size_t n) {
     ASSERT(src == NULL, "NULL POINTER");
-    for (unsigned int j = 0; j < n; ++j) {
-        for (unsigned int i = 0; i < size; ++i) CAST_PTR(dest, unsigned char)[size * j + i] = CAST_PTR(src, unsigned char)[i];
-    }
+    simd_fill(dest, src, size, n);
     return;
 }
 
@@ -98,15 +135,83 @@ void init_seed(void) {
     return;
 }
 
+// Rounds to the nearest half, ties to even: the values below the smallest normal one are counted in units of 2^-24
+unsigned short float_to_half(float value) {
+    unsigned int bits = 0;
+    memcpy(&bits, &value, sizeof(float));
+    const unsigned short sign = (bits >> 16) & 0x8000;
+    const unsigned int magnitude = bits & 0x7FFFFFFF;
+    if (magnitude > 0x7F800000) return sign | 0x7E00;
+    else if (magnitude >= 0x477FF000) return sign | 0x7C00;
+    else if (magnitude < 0x38800000) return sign | (unsigned short) lrintf(fabsf(value) * 16777216.0f);
+    return sign | (unsigned short) ((magnitude + 0xFFF + ((magnitude >> 13) & 1) - 0x38000000) >> 13);
+}
+
+float half_to_float(unsigned short value) {
+    const unsigned int sign = (unsigned int) (value & 0x8000) << 16;
+    const unsigned int exponent = (value >> 10) & 0x1F;
+    const unsigned int mantissa = value & 0x3FF;
+    if (!exponent) return (sign ? -1.0f : 1.0f) * mantissa * 5.9604644775390625e-8f;
+    unsigned int bits = sign | ((exponent == 0x1F) ? 0x7F800000 : ((exponent + 112) << 23)) | (mantissa << 13);
+    float res = 0.0f;
+    memcpy(&res, &bits, sizeof(float));
+    return res;
+}
+
+// Keeps the upper half of the float, rounded to nearest even
+unsigned short float_to_bfloat(float value) {
+    unsigned int bits = 0;
+    memcpy(&bits, &value, sizeof(float));
+    if ((bits & 0x7FFFFFFF) > 0x7F800000) return ((bits >> 16) & 0x8000) | 0x7FC0;
+    return (unsigned short) ((bits + 0x7FFF + ((bits >> 16) & 1)) >> 16);
+}
+
+float bfloat_to_float(unsigned short value) {
+    unsigned int bits = (unsigned int) value << 16;
+    float res = 0.0f;
+    memcpy(&res, &bits, sizeof(float));
+    return res;
+}
+
+// Rounds to the nearest integer, clamping to the range of the type, NaN going to 0
+signed char saturate_int8(long double value) {
+    if (isnan(value)) return 0;
+    return (signed char) lrintl(MIN(MAX(value, -128.0L), 127.0L));
+}
+
+int saturate_int32(long double value) {
+    if (isnan(value)) return 0;
+    return (int) llrintl(MIN(MAX(value, -2147483648.0L), 2147483647.0L));
+}
+
 void* assign_data_type(void* val, long double new_val, DataType data_type) {
     if (data_type == FLOAT_32) *CAST_PTR(val, float) = (float) new_val;
     else if (data_type == FLOAT_64) *CAST_PTR(val, double) = (double) new_val;
     else if (data_type == FLOAT_128) *CAST_PTR(val, long double) = new_val;
+    else if (data_type == FLOAT_16) *CAST_PTR(val, unsigned short) = float_to_half((float) new_val);
+    else if (data_type == BFLOAT_16) *CAST_PTR(val, unsigned short) = float_to_bfloat((float) new_val);
+    else if (data_type == INT_8) *CAST_PTR(val, signed char) = saturate_int8(new_val);
+    else if (data_type == INT_32) *CAST_PTR(val, int) = saturate_int32(new_val);
     return val;
 }
 
+long double read_data_type(void* val, DataType data_type) {
+    if (data_type == FLOAT_32) return *CAST_PTR(val, float);
+    else if (data_type == FLOAT_64) return *CAST_PTR(val, double);
+    else if (data_type == FLOAT_16) return half_to_float(*CAST_PTR(val, unsigned short));
+    else if (data_type == BFLOAT_16) return bfloat_to_float(*CAST_PTR(val, unsigned short));
+    else if (data_type == INT_8) return *CAST_PTR(val, signed char);
+    else if (data_type == INT_32) return *CAST_PTR(val, int);
+    return *CAST_PTR(val, long double);
+}
+
 bool comparison_op(void* a, void* b, DataType data_type, ComparisonFlag comparison) {
     ASSERT(!is_valid_enum(comparison, (unsigned char*) comparison_flags, ARR_SIZE(comparison_flags)), "INVALID_COMPARISON_FLAG");
+    if (!IS_SCALAR_TYPE(data_type)) {
+        long double x = read_data_type(a, data_type);
+        long double y = (b != NULL) ? read_data_type(b, data_type) : 0.0L;
+        return comparison_op(&x, &y, FLOAT_128, comparison);
+    }
     switch (comparison) {
         case EQUAL: {
             if (data_type == FLOAT_32) return CAST_AND_OP(a, b, float, ==);
@@ -163,6 +268,14 @@ bool comparison_op(void* a, void* b, DataType data_type, ComparisonFlag comparis
 
 void* scalar_op(void* res, void* a, void* b, DataType data_type, OperatorFlag operation) {
     ASSERT(!is_valid_enum(operation, (unsigned char*) operators_flags, ARR_SIZE(operators_flags)), "INVALID_OPERATOR_FLAG");
+    // The storage types compute in long double, the result being rounded back once
+    if (!IS_SCALAR_TYPE(data_type)) {
+        long double x = read_data_type(a, data_type);
+        long double y = (b != NULL) ? read_data_type(b, data_type) : 0.0L;
+        long double r = 0.0L;
+        scalar_op(&r, &x, (b != NULL) ? &y : NULL, FLOAT_128, operation);
+        return assign_data_type(res, r, data_type);
+    }
     switch(operation) {
         case SUM: {
             if (data_type == FLOAT_32) *CAST_PTR(res, float) = CAST_AND_OP(a, b, float, +);
@@ -261,11 +374,23 @@ void* scalar_op(void* res, void* a, void* b, DataType data_type, OperatorFlag op
             break;
         }
 
-        case SOFTMAX: {
+        case SOFTMAX:
+        case LOG_SOFTMAX:
+        case REDUCE: {
             ASSERT(TRUE, "Can't calculate on single values the SOFTMAX function");
             break;
         }
 
+        case SIGMOID: {
+            sigmoid_func(a, res, data_type);
+            break;
+        }
+
+        case GELU: {
+            gelu_func(a, res, data_type);
+            break;
+        }
+
         case NO_OP: {
             ASSERT(TRUE, "Can't calculate NO_OP");
             break;
@@ -288,15 +413,38 @@ void deallocate_ptrs(int len, ...) {
 
 void* sigmoid_func(void* value, void* result, DataType data_type) {
     // Math: \frac{1}{1 + e^{-value}}
-    if (data_type == FLOAT_32) *CAST_PTR(result, float) = (1.0f / (1.0f + expf(*CAST_PTR(value, float) * -1)));
+    if (IS_FAST_MATH() && data_type == FLOAT_32) *CAST_PTR(result, float) = 1.0f / (1.0f + fast_expf(-(*CAST_PTR(value, float))));
+    else if (IS_FAST_MATH() && data_type == FLOAT_64) *CAST_PTR(result, double) = 1.0 / (1.0 + fast_exp(-(*CAST_PTR(value, double))));
+    else if (data_type == FLOAT_32) *CAST_PTR(result, float) = (1.0f / (1.0f + expf(*CAST_PTR(value, float) * -1)));
     else if (data_type == FLOAT_64) *CAST_PTR(result, double) = (1.0f / (1.0f + exp(*CAST_PTR(value, double) * -1)));
     else if (data_type == FLOAT_128) *CAST_PTR(result, long double) = (1.0f / (1.0f + expl(*CAST_PTR(value, long double) * -1)));
     return result;
 }
 
+void* gelu_func(void* value, void* result, DataType data_type) {
+    // Math: 0.5x(1 + {\tanh}[{\sqrt{2/\pi}}({x} + 0.044715{x}^{3})])
+    if (data_type == FLOAT_32) {
+        float x = *CAST_PTR(value, float);
+        *CAST_PTR(result, float) = 0.5f * x * (1.0f + tanhf((float) GELU_SCALE * (x + (float) GELU_COEFFICIENT * x * x * x)));
+    } else if (data_type == FLOAT_64) {
+        double x = *CAST_PTR(value, double);
+        *CAST_PTR(result, double) = 0.5 * x * (1.0 + tanh((double) GELU_SCALE * (x + (double) GELU_COEFFICIENT * x * x * x)));
+    } else if (data_type == FLOAT_128) {
+        long double x = *CAST_PTR(value, long double);
+        *CAST_PTR(result, long double) = 0.5L * x * (1.0L + tanhl(GELU_SCALE * (x + GELU_COEFFICIENT * x * x * x)));
+    }
+    return result;
+}
+
 void* normal_func(void* res, void* value, void* variance, void* mean, DataType data_type) {
     // Math: (2\pi\sigma^2)^{-{1/2}}\exp(-\frac{(x-\mu)^2}{2\sigma^2})
-    if (data_type == FLOAT_32) *CAST_PTR(res, float) = powf(2.0f * (float) M_PI * (*CAST_PTR(variance, float)), -0.5f) * expf(-(powf(*CAST_PTR(value, float) - *CAST_PTR(mean, float), 2.0f) * (2.0f * (*CAST_PTR(variance, float)))));
+    if (IS_FAST_MATH() && data_type == FLOAT_32) {
+        float diff = *CAST_PTR(value, float) - *CAST_PTR(mean, float);
+        *CAST_PTR(res, float) = 1.0f / sqrtf(2.0f * (float) M_PI * (*CAST_PTR(variance, float))) * fast_expf(-(diff * diff * (2.0f * (*CAST_PTR(variance, float)))));
+    } else if (IS_FAST_MATH() && data_type == FLOAT_64) {
+        double diff = *CAST_PTR(value, double) - *CAST_PTR(mean, double);
+        *CAST_PTR(res, double) = 1.0 / sqrt(2.0 * M_PI * (*CAST_PTR(variance, double))) * fast_exp(-(diff * diff * (2.0 * (*CAST_PTR(variance, double)))));
+    } else if (data_type == FLOAT_32) *CAST_PTR(res, float) = powf(2.0f * (float) M_PI * (*CAST_PTR(variance, float)), -0.5f) * expf(-(powf(*CAST_PTR(value, float) - *CAST_PTR(mean, float), 2.0f) * (2.0f * (*CAST_PTR(variance, float)))));
     else if (data_type == FLOAT_64) *CAST_PTR(res, double) = pow(2.0 * (double) M_PI * (*CAST_PTR(variance, double)), -0.5) * exp(-(pow(*CAST_PTR(value, double) - *CAST_PTR(mean, double), 2.0) * (2.0 * (*CAST_PTR(variance, double)))));
     else if (data_type == FLOAT_128) *CAST_PTR(res, long double) = powl(2.0L * (long double) M_PI * (*CAST_PTR(variance, long double)), -0.5L) * expl(-(powl(*CAST_PTR(value, long double) - *CAST_PTR(mean, long double), 2.0L) * (2.0L * (*CAST_PTR(variance, long double)))));
     return res;
@@ -1,3 +1,4 @@
+#include <float.h>
 #include <math.h>
 #include <stdio.h>
 #include "./include/autograd.h"
@@ -5,6 +6,20 @@
 #include "include/types.h"
 #include "include/utils.h"
 
+void test_simd_kernels(void);
+void test_fast_math(void);
+void test_gemm(void);
+void test_thread_pool(void);
+void test_tensor_views(void);
+void test_graph_fusion(void);
+void test_memory_planner(void);
+void test_compiled_graph(void);
+void test_checkpointing(void);
+void test_grad_accumulation(void);
+void test_no_grad(void);
+void test_softmax(void);
+void test_reductions(void);
+void test_reduced_precision(void);
 void test_sigmoid(void);
 Tensor test_gelu(Tensor x);
 Tensor tensor_sigmoid(Tensor x);
@@ -13,9 +28,11 @@ Tensor tensor_sigmoid(Tensor x);
 #define DERIVED_VALUE(node, type) CAST_PTR(DERIVED_TENSOR(node).data, type)
 
 static Tensor sigmoid_t(Tensor* tensor) {
+    // The constant broadcasts over the whole tensor
+    size_t shape[] = {1};
     Tensor x1;
-    void* temp = calloc(1, tensor -> data_type);
-    ALLOC_TENSOR_GRAD_GRAPH_FILLED(x1, tensor -> shape, tensor -> rank, tensor -> data_type, ASSIGN(temp, 1.0L, tensor -> data_type));
+    void* temp = calloc(1, DATA_TYPE_SIZE(tensor -> data_type));
+    ALLOC_TENSOR_GRAD_GRAPH_FILLED(x1, shape, ARR_SIZE(shape), tensor -> data_type, ASSIGN(temp, 1.0L, tensor -> data_type));
 
     Tensor a, b, c, d;
     EMPTY_TENSORS(tensor -> data_type, &a, &b, &c, &d);
@@ -30,13 +47,96 @@ static Tensor sigmoid_t(Tensor* tensor) {
     return d;
 }
 
+// Releases the nodes of a graph together with the tensors they were created through, listed in the order they were
+// created, so that every node goes before the ones it reads
+static void deallocate_graph_tensors(Tensor* tensors, unsigned int count) {
+    for (unsigned int i = count; i-- > 0;) {
+        DEALLOCATE_GRAD_SINGLE_GRAPHS(tensors[i].grad_node);
+        DEALLOCATE_TENSORS(tensors[i]);
+    }
+    return;
+}
+
+#define FUSABLE_CHAIN_SIZE 17
+
+// sigmoid(gelu(x)) through the element-wise chains matched by fuse_grad_graph, with gelu_scale in place of the
+// sqrt(2/pi) of GELU: graph receives every tensor created, the sink last
+static Tensor fusable_chain(Tensor x, Tensor* graph, float gelu_scale) {
+    size_t shape[] = { 1 };
+    float constants[] = { (float) GELU_COEFFICIENT, gelu_scale, 1.0f, 0.5f, 1.0f };
+    float val = 0.0f;
+    for (unsigned int i = 0; i < 4; ++i) ALLOC_TENSOR_GRAD_GRAPH_FILLED(graph[i], shape, ARR_SIZE(shape), FLOAT_32, constants + i);
+    for (unsigned int i = 4; i < FUSABLE_CHAIN_SIZE; ++i) graph[i] = empty_tensor(FLOAT_32);
+
+    // Math: 0.5x(1 + {\tanh}[{\sqrt{2/\pi}}({x} + 0.044715{x}^{3})])
+    TENSOR_GRAPH_POW(graph + 4, x, (val = 3.0f, &val));
+    TENSOR_GRAPH_MUL(graph + 5, graph[0], graph[4]);
+    TENSOR_GRAPH_SUM(graph + 6, x, graph[5]);
+    TENSOR_GRAPH_MUL(graph + 7, graph[1], graph[6]);
+    TENSOR_GRAPH_TANH(graph + 8, graph[7]);
+    TENSOR_GRAPH_SUM(graph + 9, graph[2], graph[8]);
+    TENSOR_GRAPH_MUL(graph + 10, x, graph[3]);
+    TENSOR_GRAPH_MUL(graph + 11, graph[10], graph[9]);
+
+    // Math: \frac{1}{1 + e^{-x}}
+    ALLOC_TENSOR_GRAD_GRAPH_FILLED(graph[12], shape, ARR_SIZE(shape), FLOAT_32, constants + 4);
+    TENSOR_GRAPH_EXP(graph + 13, graph[11]);
+    TENSOR_GRAPH_POW(graph + 14, graph[13], (val = -1.0f, &val));
+    TENSOR_GRAPH_SUM(graph + 15, graph[12], graph[14]);
+    TENSOR_GRAPH_POW(graph + 16, graph[15], (val = -1.0f, &val));
+
+    return graph[FUSABLE_CHAIN_SIZE - 1];
+}
+
+// Distance from value to the long double reference, in steps of a type with digits mantissa bits whose smallest normal
+// has min_exponent as exponent
+static long double ulp_distance(long double value, long double reference, int digits, int min_exponent) {
+    if (isnan(reference)) return isnan(value) ? 0.0L : INFINITY;
+    if (isinf(reference)) return (value == reference) ? 0.0L : INFINITY;
+    const int exponent = (reference == 0.0L) ? min_exponent : MAX(ilogbl(reference), min_exponent);
+    return fabsl(value - reference) / ldexpl(1.0L, exponent - (digits - 1));
+}
+
+static long double fast_math_reference(OperatorFlag operation, long double x, long double p) {
+    if (operation == EXP) return expl(x);
+    else if (operation == LOG) return logl(x);
+    else if (operation == TANH) return tanhl(x);
+    else if (operation == POW) return powl(x, p);
+    else if (operation == SIGMOID) return 1.0L / (1.0L + expl(-x));
+    return 0.5L * x * (1.0L + tanhl(GELU_SCALE * (x + GELU_COEFFICIENT * x * x * x)));
+}
+
+// The bounds documented in fast_math.h, the exponents of POW being split into their integer part n and a half
+static long double fast_math_bound(OperatorFlag operation, long double p) {
+    if ((operation == EXP) || (operation == TANH)) return 1.5L;
+    else if (operation == LOG) return 2.0L;
+    else if (operation == SIGMOID) return 3.0L;
+    else if (operation == GELU) return 2.5L;
+    const long double n = floorl(p);
+    return MAX(fabsl(n) - 1.0L, 0.0L) + ((n < 0.0L) ? 1.0L : 0.0L) + ((p != n) ? 2.0L : 0.0L);
+}
+
 int main(void) {
     // test_sigmoid();
+    test_simd_kernels();
+    test_fast_math();
+    test_gemm();
+    test_thread_pool();
+    test_tensor_views();
+    test_graph_fusion();
+    test_memory_planner();
+    test_compiled_graph();
+    test_checkpointing();
+    test_grad_accumulation();
+    test_no_grad();
+    test_softmax();
+    test_reductions();
+    test_reduced_precision();
 
     float val = 1.0f;
-    unsigned int shape[] = {2, 1};
-    unsigned int shape_w[] = {1, 2};
-    unsigned int shape_b[] = {2, 2};
+    size_t shape[] = {2, 1};
+    size_t shape_w[] = {1, 2};
+    size_t shape_b[] = {2, 2};
 
     Tensor activation, weights, biases;
     ALLOC_TENSOR_GRAD_GRAPH_FILLED(activation, shape, ARR_SIZE(shape), FLOAT_32, &val);
@@ -71,7 +171,7 @@ int main(void) {
 }
 
 Tensor tensor_sigmoid(Tensor x) {
-    unsigned int shape[] = { 2, 2 };
+    size_t shape[] = { 1 };
     float temp_val = 0.0f;
 
     Tensor x1;
@@ -88,7 +188,7 @@ Tensor tensor_sigmoid(Tensor x) {
 }
 
 void test_sigmoid(void) {
-    unsigned int shape[] = { 2, 2 };
+    size_t shape[] = { 2, 2 };
     float val = 1.0f;
     float temp_val = 0.0f;
 
@@ -113,8 +213,8 @@ void test_sigmoid(void) {
     Tensor sigmoid_tensor = alloc_tensor(shape, ARR_SIZE(shape), FLOAT_32);
     fill_tensor(&val, sigmoid_tensor);
 
-    unsigned int size = TENSOR_SIZE(sigmoid_tensor);
-    for (unsigned int i = 0; i < size; ++i) {
+    size_t size = TENSOR_SIZE(sigmoid_tensor);
+    for (size_t i = 0; i < size; ++i) {
         sigmoid_func(CAST_PTR(sigmoid_tensor.data, float) + i, CAST_PTR(sigmoid_tensor.data, float) + i, sigmoid_tensor.data_type);
     }
 
@@ -130,8 +230,717 @@ void test_sigmoid(void) {
     return;
 }
 
+void test_simd_kernels(void) {
+    // Every ISA must reproduce the scalar kernels bit by bit on the non-transcendental operators
+    const OperatorFlag ops[] = { SUM, SUBTRACTION, MULTIPLICATION, DIVISION, MAX, MIN, ABS, CONJUGATE, SQRT };
+    const DataType types[] = { FLOAT_32, FLOAT_64 };
+    const long double special_values[] = { 0.0L, -0.0L, 1.0L, -1.0L, NAN, -NAN, INFINITY, -INFINITY };
+    size_t shape[] = { 7, 149 };
+    SimdLevel max_level = detect_simd_level();
+    unsigned int failures = 0;
+
+    for (unsigned int t = 0; t < ARR_SIZE(types); ++t) {
+        Tensor a = alloc_tensor(shape, ARR_SIZE(shape), types[t]);
+        Tensor b = alloc_tensor(shape, ARR_SIZE(shape), types[t]);
+        Tensor expected = empty_tensor(types[t]);
+        Tensor res = empty_tensor(types[t]);
+        randomize_tensor(a);
+        randomize_tensor(b);
+        SCALAR_SUB_TENSOR(&a, ASSIGN(&(long double) {0}, 0.5L, types[t]));
+        for (unsigned int i = 0; i < ARR_SIZE(special_values); ++i) {
+            ASSIGN(CAST_PTR_AT_INDEX(a.data, i, a.data_type), special_values[i], a.data_type);
+            ASSIGN(CAST_PTR_AT_INDEX(b.data, ARR_SIZE(special_values) - i - 1, b.data_type), special_values[i], b.data_type);
+        }
+
+        for (unsigned int o = 0; o < ARR_SIZE(ops); ++o) {
+            Tensor operand = (ops[o] == ABS || ops[o] == CONJUGATE || ops[o] == SQRT) ? (Tensor) {.data_type = types[t]} : b;
+            set_simd_level(SIMD_SCALAR);
+            op_tensor(&expected, a, operand, ops[o]);
+            for (SimdLevel level = SIMD_SSE; level <= max_level; ++level) {
+                set_simd_level(level);
+                op_tensor(&res, a, operand, ops[o]);
+                if (memcmp(res.data, expected.data, TENSOR_SIZE(a) * DATA_TYPE_SIZE(types[t]))) {
+                    printf("SIMD mismatch: operator %d, data type %d, level %d\n", ops[o], types[t], level);
+                    failures++;
+                }
+            }
+        }
+
+        for (SimdLevel level = SIMD_SCALAR; level <= max_level; ++level) {
+            set_simd_level(level);
+            fill_tensor(CAST_PTR_AT_INDEX(a.data, 2, a.data_type), res);
+            for (unsigned int i = 0; i < TENSOR_SIZE(res); ++i) {
+                if (memcmp(CAST_PTR_AT_INDEX(res.data, i, res.data_type), CAST_PTR_AT_INDEX(a.data, 2, a.data_type), DATA_TYPE_SIZE(res.data_type))) {
+                    printf("SIMD fill mismatch: data type %d, level %d, index %u\n", types[t], level, i);
+                    failures++;
+                    break;
+                }
+            }
+        }
+
+        DEALLOCATE_TENSORS(a, b, expected, res);
+    }
+
+    set_simd_level(max_level);
+    printf("SIMD kernels: %u ISA level(s) checked, %u failure(s)\n", max_level, failures);
+
+    return;
+}
+
+void test_fast_math(void) {
+    // The approximated kernels of every ISA against the long double libm, over sweeps of their ranges: LOG sweeps the
+    // exponent of its input, and GELU is measured against x / 2 below zero, where 1 + tanh cancels
+    const OperatorFlag ops[] = { EXP, LOG, TANH, POW, POW, POW, POW, POW, SIGMOID, GELU };
+    const long double exponents[] = { 0.0L, 0.0L, 0.0L, 3.0L, -2.0L, 17.0L, 2.5L, -7.5L, 0.0L, 0.0L };
+    const long double ranges[][2] = { { -80.0L, 80.0L }, { -80.0L, 80.0L }, { -10.0L, 10.0L }, { 0.01L, 100.0L }, { 0.01L, 100.0L }, { 0.5L, 2.0L }, { 0.01L, 100.0L }, { 0.5L, 2.0L }, { -80.0L, 80.0L }, { -6.0L, 6.0L } };
+    const DataType types[] = { FLOAT_32, FLOAT_64 };
+    const int digits[] = { FLT_MANT_DIG, DBL_MANT_DIG };
+    const int min_exponents[] = { FLT_MIN_EXP - 1, DBL_MIN_EXP - 1 };
+    const SimdLevel levels[] = { SIMD_SCALAR, detect_simd_level() };
+    size_t shape[] = { 1 << 14 };
+    unsigned int failures = 0;
+
+    SET_FAST_MATH(TRUE);
+    for (unsigned int t = 0; t < ARR_SIZE(types); ++t) {
+        Tensor x = alloc_tensor(shape, ARR_SIZE(shape), types[t]);
+        Tensor res = empty_tensor(types[t]);
+        for (unsigned int o = 0; o < ARR_SIZE(ops); ++o) {
+            for (size_t j = 0; j < shape[0]; ++j) {
+                const long double value = ranges[o][0] + (ranges[o][1] - ranges[o][0]) * j / (shape[0] - 1);
+                ASSIGN(CAST_PTR_AT_INDEX(x.data, j, x.data_type), (ops[o] == LOG) ? expl(value) : value, x.data_type);
+            }
+            long double exponent = 0.0L;
+            ASSIGN(&exponent, exponents[o], types[t]);
+            for (unsigned int l = 0; l < ARR_SIZE(levels); ++l) {
+                set_simd_level(levels[l]);
+                op_tensor(&res, x, (Tensor) {.data = (ops[o] == POW) ? &exponent : NULL, .data_type = types[t]}, ops[o]);
+                for (size_t j = 0; j < shape[0]; ++j) {
+                    const long double input = read_data_type(CAST_PTR_AT_INDEX(x.data, j, x.data_type), x.data_type);
+                    const long double value = read_data_type(CAST_PTR_AT_INDEX(res.data, j, res.data_type), res.data_type);
+                    const long double reference = fast_math_reference(ops[o], input, exponents[o]);
+                    long double error = ulp_distance(value, reference, digits[t], min_exponents[t]);
+                    if ((ops[o] == GELU) && (input < 0.0L)) error = ulp_distance(value - reference + 0.5L * input, 0.5L * input, digits[t], min_exponents[t]);
+                    if (error > fast_math_bound(ops[o], exponents[o])) {
+                        printf("Fast math mismatch: operator %d, exponent %Lg, data type %d, level %d, element %zu: %Lg ULP\n", ops[o], exponents[o], types[t], levels[l], j, error);
+                        failures++;
+                        break;
+                    }
+                }
+            }
+        }
+        DEALLOCATE_TENSORS(x, res);
+    }
+    SET_FAST_MATH(FALSE);
+    set_simd_level(levels[1]);
+    printf("Fast math: %u operation(s) checked, %u failure(s)\n", (unsigned int) ARR_SIZE(ops), failures);
+
+    return;
+}
+
+void test_gemm(void) {
+    // The packed path must match a naive product on shapes that leave partial register tiles and K panels
+    const DataType types[] = { FLOAT_32, FLOAT_64 };
+    size_t shape_a[] = { 67, 300 };
+    size_t shape_b[] = { 300, 45 };
+    size_t shape_b_t[] = { 45, 300 };
+    unsigned int failures = 0;
+
+    for (unsigned int t = 0; t < ARR_SIZE(types); ++t) {
+        const long double tolerance = (types[t] == FLOAT_32) ? 1e-5L : 1e-13L;
+        Tensor a = alloc_tensor(shape_a, ARR_SIZE(shape_a), types[t]);
+        Tensor b = alloc_tensor(shape_b, ARR_SIZE(shape_b), types[t]);
+        Tensor b_t = alloc_tensor(shape_b_t, ARR_SIZE(shape_b_t), types[t]);
+        randomize_tensor(a);
+        randomize_tensor(b);
+        randomize_tensor(b_t);
+
+        // The second product reads B through the strides of a transposed view
+        Tensor operands[2] = { b, empty_tensor(types[t]) };
+        transpose_tensor(view_tensor(operands + 1, b_t, b_t.shape, b_t.rank));
+        for (unsigned int o = 0; o < ARR_SIZE(operands); ++o) {
+            Tensor res = empty_tensor(types[t]);
+            Tensor b_copy = empty_tensor(types[t]);
+            DOT_TENSOR(&res, a, operands[o]);
+            copy_tensor(&b_copy, operands[o]);
+
+            const size_t m = shape_a[0], n = shape_b[1], k = shape_a[1];
+            long double* expected = (long double*) calloc(m * n, sizeof(long double));
+            long double* magnitude = (long double*) calloc(m * n, sizeof(long double));
+            for (size_t i = 0; i < m; ++i) {
+                for (size_t p = 0; p < k; ++p) {
+                    const long double a_ip = read_data_type(CAST_PTR_AT_INDEX(a.data, i * k + p, a.data_type), a.data_type);
+                    for (size_t j = 0; j < n; ++j) {
+                        const long double b_pj = read_data_type(CAST_PTR_AT_INDEX(b_copy.data, p * n + j, b_copy.data_type), b_copy.data_type);
+                        expected[i * n + j] += a_ip * b_pj;
+                        magnitude[i * n + j] += fabsl(a_ip * b_pj);
+                    }
+                }
+            }
+
+            for (size_t j = 0; j < m * n; ++j) {
+                const long double value = read_data_type(CAST_PTR_AT_INDEX(res.data, j, res.data_type), res.data_type);
+                if (!(fabsl(value - expected[j]) <= tolerance * magnitude[j])) {
+                    printf("Gemm mismatch: data type %d, operand %u, element %zu\n", types[t], o, j);
+                    failures++;
+                    break;
+                }
+            }
+
+            DEALLOCATE_PTRS(expected, magnitude);
+            DEALLOCATE_TENSORS(res, b_copy);
+        }
+
+        DEALLOCATE_TENSORS(a, b, b_t, operands[1]);
+    }
+
+    printf("Gemm: %u data type(s) checked, %u failure(s)\n", (unsigned int) ARR_SIZE(types), failures);
+
+    return;
+}
+
+void test_thread_pool(void) {
+    // Splitting the loops across threads must not change a single bit of the results
+    const unsigned int threads[] = { 2, 3, 8 };
+    size_t shape_a[] = { 300, 517 };
+    size_t shape_b[] = { 517, 263 };
+    size_t shape_c[] = { 40, 60, 60, 3 };
+    unsigned int default_threads = get_num_threads();
+    unsigned int failures = 0;
+
+    Tensor a = alloc_tensor(shape_a, ARR_SIZE(shape_a), FLOAT_32);
+    Tensor b = alloc_tensor(shape_b, ARR_SIZE(shape_b), FLOAT_32);
+    Tensor c = alloc_tensor(shape_c, ARR_SIZE(shape_c), FLOAT_32);
+    randomize_tensor(a);
+    randomize_tensor(b);
+    randomize_tensor(c);
+
+    Tensor expected[5], res[5];
+    for (unsigned int t = 0; t <= ARR_SIZE(threads); ++t) {
+        Tensor* out = t ? res : expected;
+        set_num_threads(t ? threads[t - 1] : 1);
+        for (unsigned int i = 0; i < ARR_SIZE(res); ++i) out[i] = empty_tensor(FLOAT_32);
+        DOT_TENSOR(out, a, b);
+        TANH_TENSOR(out + 1, a);
+        contract_tensor(copy_tensor(out + 2, c), 1, 2);
+        contiguous_tensor(transpose_tensor(copy_tensor(out + 3, a)));
+        normal(copy_tensor(out + 4, a));
+        for (unsigned int i = 0; t && i < ARR_SIZE(res); ++i) {
+            if (TENSOR_SIZE(res[i]) != TENSOR_SIZE(expected[i]) || memcmp(res[i].data, expected[i].data, TENSOR_SIZE(res[i]) * DATA_TYPE_SIZE(res[i].data_type))) {
+                printf("Thread pool mismatch: operation %u, %u threads\n", i, threads[t - 1]);
+                failures++;
+            }
+            DEALLOCATE_TENSORS(res[i]);
+        }
+    }
+
+    for (unsigned int i = 0; i < ARR_SIZE(expected); ++i) DEALLOCATE_TENSORS(expected[i]);
+    DEALLOCATE_TENSORS(a, b, c);
+    set_num_threads(default_threads);
+    printf("Thread pool: %u thread count(s) checked, %u failure(s)\n", (unsigned int) ARR_SIZE(threads), failures);
+
+    return;
+}
+
+void test_tensor_views(void) {
+    // Operating on a view must give the same bits as operating on its materialized copy
+    size_t shape_a[] = { 67, 300 };
+    size_t shape_b[] = { 300, 45 };
+    unsigned int failures = 0;
+
+    Tensor a = alloc_tensor(shape_a, ARR_SIZE(shape_a), FLOAT_32);
+    Tensor b = alloc_tensor(shape_b, ARR_SIZE(shape_b), FLOAT_32);
+    randomize_tensor(a);
+    randomize_tensor(b);
+
+    Tensor views[4], copies[4], expected[4], res[4];
+    for (unsigned int i = 0; i < ARR_SIZE(views); ++i) {
+        views[i] = empty_tensor(FLOAT_32);
+        copies[i] = empty_tensor(FLOAT_32);
+        expected[i] = empty_tensor(FLOAT_32);
+        res[i] = empty_tensor(FLOAT_32);
+    }
+
+    transpose_tensor(view_tensor(views, b, b.shape, b.rank));
+    slice_tensor(views + 1, a, 0, 10, 55);
+    transpose_tensor(view_tensor(views + 2, a, a.shape, a.rank));
+    extract_tensor(views + 3, a, 7, 0);
+    for (unsigned int i = 0; i < ARR_SIZE(views); ++i) copy_tensor(copies + i, views[i]);
+
+    DOT_TENSOR(expected, copies[0], a);
+    DOT_TENSOR(res, views[0], a);
+    SUM_TENSOR(expected + 1, copies[1], copies[0]);
+    SUM_TENSOR(res + 1, views[1], views[0]);
+    TANH_TENSOR(expected + 2, copies[2]);
+    TANH_TENSOR(res + 2, views[2]);
+    EXP_TENSOR(expected + 3, copies[3]);
+    EXP_TENSOR(res + 3, views[3]);
+
+    for (unsigned int i = 0; i < ARR_SIZE(res); ++i) {
+        if (TENSOR_SIZE(res[i]) != TENSOR_SIZE(expected[i]) || memcmp(res[i].data, expected[i].data, TENSOR_SIZE(res[i]) * DATA_TYPE_SIZE(res[i].data_type))) {
+            printf("Tensor view mismatch: operation %u\n", i);
+            failures++;
+        }
+        DEALLOCATE_TENSORS(views[i], copies[i], expected[i], res[i]);
+    }
+
+    DEALLOCATE_TENSORS(a, b);
+    printf("Tensor views: %u operation(s) checked, %u failure(s)\n", (unsigned int) ARR_SIZE(res), failures);
+
+    return;
+}
+
+void test_graph_fusion(void) {
+    // The fused activations must match the chains they replace, in value and in gradient
+    size_t shape[] = { 4, 64 };
+    unsigned int failures = 0;
+
+    Tensor inputs[2], sinks[2], graphs[3][FUSABLE_CHAIN_SIZE];
+    for (unsigned int i = 0; i < ARR_SIZE(inputs); ++i) {
+        ALLOC_TENSOR_GRAD_GRAPH(inputs[i], shape, ARR_SIZE(shape), FLOAT_32);
+        for (unsigned int j = 0; j < TENSOR_SIZE(inputs[i]); ++j) CAST_PTR(inputs[i].data, float)[j] = CAST_PTR(NODE_TENSOR(inputs[i].grad_node) -> data, float)[j] = (j % 37) * 0.2f - 3.6f;
+        sinks[i] = fusable_chain(inputs[i], graphs[i], (float) GELU_SCALE);
+    }
+
+    unsigned int fused_count = fuse_grad_graph(sinks[1].grad_node);
+    if (fused_count != 2) failures++;
+    DERIVE_NODE_REVERSE(sinks[0].grad_node);
+    DERIVE_NODE_REVERSE(sinks[1].grad_node);
+
+    for (unsigned int j = 0; j < TENSOR_SIZE(inputs[0]); ++j) {
+        const float value_diff = CAST_PTR(NODE_TENSOR(sinks[0].grad_node) -> data, float)[j] - CAST_PTR(NODE_TENSOR(sinks[1].grad_node) -> data, float)[j];
+        const float grad_diff = DERIVED_VALUE(inputs[0].grad_node, float)[j] - DERIVED_VALUE(inputs[1].grad_node, float)[j];
+        if (fabsf(value_diff) > 1e-5f || fabsf(grad_diff) > 1e-5f) {
+            printf("Graph fusion mismatch: element %u\n", j);
+            failures++;
+        }
+    }
+
+    // A scale one ulp away from sqrt(2/pi), as test_gelu computes it, leaves the GELU chain as it is
+    Tensor sink = fusable_chain(inputs[0], graphs[2], sqrtf(2.0f / M_PI));
+    if (fuse_grad_graph(sink.grad_node) != 1) failures++;
+
+    for (unsigned int i = 0; i < ARR_SIZE(graphs); ++i) deallocate_graph_tensors(graphs[i], FUSABLE_CHAIN_SIZE);
+    DEALLOCATE_GRAD_GRAPHS(inputs[0].grad_node, inputs[1].grad_node);
+    DEALLOCATE_TENSORS(inputs[0], inputs[1]);
+    printf("Graph fusion: %u chain(s) fused, %u failure(s)\n", fused_count, failures);
+
+    return;
+}
+
+void test_memory_planner(void) {
+    // A plan running over shared buffers must compute what the graph computes with a buffer per node
+    size_t shape[] = { 8, 32 };
+    size_t shape_w[] = { 32, 32 };
+    unsigned int failures = 0;
+
+    // Each layer holds its weights, its pre-activation and its activation chain
+    const unsigned int layer_size = FUSABLE_CHAIN_SIZE + 2;
+    Tensor inputs[2], sinks[2], graphs[2][6 * (FUSABLE_CHAIN_SIZE + 2)];
+    for (unsigned int i = 0; i < ARR_SIZE(inputs); ++i) {
+        ALLOC_TENSOR_GRAD_GRAPH(inputs[i], shape, ARR_SIZE(shape), FLOAT_32);
+        Tensor layer = inputs[i];
+        for (unsigned int l = 0; l < 6; ++l) {
+            Tensor* graph = graphs[i] + l * layer_size;
+            float val = 0.01f * (l + 1);
+            ALLOC_TENSOR_GRAD_GRAPH_FILLED(graph[0], shape_w, ARR_SIZE(shape_w), FLOAT_32, &val);
+            graph[1] = empty_tensor(FLOAT_32);
+            TENSOR_GRAPH_DOT(graph + 1, layer, graph[0]);
+            layer = fusable_chain(graph[1], graph + 2, (float) GELU_SCALE);
+        }
+        sinks[i] = layer;
+    }
+
+    fuse_grad_graph(sinks[1].grad_node);
+    GradPlan plan = compile_graph(sinks[1].grad_node);
+    size_t planned_size = plan_graph_memory(&plan, FALSE);
+
+    for (unsigned int j = 0; j < TENSOR_SIZE(inputs[0]); ++j) CAST_PTR(NODE_TENSOR(inputs[0].grad_node) -> data, float)[j] = CAST_PTR(NODE_TENSOR(inputs[1].grad_node) -> data, float)[j] = (j % 13) * 0.5f - 3.0f;
+    set_update_flag(FALSE, inputs[0].grad_node);
+    set_update_flag(FALSE, inputs[1].grad_node);
+    backward_pass(sinks[0].grad_node);
+    run_compiled_graph(plan);
+
+    for (unsigned int j = 0; j < TENSOR_SIZE(*NODE_TENSOR(sinks[0].grad_node)); ++j) {
+        if (fabsf(CAST_PTR(NODE_TENSOR(sinks[0].grad_node) -> data, float)[j] - CAST_PTR(NODE_TENSOR(sinks[1].grad_node) -> data, float)[j]) > 1e-5f) {
+            printf("Memory planner mismatch: element %u\n", j);
+            failures++;
+        }
+    }
+
+    deallocate_compiled_graph(&plan);
+    for (unsigned int i = 0; i < ARR_SIZE(inputs); ++i) deallocate_graph_tensors(graphs[i], ARR_SIZE(graphs[i]));
+    DEALLOCATE_GRAD_GRAPHS(inputs[0].grad_node, inputs[1].grad_node);
+    DEALLOCATE_TENSORS(inputs[0], inputs[1]);
+    printf("Memory planner: %zu byte(s) shared by the intermediates, %u failure(s)\n", planned_size, failures);
+
+    return;
+}
+
+void test_compiled_graph(void) {
+    // A graph fused and compiled once must follow every new input, as the graph evaluated node by node does
+    size_t shape[] = { 2, 1 };
+    size_t shape_w[] = { 1, 2 };
+    size_t shape_b[] = { 2, 2 };
+    float values[] = { 120.0f, 1.0f, -3.5f };
+    unsigned int failures = 0;
+
+    // Each graph holds its pre-activation, then its activation chain
+    Tensor inputs[2], weights[2], biases[2], sinks[2], graphs[2][2 + FUSABLE_CHAIN_SIZE];
+    for (unsigned int i = 0; i < ARR_SIZE(inputs); ++i) {
+        float val = 1.0f;
+        ALLOC_TENSOR_GRAD_GRAPH_FILLED(inputs[i], shape, ARR_SIZE(shape), FLOAT_32, &val);
+        ALLOC_TENSOR_GRAD_GRAPH_FILLED(weights[i], shape_w, ARR_SIZE(shape_w), FLOAT_32, &val);
+        ALLOC_TENSOR_GRAD_GRAPH_FILLED(biases[i], shape_b, ARR_SIZE(shape_b), FLOAT_32, &val);
+        EMPTY_TENSORS(FLOAT_32, graphs[i], graphs[i] + 1);
+        TENSOR_GRAPH_SUM(graphs[i] + 1, *TENSOR_GRAPH_DOT(graphs[i], inputs[i], weights[i]), biases[i]);
+        sinks[i] = fusable_chain(graphs[i][1], graphs[i] + 2, (float) GELU_SCALE);
+    }
+
+    const unsigned int fused_count = fuse_grad_graph(sinks[1].grad_node);
+    GradPlan plan = compile_graph(sinks[1].grad_node);
+    plan_graph_memory(&plan, FALSE);
+
+    for (unsigned int v = 0; v < ARR_SIZE(values); ++v) {
+        for (unsigned int i = 0; i < ARR_SIZE(inputs); ++i) {
+            fill_tensor(values + v, *NODE_TENSOR(inputs[i].grad_node));
+            set_update_flag(FALSE, inputs[i].grad_node);
+        }
+        backward_pass(sinks[0].grad_node);
+        run_compiled_graph(plan);
+        for (unsigned int j = 0; j < TENSOR_SIZE(*NODE_TENSOR(sinks[0].grad_node)); ++j) {
+            if (fabsf(CAST_PTR(NODE_TENSOR(sinks[0].grad_node) -> data, float)[j] - CAST_PTR(NODE_TENSOR(sinks[1].grad_node) -> data, float)[j]) > 1e-6f) {
+                printf("Compiled graph mismatch: input %g, element %u\n", values[v], j);
+                failures++;
+            }
+        }
+    }
+
+    deallocate_compiled_graph(&plan);
+    for (unsigned int i = 0; i < ARR_SIZE(inputs); ++i) deallocate_graph_tensors(graphs[i], ARR_SIZE(graphs[i]));
+    DEALLOCATE_GRAD_GRAPHS(inputs[0].grad_node, inputs[1].grad_node, weights[0].grad_node, weights[1].grad_node, biases[0].grad_node, biases[1].grad_node);
+    DEALLOCATE_TENSORS(inputs[0], inputs[1], weights[0], weights[1], biases[0], biases[1]);
+    printf("Compiled graph: %u chain(s) fused, %u input(s) evaluated, %u failure(s)\n", fused_count, (unsigned int) ARR_SIZE(values), failures);
+
+    return;
+}
+
+void test_checkpointing(void) {
+    // Recomputing the released values during the sweep must leave the gradients untouched
+    size_t shape[] = { 16 };
+    unsigned int failures = 0;
+    CheckpointPolicy policies[] = { CHECKPOINT_NONE, CHECKPOINT_SQRT };
+
+    // Every layer holds a product and its activation
+    Tensor inputs[2], weights[2], graphs[2][2 * 32];
+    const unsigned int layers_count = ARR_SIZE(graphs[0]) / 2;
+    for (unsigned int i = 0; i < ARR_SIZE(policies); ++i) {
+        float val = 0.9f;
+        ALLOC_TENSOR_GRAD_GRAPH(inputs[i], shape, ARR_SIZE(shape), FLOAT_32);
+        ALLOC_TENSOR_GRAD_GRAPH_FILLED(weights[i], shape, ARR_SIZE(shape), FLOAT_32, &val);
+        for (unsigned int j = 0; j < TENSOR_SIZE(inputs[i]); ++j) CAST_PTR(inputs[i].data, float)[j] = CAST_PTR(NODE_TENSOR(inputs[i].grad_node) -> data, float)[j] = j * 0.1f - 0.8f;
+
+        Tensor layer = inputs[i];
+        for (unsigned int l = 0; l < layers_count; ++l) {
+            Tensor* graph = graphs[i] + 2 * l;
+            EMPTY_TENSORS(FLOAT_32, graph, graph + 1);
+            TENSOR_GRAPH_TANH(graph + 1, *TENSOR_GRAPH_MUL(graph, layer, weights[i]));
+            layer = graph[1];
+        }
+
+        SET_CHECKPOINT_POLICY(policies[i], 0);
+        DERIVE_NODE_REVERSE(layer.grad_node);
+    }
+    SET_CHECKPOINT_POLICY(CHECKPOINT_NONE, 0);
+
+    for (unsigned int j = 0; j < TENSOR_SIZE(inputs[0]); ++j) {
+        if (DERIVED_VALUE(weights[0].grad_node, float)[j] != DERIVED_VALUE(weights[1].grad_node, float)[j]) {
+            printf("Checkpointing mismatch: element %u\n", j);
+            failures++;
+        }
+    }
+
+    for (unsigned int i = 0; i < ARR_SIZE(inputs); ++i) deallocate_graph_tensors(graphs[i], ARR_SIZE(graphs[i]));
+    DEALLOCATE_GRAD_GRAPHS(inputs[0].grad_node, inputs[1].grad_node, weights[0].grad_node, weights[1].grad_node);
+    DEALLOCATE_TENSORS(inputs[0], inputs[1], weights[0], weights[1]);
+    printf("Checkpointing: %u layer(s) derived, %u failure(s)\n", layers_count, failures);
+
+    return;
+}
+
+void test_grad_accumulation(void) {
+    // The contributions of every path are added into the same gradient: y = x * x + x * w + e^x, so dy/dx = 2x + w + e^x
+    size_t shape[] = { 4, 8 };
+    size_t shape_w[] = { 8 };
+    unsigned int failures = 0;
+
+    Tensor x, w;
+    float val = 0.5f;
+    ALLOC_TENSOR_GRAD_GRAPH(x, shape, ARR_SIZE(shape), FLOAT_32);
+    ALLOC_TENSOR_GRAD_GRAPH_FILLED(w, shape_w, ARR_SIZE(shape_w), FLOAT_32, &val);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) CAST_PTR(x.data, float)[j] = CAST_PTR(NODE_TENSOR(x.grad_node) -> data, float)[j] = (j % 9) * 0.25f - 1.0f;
+
+    Tensor a, b, c, d, y;
+    EMPTY_TENSORS(FLOAT_32, &a, &b, &c, &d, &y);
+    TENSOR_GRAPH_SUM(&y, *TENSOR_GRAPH_SUM(&d, *TENSOR_GRAPH_MUL(&a, x, x), *TENSOR_GRAPH_MUL(&b, x, w)), *TENSOR_GRAPH_EXP(&c, x));
+    DERIVE_NODE_REVERSE(y.grad_node);
+
+    // w is broadcast over the rows of x, its gradient sums them back
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) {
+        const float value = CAST_PTR(x.data, float)[j];
+        if (fabsf(DERIVED_VALUE(x.grad_node, float)[j] - (2.0f * value + val + expf(value))) > 1e-5f) {
+            printf("Gradient accumulation mismatch: x element %u\n", j);
+            failures++;
+        }
+    }
+    for (unsigned int j = 0; j < TENSOR_SIZE(w); ++j) {
+        float expected = 0.0f;
+        for (unsigned int i = 0; i < shape[0]; ++i) expected += CAST_PTR(x.data, float)[i * shape[1] + j];
+        if (fabsf(DERIVED_VALUE(w.grad_node, float)[j] - expected) > 1e-5f) {
+            printf("Gradient accumulation mismatch: w element %u\n", j);
+            failures++;
+        }
+    }
+
+    DEALLOCATE_GRAD_GRAPHS(x.grad_node, w.grad_node);
+    DEALLOCATE_TENSORS(x, w, a, b, c, d, y);
+
+    // An operand read twice by the same node gets the rule of each slot: z = (p - p) + p / p, so dz/dp = 0
+    Tensor p, e, f, z;
+    ALLOC_TENSOR_GRAD_GRAPH(p, shape, ARR_SIZE(shape), FLOAT_32);
+    for (unsigned int j = 0; j < TENSOR_SIZE(p); ++j) CAST_PTR(p.data, float)[j] = CAST_PTR(NODE_TENSOR(p.grad_node) -> data, float)[j] = (j % 7) * 0.5f + 0.5f;
+    EMPTY_TENSORS(FLOAT_32, &e, &f, &z);
+    TENSOR_GRAPH_SUM(&z, *TENSOR_GRAPH_SUB(&e, p, p), *TENSOR_GRAPH_DIV(&f, p, p));
+    DERIVE_NODE_REVERSE(z.grad_node);
+    for (unsigned int j = 0; j < TENSOR_SIZE(p); ++j) {
+        if (fabsf(DERIVED_VALUE(p.grad_node, float)[j]) > 1e-6f) {
+            printf("Gradient accumulation mismatch: p element %u\n", j);
+            failures++;
+        }
+    }
+
+    DEALLOCATE_GRAD_GRAPHS(p.grad_node);
+    DEALLOCATE_TENSORS(p, e, f, z);
+    printf("Gradient accumulation: %u failure(s)\n", failures);
+
+    return;
+}
+
+void test_no_grad(void) {
+    // Inside a no-grad scope the graph operations compute the same values without building any node
+    size_t shape[] = { 4, 16 };
+    unsigned int failures = 0;
+
+    Tensor x;
+    ALLOC_TENSOR_GRAD_GRAPH(x, shape, ARR_SIZE(shape), FLOAT_32);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) CAST_PTR(x.data, float)[j] = CAST_PTR(NODE_TENSOR(x.grad_node) -> data, float)[j] = (j % 11) * 0.4f - 2.0f;
+
+    Tensor graph_res = empty_tensor(FLOAT_32), res = empty_tensor(FLOAT_32);
+    TENSOR_GRAPH_GELU(&graph_res, x);
+    PUSH_NO_GRAD();
+    TENSOR_GRAPH_GELU(&res, x);
+    if (is_grad_enabled() || (res.grad_node != NULL) || (CAST_PTR(x.grad_node, GradNode) -> children_count != 1)) failures++;
+    POP_NO_GRAD();
+    if (!is_grad_enabled()) failures++;
+
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) {
+        if (CAST_PTR(graph_res.data, float)[j] != CAST_PTR(res.data, float)[j]) {
+            printf("No-grad mismatch: element %u\n", j);
+            failures++;
+        }
+    }
+
+    DEALLOCATE_GRAD_GRAPHS(x.grad_node);
+    DEALLOCATE_TENSORS(x, graph_res, res);
+    printf("No-grad: %u failure(s)\n", failures);
+
+    return;
+}
+
+void test_softmax(void) {
+    // Cross-entropy over rows far from zero: the rows must stay finite and the gradient must be softmax(x) - target
+    size_t shape[] = { 8, 128 };
+    unsigned int failures = 0;
+
+    Tensor x, target;
+    ALLOC_TENSOR_GRAD_GRAPH(x, shape, ARR_SIZE(shape), FLOAT_32);
+    ALLOC_TENSOR_GRAD_GRAPH(target, shape, ARR_SIZE(shape), FLOAT_32);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) {
+        CAST_PTR(x.data, float)[j] = CAST_PTR(NODE_TENSOR(x.grad_node) -> data, float)[j] = 500.0f + (j % 17) * 0.75f;
+        CAST_PTR(target.data, float)[j] = CAST_PTR(NODE_TENSOR(target.grad_node) -> data, float)[j] = (j % shape[1] == (j / shape[1]) * 3) ? -1.0f : 0.0f;
+    }
+
+    Tensor log_probs = empty_tensor(FLOAT_32), loss = empty_tensor(FLOAT_32), probs = empty_tensor(FLOAT_32);
+    TENSOR_GRAPH_MUL(&loss, *TENSOR_GRAPH_LOG_SOFTMAX(&log_probs, x), target);
+    DERIVE_NODE_REVERSE(loss.grad_node);
+    SOFTMAX_TENSOR(&probs, x);
+
+    for (unsigned int i = 0; i < shape[0]; ++i) {
+        float row_sum = 0.0f;
+        for (unsigned int j = 0; j < shape[1]; ++j) row_sum += CAST_PTR(probs.data, float)[i * shape[1] + j];
+        if (fabsf(row_sum - 1.0f) > 1e-5f) failures++;
+    }
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) {
+        const float expected = CAST_PTR(probs.data, float)[j] + CAST_PTR(target.data, float)[j];
+        if (!isfinite(CAST_PTR(log_probs.data, float)[j]) || fabsf(DERIVED_VALUE(x.grad_node, float)[j] - expected) > 1e-5f) {
+            printf("Softmax mismatch: element %u\n", j);
+            failures++;
+        }
+    }
+
+    DEALLOCATE_GRAD_GRAPHS(x.grad_node, target.grad_node);
+    DEALLOCATE_TENSORS(x, target, log_probs, loss, probs);
+    printf("Softmax: %u failure(s)\n", failures);
+
+    return;
+}
+
+void test_reductions(void) {
+    // Axis reductions against a naive double precision loop, then the gradients of a batch mean and of a row norm
+    size_t shape[] = { 6, 5, 4 };
+    unsigned int failures = 0;
+
+    Tensor x, squares = empty_tensor(FLOAT_32), loss = empty_tensor(FLOAT_32);
+    ALLOC_TENSOR_GRAD_GRAPH(x, shape, ARR_SIZE(shape), FLOAT_32);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) CAST_PTR(x.data, float)[j] = CAST_PTR(NODE_TENSOR(x.grad_node) -> data, float)[j] = ((j * 37) % 23) * 0.25f - 2.5f;
+    float* data = CAST_PTR(x.data, float);
+
+    Tensor sums = empty_tensor(FLOAT_32), maxs = empty_tensor(FLOAT_32), indices = empty_tensor(FLOAT_32), lse = empty_tensor(FLOAT_32);
+    REDUCE_SUM_TENSOR(&sums, x, AXIS(0) | AXIS(2), FALSE);
+    REDUCE_MAX_TENSOR(&maxs, x, AXIS(1), TRUE);
+    ARGMAX_TENSOR(&indices, x, AXIS(1), TRUE);
+    LOGSUMEXP_TENSOR(&lse, x, AXIS(2), FALSE);
+    if ((sums.rank != 1) || (sums.shape[0] != shape[1]) || (maxs.rank != 3) || (maxs.shape[1] != 1) || (lse.rank != 2)) failures++;
+
+    for (unsigned int j = 0; j < shape[1]; ++j) {
+        double expected = 0.0;
+        for (unsigned int i = 0; i < shape[0]; ++i) {
+            for (unsigned int k = 0; k < shape[2]; ++k) expected += data[(i * shape[1] + j) * shape[2] + k];
+        }
+        if (fabs(CAST_PTR(sums.data, float)[j] - expected) > 1e-4) failures++;
+    }
+    for (unsigned int i = 0; i < shape[0]; ++i) {
+        for (unsigned int k = 0; k < shape[2]; ++k) {
+            const float max = CAST_PTR(maxs.data, float)[i * shape[2] + k];
+            const unsigned int index = (unsigned int) CAST_PTR(indices.data, float)[i * shape[2] + k];
+            if ((index >= shape[1]) || (data[(i * shape[1] + index) * shape[2] + k] != max)) failures++;
+        }
+        for (unsigned int j = 0; j < shape[1]; ++j) {
+            double expected = 0.0;
+            for (unsigned int k = 0; k < shape[2]; ++k) expected += exp(data[(i * shape[1] + j) * shape[2] + k]);
+            if (fabs(CAST_PTR(lse.data, float)[i * shape[1] + j] - log(expected)) > 1e-5) failures++;
+        }
+    }
+
+    // The gradient of mean(x^2) is 2x / N
+    TENSOR_GRAPH_REDUCE_MEAN(&loss, *TENSOR_GRAPH_MUL(&squares, x, x), 0, FALSE);
+    DERIVE_NODE_REVERSE(loss.grad_node);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) {
+        if (fabsf(DERIVED_VALUE(x.grad_node, float)[j] - 2.0f * data[j] / TENSOR_SIZE(x)) > 1e-6f) {
+            printf("Mean gradient mismatch: element %u\n", j);
+            failures++;
+        }
+    }
+    DEALLOCATE_GRAD_GRAPHS(x.grad_node);
+    DEALLOCATE_TENSORS(x, squares, loss);
+
+    // The gradient of the L2 norm of every row is the row divided by its norm
+    Tensor norms = empty_tensor(FLOAT_32), total = empty_tensor(FLOAT_32);
+    ALLOC_TENSOR_GRAD_GRAPH(x, shape, ARR_SIZE(shape), FLOAT_32);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) CAST_PTR(x.data, float)[j] = CAST_PTR(NODE_TENSOR(x.grad_node) -> data, float)[j] = ((j * 37) % 23) * 0.25f - 2.5f;
+    TENSOR_GRAPH_REDUCE_SUM(&total, *TENSOR_GRAPH_REDUCE_NORM(&norms, x, AXIS(2), TRUE, 2.0L), 0, FALSE);
+    DERIVE_NODE_REVERSE(total.grad_node);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) {
+        if (fabsf(DERIVED_VALUE(x.grad_node, float)[j] - CAST_PTR(x.data, float)[j] / CAST_PTR(norms.data, float)[j / shape[2]]) > 1e-5f) {
+            printf("Norm gradient mismatch: element %u\n", j);
+            failures++;
+        }
+    }
+    DEALLOCATE_GRAD_GRAPHS(x.grad_node);
+
+    // Summing a million times 0.1 drifts by whole units without the compensation
+    size_t long_shape[] = { 1 << 20 };
+    Tensor ones = alloc_tensor(long_shape, ARR_SIZE(long_shape), FLOAT_32), sum = empty_tensor(FLOAT_32);
+    fill_tensor(&(float) {0.1f}, ones);
+    REDUCE_SUM_TENSOR(&sum, ones, 0, FALSE);
+    if (fabs(CAST_PTR(sum.data, float)[0] - (double) 0.1f * long_shape[0]) > 1e-2) failures++;
+
+    DEALLOCATE_TENSORS(x, norms, total, sums, maxs, indices, lse, ones, sum);
+    printf("Reductions: %u failure(s)\n", failures);
+
+    return;
+}
+
+void test_reduced_precision(void) {
+    // Conversions at the edges of the half range, element-wise operators on FP16 and BF16 storage, then an INT_8 gemm
+    // against the exact integer product and against the float one it approximates
+    unsigned int failures = 0;
+    const float half_values[] = { 1.0f, -2.5f, 65504.0f, 70000.0f, 5.9604645e-8f, 1e-9f };
+    const unsigned short half_bits[] = { 0x3C00, 0xC100, 0x7BFF, 0x7C00, 0x0001, 0x0000 };
+    for (unsigned int i = 0; i < ARR_SIZE(half_values); ++i) {
+        if ((float_to_half(half_values[i]) != half_bits[i]) || ((i != 3) && (i != 5) && (half_to_float(half_bits[i]) != half_values[i]))) failures++;
+    }
+    if ((float_to_bfloat(1.0f) != 0x3F80) || (bfloat_to_float(float_to_bfloat(3.0f)) != 3.0f) || (float_to_bfloat(1.00390625f) != 0x3F80)) failures++;
+
+    size_t shape[] = { 4, 33 };
+    Tensor x = alloc_tensor(shape, ARR_SIZE(shape), FLOAT_32), y = alloc_tensor(shape, ARR_SIZE(shape), FLOAT_32), expected = empty_tensor(FLOAT_32);
+    for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) CAST_PTR(x.data, float)[j] = j * 0.125f - 3.0f, CAST_PTR(y.data, float)[j] = (j % 7) * 0.5f;
+    MULTIPLY_TENSOR(&expected, x, y);
+    const DataType storage_types[] = { FLOAT_16, BFLOAT_16 };
+    for (unsigned int t = 0; t < ARR_SIZE(storage_types); ++t) {
+        Tensor x_low = empty_tensor(storage_types[t]), y_low = empty_tensor(storage_types[t]), res = empty_tensor(storage_types[t]), res_f32 = empty_tensor(FLOAT_32);
+        cast_tensor(&x_low, x, storage_types[t]);
+        cast_tensor(&y_low, y, storage_types[t]);
+        cast_tensor(&res_f32, *MULTIPLY_TENSOR(&res, x_low, y_low), FLOAT_32);
+        if ((res.data_type != storage_types[t]) || (DATA_TYPE_SIZE(res.data_type) != 2)) failures++;
+        for (unsigned int j = 0; j < TENSOR_SIZE(x); ++j) {
+            if (fabsf(CAST_PTR(res_f32.data, float)[j] - CAST_PTR(expected.data, float)[j]) > 1e-2f * MAX(fabsf(CAST_PTR(expected.data, float)[j]), 1.0f)) failures++;
+        }
+        DEALLOCATE_TENSORS(x_low, y_low, res, res_f32);
+    }
+
+    size_t a_shape[] = { 48, 96 }, b_shape[] = { 96, 40 };
+    Tensor a = alloc_tensor(a_shape, ARR_SIZE(a_shape), FLOAT_32), b = alloc_tensor(b_shape, ARR_SIZE(b_shape), FLOAT_32);
+    for (unsigned int j = 0; j < TENSOR_SIZE(a); ++j) CAST_PTR(a.data, float)[j] = ((j * 13) % 29) * 0.1f - 1.4f;
+    for (unsigned int j = 0; j < TENSOR_SIZE(b); ++j) CAST_PTR(b.data, float)[j] = ((j * 7) % 31) * 0.05f - 0.75f;
+    Quantization a_quantization = compute_quantization(a, QUANTIZE_PER_TENSOR, TRUE), b_quantization = compute_quantization(b, QUANTIZE_PER_TENSOR, TRUE);
+    Tensor a_q = empty_tensor(INT_8), b_q = empty_tensor(INT_8), c_q = empty_tensor(INT_8), c = empty_tensor(FLOAT_32), c_float = empty_tensor(FLOAT_32), a_back = empty_tensor(FLOAT_32);
+    quantize_tensor(&a_q, a, a_quantization);
+    quantize_tensor(&b_q, b, b_quantization);
+    DOT_TENSOR(&c_q, a_q, b_q);
+    DOT_TENSOR(&c_float, a, b);
+    for (unsigned int i = 0; i < a_shape[0]; ++i) {
+        for (unsigned int j = 0; j < b_shape[1]; ++j) {
+            int exact = 0;
+            for (unsigned int k = 0; k < a_shape[1]; ++k) exact += CAST_PTR(a_q.data, signed char)[i * a_shape[1] + k] * CAST_PTR(b_q.data, signed char)[k * b_shape[1] + j];
+            if (CAST_PTR(c_q.data, int)[i * b_shape[1] + j] != exact) failures++;
+        }
+    }
+    float product_scale = a_quantization.scales[0] * b_quantization.scales[0];
+    int zero_point = 0;
+    dequantize_tensor(&c, c_q, (Quantization) { .scales = &product_scale, .zero_points = &zero_point, .channels = 1, .axis = QUANTIZE_PER_TENSOR });
+    for (unsigned int j = 0; j < TENSOR_SIZE(c); ++j) {
+        if (fabsf(CAST_PTR(c.data, float)[j] - CAST_PTR(c_float.data, float)[j]) > 0.1f) failures++;
+    }
+
+    // A per-channel round trip stays within half a step of every channel
+    Quantization row_quantization = compute_quantization(a, 0, FALSE);
+    dequantize_tensor(&a_back, *quantize_tensor(&a_q, a, row_quantization), row_quantization);
+    for (unsigned int j = 0; j < TENSOR_SIZE(a); ++j) {
+        if (fabsf(CAST_PTR(a_back.data, float)[j] - CAST_PTR(a.data, float)[j]) > 0.5f * row_quantization.scales[j / a_shape[1]] + 1e-6f) failures++;
+    }
+
+    deallocate_quantization(&a_quantization);
+    deallocate_quantization(&b_quantization);
+    deallocate_quantization(&row_quantization);
+    DEALLOCATE_TENSORS(x, y, expected, a, b, a_q, b_q, c_q, c, c_float, a_back);
+    printf("Reduced precision: %u failure(s)\n", failures);
+
+    return;
+}
+
 Tensor test_gelu(Tensor x) {
-    unsigned int shape[] = {2, 1};
+    // The constants are broadcast against x
+    size_t shape[] = {1};
     float val = 1.0f;
 
     Tensor x1, x2, x3, x4;